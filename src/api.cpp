@@ -1,10 +1,18 @@
 #include "api.hpp"
 
+#include "apt_tessellator.hpp"
+#include "great_circle.hpp"
 #include "plugin.hpp"
 #include "triangulator.hpp"
 #include "wmm_interface.hpp"
 
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
 static avionicsbay::XPData* xpdata;
+static avionicsbay::EventQueue* events;
 static avionicsbay::Triangulator t;
 
 #if __GNUC__
@@ -23,8 +31,11 @@ static avionicsbay::Triangulator t;
 #define SANITY_CHECK_INT() if (unlikely(xpdata == nullptr)) { return 0; }
 
 #define SANITY_CHECK_DFR_VOID() if (unlikely(avionicsbay::get_dfr() == nullptr)) { return; }
+#define SANITY_CHECK_DFR_INT() if (unlikely(avionicsbay::get_dfr() == nullptr)) { return 0; }
 #define SANITY_CHECK_CIFP_VOID() if (unlikely(avionicsbay::get_cifp() == nullptr)) { return; }
 #define SANITY_CHECK_CIFP_BOOL() if (unlikely(avionicsbay::get_cifp() == nullptr)) { return false; }
+#define SANITY_CHECK_CIFP_STRUCT() if (unlikely(avionicsbay::get_cifp() == nullptr)) { return {}; }
+#define SANITY_CHECK_CIFP_PTR() if (unlikely(avionicsbay::get_cifp() == nullptr)) { return nullptr; }
 
 /**************************************************************************************************/
 /** Helpers functions **/
@@ -65,6 +76,13 @@ static xpdata_awy_array_t build_awy_array(std::pair<const xpdata_awy_t* const*,
     return array;
 }
 
+static xpdata_cifp_ptr_array_t build_cifp_ptr_array(std::pair<const xpdata_cifp_data_t* const*, size_t> std_vec) {
+    xpdata_cifp_ptr_array_t array;
+    array.data = std_vec.first;
+    array.len = std_vec.second;
+    return array;
+}
+
 /**************************************************************************************************/
 /** NAVAIDS **/
 /**************************************************************************************************/
@@ -114,27 +132,193 @@ EXPORT_DLL const xpdata_apt_t* get_nearest_apt() {
     return xpdata->get_nearest_airport();
 }
 
+/**************************************************************************************************/
+/** QUERIES **/
+/**************************************************************************************************/
+
+// The records as an untyped result, with the closest one to the reference position if requested
+template<typename T, typename F>
+static xpdata_query_result_t build_query_result(std::pair<T* const*, size_t> std_vec, const xpdata_query_t &query, F get_coords) {
+    xpdata_query_result_t result;
+    result.records = reinterpret_cast<const void* const*>(std_vec.first);
+    result.len = std_vec.second;
+    result.nearest = -1;
+    if (query.use_ref) {
+        double best = std::numeric_limits<double>::max();
+        for (int i=0; i < result.len; i++) {
+            double dist = avionicsbay::gc_distance_nm(query.ref, get_coords(std_vec.first[i]));
+            if (dist < best) {
+                best = dist;
+                result.nearest = i;
+            }
+        }
+    }
+    return result;
+}
+
+EXPORT_DLL int query_batch(const xpdata_query_t* queries, int queries_len, xpdata_query_result_t* results) {
+    SANITY_CHECK_INT();
+    if (queries == nullptr || results == nullptr) {
+        return 0;
+    }
+
+    auto navaid_coords = [](const xpdata_navaid_t *x) { return x->coords; };
+    auto fix_coords = [](const xpdata_fix_t *x) { return x->coords; };
+    auto apt_coords = [](const xpdata_apt_t *x) { return x->apt_center; };
+
+    int found = 0;
+    std::string name;   // Reused by all the queries
+    for (int i=0; i < queries_len; i++) {
+        const xpdata_query_t &q = queries[i];
+        bool by_name = q.type == QUERY_NAVAID_BY_NAME || q.type == QUERY_FIX_BY_NAME || q.type == QUERY_APT_BY_NAME;
+        if (by_name) {
+            if (q.name == nullptr) {
+                results[i] = {nullptr, 0, -1};
+                continue;
+            }
+            name.assign(q.name);
+        }
+
+        switch (q.type) {
+            case QUERY_NAVAID_BY_NAME:
+                results[i] = build_query_result(xpdata->get_navaids_by_name(q.navaid_type, name), q, navaid_coords);
+                break;
+            case QUERY_NAVAID_BY_FREQ:
+                results[i] = build_query_result(xpdata->get_navaids_by_freq(q.navaid_type, q.freq), q, navaid_coords);
+                break;
+            case QUERY_NAVAID_BY_COORDS:
+                results[i] = build_query_result(xpdata->get_navaids_by_coords(q.navaid_type, q.coords.lat, q.coords.lon), q, navaid_coords);
+                break;
+            case QUERY_FIX_BY_NAME:
+                results[i] = build_query_result(xpdata->get_fixes_by_name(name), q, fix_coords);
+                break;
+            case QUERY_FIX_BY_COORDS:
+                results[i] = build_query_result(xpdata->get_fixes_by_coords(q.coords.lat, q.coords.lon), q, fix_coords);
+                break;
+            case QUERY_APT_BY_NAME:
+                results[i] = build_query_result(xpdata->get_apts_by_name(name), q, apt_coords);
+                break;
+            case QUERY_APT_BY_COORDS:
+                results[i] = build_query_result(xpdata->get_apts_by_coords(q.coords.lat, q.coords.lon), q, apt_coords);
+                break;
+            default:
+                results[i] = {nullptr, 0, -1};
+                break;
+        }
+        found += results[i].len > 0;
+    }
+    return found;
+}
+
 EXPORT_DLL void request_apts_details(const char* arpt_id) {
     SANITY_CHECK_DFR_VOID();
-    avionicsbay::get_dfr()->request_apts_details(arpt_id);
+    avionicsbay::get_dfr()->request_apts_details(arpt_id, APT_DETAILS_PRIO_CURRENT);
+}
+
+EXPORT_DLL void request_apts_details_prio(const char* arpt_id, int priority) {
+    SANITY_CHECK_DFR_VOID();
+    avionicsbay::get_dfr()->request_apts_details(arpt_id, priority);
+}
+
+EXPORT_DLL int get_apts_details_status(const char* arpt_id) {
+    SANITY_CHECK_DFR_INT();
+    return avionicsbay::get_dfr()->get_apts_details_status(arpt_id);
+}
+
+EXPORT_DLL void set_apts_details_memory_budget(size_t bytes) {
+    SANITY_CHECK_VOID();
+    xpdata->set_apt_details_memory_budget(bytes);
+}
+
+EXPORT_DLL int get_apt_tess_level(double meters_per_pixel) {
+    return avionicsbay::AptTessellator::level_for_resolution(meters_per_pixel);
 }
 
 EXPORT_DLL xpdata_coords_t get_route_pos(const xpdata_apt_t *apt, int route_id) {
     SANITY_CHECK_COORDS();
     try {
-        return xpdata->get_route_point(apt->pos_seek, route_id);
+        return xpdata->get_route_point(apt, route_id);
     } catch(...) {
         return {0,0};   // If it doesn't exist
     }
 }
 
+EXPORT_DLL xpdata_apt_surface_t get_apt_surface(const xpdata_apt_t *apt, double lat, double lon) {
+    xpdata_apt_surface_t nothing = {-1, 0, -1, -1, 0};
+    if (unlikely(xpdata == nullptr) || apt == nullptr) {
+        return nothing;
+    }
+    const avionicsbay::AptSpatialIndex *index = xpdata->get_apt_spatial_index(apt);
+    return index ? index->query(lat, lon) : nothing;
+}
+
+// The route is written into the buffer up to buffer_len points, the return value is its full
+// length: 0 if there is no route or the details of the airport are not loaded
+static int find_taxi_route_impl(const avionicsbay::AptTaxiGraph *graph, xpdata_coords_t from, const char* rwy_name, const char* const* taxiways, int taxiways_len,
+                                xpdata_apt_taxi_point_t *buffer, int buffer_len) {
+    std::vector<std::string_view> taxiways_list;
+    for (int i=0; i < taxiways_len; i++) {
+        taxiways_list.emplace_back(taxiways[i]);
+    }
+
+    std::vector<avionicsbay::AptTaxiGraph::RoutePoint> route;
+    if (!graph->find_route(from, rwy_name, taxiways_list, route)) {
+        return 0;
+    }
+
+    for (int i=0; i < buffer_len && i < static_cast<int>(route.size()); i++) {
+        buffer[i].coords      = route[i].coords;
+        buffer[i].taxiway     = route[i].taxiway ? route[i].taxiway->c_str() : nullptr;
+        buffer[i].taxiway_len = route[i].taxiway ? route[i].taxiway->size() : 0;
+    }
+    return route.size();
+}
+
+EXPORT_DLL int find_taxi_route(const xpdata_apt_t *apt, xpdata_coords_t from, const char* rwy_name, const char* const* taxiways, int taxiways_len,
+                               xpdata_apt_taxi_point_t *buffer, int buffer_len) {
+    SANITY_CHECK_INT();
+    if (apt == nullptr || rwy_name == nullptr) {
+        return 0;
+    }
+    const avionicsbay::AptTaxiGraph *graph = xpdata->get_apt_taxi_graph(apt);
+    if (graph == nullptr) {
+        return 0;
+    }
+    return find_taxi_route_impl(graph, from, rwy_name, taxiways, taxiways_len, buffer, buffer_len);
+}
+
+EXPORT_DLL int find_taxi_route_from_gate(const xpdata_apt_t *apt, const char* gate_name, const char* rwy_name, const char* const* taxiways, int taxiways_len,
+                                         xpdata_apt_taxi_point_t *buffer, int buffer_len) {
+    SANITY_CHECK_INT();
+    if (apt == nullptr || gate_name == nullptr || rwy_name == nullptr) {
+        return 0;
+    }
+    const avionicsbay::AptTaxiGraph *graph = xpdata->get_apt_taxi_graph(apt);
+    if (graph == nullptr) {
+        return 0;
+    }
+
+    // The details are loaded (and not evicted before the next quiescent state) if the graph exists
+    const std::string_view gate(gate_name);
+    for (int i=0; i < apt->details->gates_len; i++) {
+        const xpdata_apt_gate_t &g = apt->details->gates[i];
+        if (std::string_view(g.name, g.name_len) == gate) {
+            return find_taxi_route_impl(graph, g.coords, rwy_name, taxiways, taxiways_len, buffer, buffer_len);
+        }
+    }
+    return 0;
+}
+
 EXPORT_DLL xpdata_triangulation_t triangulate(const xpdata_apt_node_array_t* array) {
 
-    const auto &result = t.triangulate(array);
+    auto result = t.triangulate(array);  // Kept alive by the triangulator (and then by the reclaimer)
+    if (!result) {
+        return {nullptr, 0};
+    }
 
     xpdata_triangulation_t triang = {
-        .points = result.data(),
-        .points_len = static_cast<int>(result.size())
+        .points = result->data(),
+        .points_len = static_cast<int>(result->size())
     };
 
     return triang;
@@ -153,6 +337,27 @@ EXPORT_DLL bool xpdata_is_ready(void) {
     return xpdata->get_is_ready();
 }
 
+EXPORT_DLL int poll_events(xpdata_event_t* buffer, int max) {
+    // Single consumer: to be called by one thread only (typically once per frame)
+    if (unlikely(events == nullptr) || max <= 0) { return 0; }
+
+    int len = 0;
+    const size_t dropped = events->take_dropped();
+    if (unlikely(dropped > 0)) {
+        buffer[len++] = {EVENT_LOST, static_cast<int>(dropped), nullptr, ""};
+    }
+    while (len < max && events->pop(buffer[len])) {
+        len++;
+    }
+    return len;
+}
+
+EXPORT_DLL void quiescent_state(void) {
+    // The caller declares that it does not hold anymore pointers obtained before this call
+    if (unlikely(avionicsbay::get_reclaimer() == nullptr)) { return; }
+    avionicsbay::get_reclaimer()->quiescent_state();
+}
+
 /**************************************************************************************************/
 /** MORA **/
 /**************************************************************************************************/
@@ -201,12 +406,49 @@ EXPORT_DLL xpdata_awy_array_t get_awy_by_end_wpt(const char* wpt_id) {
 /** CFP **/
 /**************************************************************************************************/
 EXPORT_DLL xpdata_cifp_t get_cifp(const char* airport_id) {
-    if (!avionicsbay::get_cifp()->is_ready()) {
+    SANITY_CHECK_CIFP_STRUCT();
+    return avionicsbay::get_cifp()->get_full_cifp(airport_id);     // Empty if not loaded yet
+
+}
+
+EXPORT_DLL const xpdata_cifp_rwy_data_t* get_cifp_rwy(const char* airport_id, const char* rwy_name) {
+    SANITY_CHECK_CIFP_PTR();
+    return avionicsbay::get_cifp()->get_rwy(airport_id, rwy_name); // NULL if not loaded yet or not found
+}
+
+EXPORT_DLL const xpdata_cifp_data_t* get_cifp_proc(const char* airport_id, xpdata_cifp_proc_type_t type, const char* proc_name, const char* trans_name) {
+    SANITY_CHECK_CIFP_PTR();
+    return avionicsbay::get_cifp()->get_proc(airport_id, type, proc_name, trans_name);
+}
+
+EXPORT_DLL xpdata_cifp_ptr_array_t get_cifp_procs_by_rwy(const char* airport_id, xpdata_cifp_proc_type_t type, const char* rwy_name) {
+    SANITY_CHECK_CIFP_STRUCT();
+    return build_cifp_ptr_array(avionicsbay::get_cifp()->get_procs_by_rwy(airport_id, type, rwy_name));
+}
+
+EXPORT_DLL xpdata_cifp_ptr_array_t get_cifp_apprs_by_type(const char* airport_id, char appr_type) {
+    SANITY_CHECK_CIFP_STRUCT();
+    return build_cifp_ptr_array(avionicsbay::get_cifp()->get_apprs_by_type(airport_id, appr_type));
+}
+
+EXPORT_DLL xpdata_cifp_geometry_t get_cifp_geometry(const char* airport_id, xpdata_cifp_proc_type_t type, const char* proc_name, const char* trans_name) {
+    if (unlikely(avionicsbay::get_cifp_geometry() == nullptr || airport_id == nullptr || proc_name == nullptr)) {
         return {};
     }
-    
-    return avionicsbay::get_cifp()->get_full_cifp(airport_id);
 
+    xpdata_cifp_geometry_t geometry = {};
+    bool not_found = false;
+    auto* polyline = avionicsbay::get_cifp_geometry()->get_polyline(airport_id, type, proc_name, trans_name ? trans_name : "", not_found);
+    geometry.not_found = not_found;
+    geometry.is_ready  = not_found;
+    if (polyline != nullptr) {
+        geometry.points    = polyline->points.data();
+        geometry.distances = polyline->distances.data();
+        geometry.legs      = polyline->legs.data();
+        geometry.len       = polyline->points.size();
+        geometry.is_ready  = true;
+    }
+    return geometry;
 }
 
 EXPORT_DLL void load_cifp(const char* airport_id) {
@@ -215,8 +457,27 @@ EXPORT_DLL void load_cifp(const char* airport_id) {
 
 }
 
-EXPORT_DLL bool is_cifp_ready() {
-    return avionicsbay::get_cifp()->is_ready();
+EXPORT_DLL void load_all_cifp(void) {
+    SANITY_CHECK_CIFP_VOID();
+    avionicsbay::get_cifp()->load_all_airports();
+}
+
+EXPORT_DLL bool is_cifp_ready(const char* airport_id) {
+    SANITY_CHECK_CIFP_BOOL();
+    if (airport_id == nullptr) {
+        return avionicsbay::get_cifp()->is_ready();     // All the requested airports
+    }
+    return avionicsbay::get_cifp()->is_ready(airport_id);
+}
+
+EXPORT_DLL void pin_cifp(const char* airport_id, bool pinned) {
+    SANITY_CHECK_CIFP_VOID();
+    avionicsbay::get_cifp()->set_pinned(airport_id, pinned);
+}
+
+EXPORT_DLL void set_cifp_memory_budget(size_t bytes) {
+    SANITY_CHECK_CIFP_VOID();
+    avionicsbay::get_cifp()->set_memory_budget(bytes);
 }
 
 /**************************************************************************************************/
@@ -227,6 +488,48 @@ EXPORT_DLL double get_declination(double lat, double lon, unsigned short year) {
     return avionicsbay::get_declination(lat, lon, year);
 }
 
+EXPORT_DLL void get_declination_batch(const xpdata_coords_t* coords, int coords_len, unsigned short year, double* out) {
+    if (coords == nullptr || out == nullptr || coords_len <= 0) {
+        return;
+    }
+    avionicsbay::get_declination_batch(coords, coords_len, year, out);
+}
+
+EXPORT_DLL double get_navaid_declination(const xpdata_navaid_t* navaid) {
+    SANITY_CHECK_INT();
+    if (navaid == nullptr) {
+        return 0;
+    }
+    return xpdata->get_navaid_declination(navaid);
+}
+
+EXPORT_DLL double get_fix_declination(const xpdata_fix_t* fix) {
+    SANITY_CHECK_INT();
+    if (fix == nullptr) {
+        return 0;
+    }
+    return xpdata->get_fix_declination(fix);
+}
+
+EXPORT_DLL double get_apt_declination(const xpdata_apt_t* apt) {
+    SANITY_CHECK_INT();
+    if (apt == nullptr) {
+        return 0;
+    }
+    return xpdata->get_apt_declination(apt);
+}
+
+EXPORT_DLL double get_geoid_height(double lat, double lon) {
+    return avionicsbay::get_geoid_height(lat, lon);
+}
+
+EXPORT_DLL void get_geoid_height_batch(const xpdata_coords_t* coords, int coords_len, double* out) {
+    if (coords == nullptr || out == nullptr || coords_len <= 0) {
+        return;
+    }
+    avionicsbay::get_geoid_height_batch(coords, coords_len, out);
+}
+
 /**************************************************************************************************/
 /** NAVDATA **/
 /**************************************************************************************************/
@@ -244,5 +547,6 @@ EXPORT_DLL unsigned int get_navdata_month() {
 namespace avionicsbay {
     void api_init() noexcept {
         xpdata = get_xpdata().get();
+        events = get_events().get();
     }
 }
@@ -9,6 +9,8 @@
 
 #include "data_types.hpp"
 
+#include <cstddef>
+
 extern "C" {
     EXPORT_DLL xpdata_navaid_array_t get_navaid_by_name  (xpdata_navaid_type_t, const char*);
     EXPORT_DLL xpdata_navaid_array_t get_navaid_by_freq  (xpdata_navaid_type_t, unsigned int);
@@ -20,13 +22,26 @@ extern "C" {
     EXPORT_DLL xpdata_apt_array_t get_apts_by_name  (const char*);
     EXPORT_DLL xpdata_apt_array_t get_apts_by_coords(double, double);
     EXPORT_DLL const xpdata_apt_t* get_nearest_apt();
+    EXPORT_DLL int query_batch(const xpdata_query_t* queries, int queries_len, xpdata_query_result_t* results);
     EXPORT_DLL void request_apts_details(const char* arpt_id);
+    EXPORT_DLL void request_apts_details_prio(const char* arpt_id, int priority);
+    EXPORT_DLL int get_apts_details_status(const char* arpt_id);
+    // Reading apt->details is not an access for the LRU policy: call request_apts_details() or
+    // get_apts_details_status() each frame for the airports on display. Airports accessed
+    // since the last quiescent_state() are never evicted: without it the budget is not enforced
+    EXPORT_DLL void set_apts_details_memory_budget(size_t bytes);
+    EXPORT_DLL int get_apt_tess_level(double meters_per_pixel);
 
     EXPORT_DLL int get_mora(double lat, double lon);
 
     EXPORT_DLL void set_acf_coords(double lat, double lon);
     
     EXPORT_DLL xpdata_coords_t get_route_pos(const xpdata_apt_t *apt, int route_id);
+    EXPORT_DLL xpdata_apt_surface_t get_apt_surface(const xpdata_apt_t *apt, double lat, double lon);
+    EXPORT_DLL int find_taxi_route(const xpdata_apt_t *apt, xpdata_coords_t from, const char* rwy_name, const char* const* taxiways, int taxiways_len,
+                                   xpdata_apt_taxi_point_t *buffer, int buffer_len);
+    EXPORT_DLL int find_taxi_route_from_gate(const xpdata_apt_t *apt, const char* gate_name, const char* rwy_name, const char* const* taxiways, int taxiways_len,
+                                             xpdata_apt_taxi_point_t *buffer, int buffer_len);
 
     EXPORT_DLL xpdata_hold_array_t get_hold_by_id(const char* id);
     EXPORT_DLL xpdata_hold_array_t get_hold_by_apt_id(const char* apt_id);
@@ -35,15 +50,36 @@ extern "C" {
     EXPORT_DLL xpdata_awy_array_t get_awy_by_start_wpt(const char* wpt_id);
     EXPORT_DLL xpdata_awy_array_t get_awy_by_end_wpt(const char* wpt_id);
 
+    // The points stay valid forever if quiescent_state() is never called. Otherwise only until
+    // the next quiescent_state(): the results are cached and evicted, call it again next frame
     EXPORT_DLL xpdata_triangulation_t triangulate(const xpdata_apt_node_array_t* array);
 
     EXPORT_DLL xpdata_cifp_t get_cifp(const char* airport_id);
+    EXPORT_DLL const xpdata_cifp_rwy_data_t* get_cifp_rwy(const char* airport_id, const char* rwy_name);
+    EXPORT_DLL const xpdata_cifp_data_t* get_cifp_proc(const char* airport_id, xpdata_cifp_proc_type_t type, const char* proc_name, const char* trans_name);
+    EXPORT_DLL xpdata_cifp_ptr_array_t get_cifp_procs_by_rwy(const char* airport_id, xpdata_cifp_proc_type_t type, const char* rwy_name);
+    EXPORT_DLL xpdata_cifp_ptr_array_t get_cifp_apprs_by_type(const char* airport_id, char appr_type);
+    EXPORT_DLL xpdata_cifp_geometry_t get_cifp_geometry(const char* airport_id, xpdata_cifp_proc_type_t type, const char* proc_name, const char* trans_name);
     EXPORT_DLL void load_cifp(const char* airport_id);
-    EXPORT_DLL bool is_cifp_ready();
+    EXPORT_DLL void load_all_cifp(void);
+    EXPORT_DLL bool is_cifp_ready(const char* airport_id);
+    EXPORT_DLL void pin_cifp(const char* airport_id, bool pinned);
+    // Airports read since the last quiescent_state() are never evicted: without calls to
+    // quiescent_state() the budget is not enforced
+    EXPORT_DLL void set_cifp_memory_budget(size_t bytes);
+
+    EXPORT_DLL void quiescent_state(void);
 
     EXPORT_DLL bool xpdata_is_ready(void);
+    EXPORT_DLL int poll_events(xpdata_event_t* buffer, int max);
 
     EXPORT_DLL double get_declination(double lat, double lon, unsigned short year);
+    EXPORT_DLL void get_declination_batch(const xpdata_coords_t* coords, int coords_len, unsigned short year, double* out);
+    EXPORT_DLL double get_navaid_declination(const xpdata_navaid_t* navaid);
+    EXPORT_DLL double get_fix_declination(const xpdata_fix_t* fix);
+    EXPORT_DLL double get_apt_declination(const xpdata_apt_t* apt);
+    EXPORT_DLL double get_geoid_height(double lat, double lon);
+    EXPORT_DLL void get_geoid_height_batch(const xpdata_coords_t* coords, int coords_len, double* out);
     EXPORT_DLL unsigned int get_navdata_year();
     EXPORT_DLL unsigned int get_navdata_month();
 
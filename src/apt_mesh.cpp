@@ -0,0 +1,68 @@
+#include "apt_mesh.hpp"
+
+#include "triangulator.hpp"
+
+namespace avionicsbay {
+
+uint32_t AptMeshBuilder::get_vertex_id(const xpdata_coords_t &coords) {
+    auto it = vertex_ids.find(coords);
+    if (it != vertex_ids.end()) {
+        return it->second;
+    }
+    uint32_t id = vertices.size();
+    vertices.push_back(coords);
+    double east, north;
+    frame.to_enu(coords.lat, coords.lon, east, north);
+    vertices_xy.push_back(east);
+    vertices_xy.push_back(north);
+    vertex_ids.emplace(coords, id);
+    return id;
+}
+
+void AptMeshBuilder::add_polygon(const xpdata_apt_node_array_t &array, int array_idx, int surface) {
+    if (array.nodes_len < 3) {
+        return;
+    }
+
+    // The ids in the mesh of the nodes of the polygon and of its holes, and their local coordinates
+    polygon_vertices.clear();
+    polygon_rings.clear();
+    for (const xpdata_apt_node_array_t *ring = &array; ring != nullptr; ring = ring->hole) {
+        polygon_rings.emplace_back();
+        for (int i=0; i < ring->nodes_len; i++) {
+            double east, north;
+            frame.to_enu(ring->nodes[i].coords.lat, ring->nodes[i].coords.lon, east, north);
+            polygon_rings.back().push_back({east, north});
+            polygon_vertices.push_back(get_vertex_id(ring->nodes[i].coords));
+        }
+    }
+
+    Triangulator::triangulate_rings(polygon_rings, polygon_indices);
+
+    for (size_t i=0; i + 2 < polygon_indices.size(); i += 3) {
+        uint32_t a = polygon_vertices[polygon_indices[i]];
+        uint32_t b = polygon_vertices[polygon_indices[i+1]];
+        uint32_t c = polygon_vertices[polygon_indices[i+2]];
+        if (a == b || b == c || a == c) {
+            continue;   // Degenerate, after merging the duplicated nodes
+        }
+        indices.push_back(a);
+        indices.push_back(b);
+        indices.push_back(c);
+        surfaces.push_back(surface);
+        arrays.push_back(array_idx);
+    }
+}
+
+void AptMeshBuilder::store(Arena &arena, xpdata_apt_mesh_t &mesh) const {
+    mesh.vertices = arena.copy_array(vertices.data(), vertices.size());
+    mesh.vertices_xy = arena.copy_array(vertices_xy.data(), vertices_xy.size());
+    mesh.vertices_len = vertices.size();
+    mesh.indices = arena.copy_array(indices.data(), indices.size());
+    mesh.indices_len = indices.size();
+    mesh.surfaces = arena.copy_array(surfaces.data(), surfaces.size());
+    mesh.arrays = arena.copy_array(arrays.data(), arrays.size());
+    mesh.triangles_len = surfaces.size();
+}
+
+} // namespace avionicsbay
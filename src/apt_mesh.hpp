@@ -0,0 +1,61 @@
+#ifndef APT_MESH_H
+#define APT_MESH_H
+
+#include "utilities/arena.hpp"
+#include "utilities/enu.hpp"
+#include "data_types.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace avionicsbay {
+
+// Merges the polygons of an airport into a single indexed mesh. Vertices with the same
+// coordinates (e.g. the edges shared by adjacent pavements) are stored once. The polygons are
+// triangulated in the local frame of the airport, where earcut works on metres.
+class AptMeshBuilder {
+public:
+    explicit AptMeshBuilder(const EnuFrame &frame) noexcept : frame(frame) {}
+
+    void add_polygon(const xpdata_apt_node_array_t &array, int array_idx, int surface);    // Holes included
+
+    // Copies the mesh into the arena
+    void store(Arena &arena, xpdata_apt_mesh_t &mesh) const;
+
+private:
+    struct CoordsHash {
+        size_t operator()(const xpdata_coords_t &c) const noexcept {
+            uint64_t lat, lon;
+            std::memcpy(&lat, &c.lat, sizeof(lat));
+            std::memcpy(&lon, &c.lon, sizeof(lon));
+            return std::hash<uint64_t>()(lat * 0x9E3779B97F4A7C15ULL ^ lon);
+        }
+    };
+    struct CoordsEqual {
+        bool operator()(const xpdata_coords_t &a, const xpdata_coords_t &b) const noexcept {
+            return a.lat == b.lat && a.lon == b.lon;
+        }
+    };
+
+    const EnuFrame &frame;
+
+    std::vector<xpdata_coords_t> vertices;
+    std::vector<float> vertices_xy;
+    std::vector<uint32_t> indices;
+    std::vector<int> surfaces;
+    std::vector<int> arrays;
+    std::unordered_map<xpdata_coords_t, uint32_t, CoordsHash, CoordsEqual> vertex_ids;
+
+    std::vector<uint32_t> polygon_indices;  // Scratch buffers, kept to avoid reallocations
+    std::vector<uint32_t> polygon_vertices;
+    std::vector<std::vector<std::array<double, 2>>> polygon_rings;
+
+    uint32_t get_vertex_id(const xpdata_coords_t &coords);
+};
+
+} // namespace avionicsbay
+
+#endif // APT_MESH_H
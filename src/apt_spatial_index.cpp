@@ -0,0 +1,247 @@
+#include "apt_spatial_index.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#define APT_INDEX_CELL_M       32.f     // Side of the cells of the grid
+#define APT_INDEX_MAX_CELLS    (1 << 20)
+#define APT_INDEX_ROUTE_MAX_M  2000.f   // Farther, no nearest route edge is reported
+
+namespace avionicsbay {
+
+enum : uint32_t {
+    ITEM_TRIANGLE = 0u << 30,
+    ITEM_RUNWAY   = 1u << 30,
+    ITEM_ROUTE    = 2u << 30,
+    ITEM_TYPE     = 3u << 30
+};
+
+static float segment_distance(float x, float y, float x1, float y1, float x2, float y2, float &t) {
+    const float dx = x2 - x1;
+    const float dy = y2 - y1;
+    const float len2 = dx * dx + dy * dy;
+    t = len2 > 0 ? ((x - x1) * dx + (y - y1) * dy) / len2 : 0;
+    const float tc = std::clamp(t, 0.f, 1.f);
+    return std::hypot(x1 + tc * dx - x, y1 + tc * dy - y);
+}
+
+template<typename F>
+void AptSpatialIndex::for_each_cell(float x1, float y1, float x2, float y2, F f) const {
+    int c1 = std::max(0, static_cast<int>(std::floor((x1 - min_x) / cell_m)));
+    int c2 = std::min(cols - 1, static_cast<int>(std::floor((x2 - min_x) / cell_m)));
+    int r1 = std::max(0, static_cast<int>(std::floor((y1 - min_y) / cell_m)));
+    int r2 = std::min(rows - 1, static_cast<int>(std::floor((y2 - min_y) / cell_m)));
+    for (int r=r1; r <= r2; r++) {
+        for (int c=c1; c <= c2; c++) {
+            f(r * cols + c);
+        }
+    }
+}
+
+void AptSpatialIndex::build(const xpdata_apt_t &apt, const xpdata_apt_details_t &details, const EnuFrame &frame) {
+    this->frame = frame;
+    mesh = &details.pavements_mesh[0];
+    routes_xy = details.enu.routes_xy;
+    routes_len = details.routes_len;
+
+    for (int i=0; i < apt.rwys_len; i++) {
+        double x1, y1, x2, y2;
+        frame.to_enu(apt.rwys[i].coords.lat, apt.rwys[i].coords.lon, x1, y1);
+        frame.to_enu(apt.rwys[i].sibl_coords.lat, apt.rwys[i].sibl_coords.lon, x2, y2);
+        rwys.push_back({float(x1), float(y1), float(x2), float(y2), float(apt.rwys[i].width / 2)});
+    }
+
+    // The bounding box of each item
+    struct Box {
+        uint32_t item;
+        float x1, y1, x2, y2;
+    };
+    std::vector<Box> boxes;
+    for (int i=0; i < mesh->triangles_len; i++) {
+        Box box = {ITEM_TRIANGLE | i, std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+                   std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+        for (int j=0; j < 3; j++) {
+            const float *v = &mesh->vertices_xy[2 * mesh->indices[3*i+j]];
+            box.x1 = std::min(box.x1, v[0]);
+            box.y1 = std::min(box.y1, v[1]);
+            box.x2 = std::max(box.x2, v[0]);
+            box.y2 = std::max(box.y2, v[1]);
+        }
+        boxes.push_back(box);
+    }
+    for (size_t i=0; i < rwys.size(); i++) {
+        const Runway &r = rwys[i];
+        boxes.push_back({ITEM_RUNWAY | uint32_t(i), std::min(r.x1, r.x2) - r.half_width, std::min(r.y1, r.y2) - r.half_width,
+                         std::max(r.x1, r.x2) + r.half_width, std::max(r.y1, r.y2) + r.half_width});
+    }
+    for (int i=0; i < routes_len; i++) {
+        const float *xy = &routes_xy[4*i];
+        if (std::isnan(xy[0]) || std::isnan(xy[2])) {
+            continue;   // Unknown node
+        }
+        boxes.push_back({ITEM_ROUTE | uint32_t(i), std::min(xy[0], xy[2]), std::min(xy[1], xy[3]), std::max(xy[0], xy[2]), std::max(xy[1], xy[3])});
+    }
+
+    if (boxes.empty()) {
+        return;
+    }
+
+    // The grid, with larger cells for the (very) large airports
+    float max_x = std::numeric_limits<float>::lowest(), max_y = std::numeric_limits<float>::lowest();
+    min_x = min_y = std::numeric_limits<float>::max();
+    for (const auto &box : boxes) {
+        min_x = std::min(min_x, box.x1);
+        min_y = std::min(min_y, box.y1);
+        max_x = std::max(max_x, box.x2);
+        max_y = std::max(max_y, box.y2);
+    }
+    cell_m = APT_INDEX_CELL_M;
+    while ((max_x - min_x) / cell_m * (max_y - min_y) / cell_m > APT_INDEX_MAX_CELLS) {
+        cell_m *= 2;
+    }
+    cols = static_cast<int>((max_x - min_x) / cell_m) + 1;
+    rows = static_cast<int>((max_y - min_y) / cell_m) + 1;
+
+    // CSR: count the items of each cell, then fill them
+    cell_offsets.assign(cols * rows + 1, 0);
+    for (const auto &box : boxes) {
+        for_each_cell(box.x1, box.y1, box.x2, box.y2, [&](int cell) { cell_offsets[cell + 1]++; });
+    }
+    for (size_t i=1; i < cell_offsets.size(); i++) {
+        cell_offsets[i] += cell_offsets[i-1];
+    }
+    cell_items.resize(cell_offsets.back());
+    std::vector<uint32_t> next(cell_offsets.begin(), cell_offsets.end() - 1);
+    for (const auto &box : boxes) {
+        for_each_cell(box.x1, box.y1, box.x2, box.y2, [&](int cell) { cell_items[next[cell]++] = box.item; });
+    }
+}
+
+bool AptSpatialIndex::in_triangle(uint32_t tri, float x, float y) const noexcept {
+    const float *a = &mesh->vertices_xy[2 * mesh->indices[3*tri]];
+    const float *b = &mesh->vertices_xy[2 * mesh->indices[3*tri+1]];
+    const float *c = &mesh->vertices_xy[2 * mesh->indices[3*tri+2]];
+    const float d1 = (b[0] - a[0]) * (y - a[1]) - (b[1] - a[1]) * (x - a[0]);
+    const float d2 = (c[0] - b[0]) * (y - b[1]) - (c[1] - b[1]) * (x - b[0]);
+    const float d3 = (a[0] - c[0]) * (y - c[1]) - (a[1] - c[1]) * (x - c[0]);
+    const bool has_neg = d1 < 0 || d2 < 0 || d3 < 0;
+    const bool has_pos = d1 > 0 || d2 > 0 || d3 > 0;
+    return !(has_neg && has_pos);   // Any winding
+}
+
+float AptSpatialIndex::rwy_distance(uint32_t rwy, float x, float y, bool &inside) const noexcept {
+    const Runway &r = rwys[rwy];
+    float t;
+    float dist = segment_distance(x, y, r.x1, r.y1, r.x2, r.y2, t);
+    inside = t >= 0 && t <= 1 && dist <= r.half_width;
+    return dist;
+}
+
+float AptSpatialIndex::route_distance(uint32_t route, float x, float y) const noexcept {
+    const float *xy = &routes_xy[4*route];
+    float t;
+    return segment_distance(x, y, xy[0], xy[1], xy[2], xy[3], t);
+}
+
+xpdata_apt_surface_t AptSpatialIndex::query(double lat, double lon) const noexcept {
+    xpdata_apt_surface_t result = {-1, 0, -1, -1, 0};
+    if (cols == 0) {
+        return result;
+    }
+
+    double east, north;
+    frame.to_enu(lat, lon, east, north);
+    const float x = east;
+    const float y = north;
+    if (!std::isfinite(x) || !std::isfinite(y)) {
+        return result;
+    }
+
+    // The cell of the point, possibly out of the grid
+    const int pc = static_cast<int>(std::floor((x - min_x) / cell_m));
+    const int pr = static_cast<int>(std::floor((y - min_y) / cell_m));
+
+    if (pc >= 0 && pc < cols && pr >= 0 && pr < rows) {
+        const int cell = pr * cols + pc;
+        float rwy_best = std::numeric_limits<float>::max();
+        for (uint32_t i=cell_offsets[cell]; i < cell_offsets[cell+1]; i++) {
+            const uint32_t item = cell_items[i];
+            const uint32_t idx = item & ~ITEM_TYPE;
+            if ((item & ITEM_TYPE) == ITEM_TRIANGLE) {
+                if (mesh->arrays[idx] > result.pavement && in_triangle(idx, x, y)) {
+                    result.pavement = mesh->arrays[idx];    // The pavements are drawn in order: the last one is on top
+                    result.surface = mesh->surfaces[idx];
+                }
+            } else if ((item & ITEM_TYPE) == ITEM_RUNWAY) {
+                bool inside;
+                float dist = rwy_distance(idx, x, y, inside);
+                if (inside && dist < rwy_best) {
+                    rwy_best = dist;    // At the intersections, the closest centerline
+                    result.rwy = idx;
+                }
+            }
+        }
+    }
+
+    // The nearest route edge: rings of cells around the point, until no cell can be closer. The
+    // rings start at the first one touching the grid and stop at APT_INDEX_ROUTE_MAX_M.
+    float route_best = APT_INDEX_ROUTE_MAX_M;
+    const int out_c = std::max({0, -pc, pc - (cols - 1)});
+    const int out_r = std::max({0, -pr, pr - (rows - 1)});
+    const int r_min = std::max(out_c, out_r);
+    const int r_max = std::min(std::max({std::abs(pc), std::abs(cols - 1 - pc), std::abs(pr), std::abs(rows - 1 - pr)}),
+                               static_cast<int>(APT_INDEX_ROUTE_MAX_M / cell_m) + 1);
+
+    auto scan_cell = [&](int row, int col) {
+        const int cell = row * cols + col;
+        for (uint32_t i=cell_offsets[cell]; i < cell_offsets[cell+1]; i++) {
+            const uint32_t item = cell_items[i];
+            if ((item & ITEM_TYPE) != ITEM_ROUTE) {
+                continue;
+            }
+            const uint32_t idx = item & ~ITEM_TYPE;
+            float dist = route_distance(idx, x, y);
+            if (dist < route_best) {
+                route_best = dist;
+                result.route = idx;
+            }
+        }
+    };
+
+    for (int r=r_min; r <= r_max; r++) {
+        // Only the part of the ring inside the grid
+        const int row1 = std::max(pr - r, 0), row2 = std::min(pr + r, rows - 1);
+        const int col1 = std::max(pc - r, 0), col2 = std::min(pc + r, cols - 1);
+        for (int row=row1; row <= row2; row++) {
+            if (row == pr - r || row == pr + r) {
+                for (int col=col1; col <= col2; col++) {
+                    scan_cell(row, col);
+                }
+            } else {
+                if (pc - r >= 0) {
+                    scan_cell(row, pc - r);     // Inner rows: only the two sides
+                }
+                if (r > 0 && pc + r < cols) {
+                    scan_cell(row, pc + r);
+                }
+            }
+        }
+        if (route_best <= r * cell_m) {
+            break;      // The cells of the next ring are at least r cells away
+        }
+    }
+    if (result.route >= 0) {
+        result.route_dist = route_best;
+    }
+
+    return result;
+}
+
+size_t AptSpatialIndex::memory_usage() const noexcept {
+    return sizeof(AptSpatialIndex) + rwys.capacity() * sizeof(Runway)
+           + cell_offsets.capacity() * sizeof(uint32_t) + cell_items.capacity() * sizeof(uint32_t);
+}
+
+} // namespace avionicsbay
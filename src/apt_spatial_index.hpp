@@ -0,0 +1,51 @@
+#ifndef APT_SPATIAL_INDEX_H
+#define APT_SPATIAL_INDEX_H
+
+#include "utilities/enu.hpp"
+#include "data_types.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace avionicsbay {
+
+// Uniform grid over the surfaces of an airport, in its local frame: the triangles of the
+// pavements mesh, the runway rectangles and the taxi route edges. Built once by the details
+// loader, then only read. It points into the details of the airport, so it must live as long as
+// them.
+class AptSpatialIndex {
+public:
+    // On the finest pavements mesh and on enu.routes_xy, that must be already built
+    void build(const xpdata_apt_t &apt, const xpdata_apt_details_t &details, const EnuFrame &frame);
+
+    xpdata_apt_surface_t query(double lat, double lon) const noexcept;
+
+    size_t memory_usage() const noexcept;
+
+private:
+    struct Runway {
+        float x1, y1, x2, y2;   // Centerline, threshold to threshold
+        float half_width;
+    };
+
+    EnuFrame frame = EnuFrame(0, 0);       // Of the airport, set by build()
+    const xpdata_apt_mesh_t *mesh = nullptr;
+    std::vector<Runway> rwys;
+    const float *routes_xy = nullptr;
+    int routes_len = 0;
+
+    float min_x = 0, min_y = 0;
+    float cell_m = 0;
+    int cols = 0, rows = 0;
+    std::vector<uint32_t> cell_offsets;     // Items of cell i: [cell_offsets[i], cell_offsets[i+1])
+    std::vector<uint32_t> cell_items;       // Item type in the 2 high bits, index in the low ones
+
+    template<typename F> void for_each_cell(float x1, float y1, float x2, float y2, F f) const;
+    bool in_triangle(uint32_t tri, float x, float y) const noexcept;
+    float rwy_distance(uint32_t rwy, float x, float y, bool &inside) const noexcept;
+    float route_distance(uint32_t route, float x, float y) const noexcept;
+};
+
+} // namespace avionicsbay
+
+#endif // APT_SPATIAL_INDEX_H
@@ -0,0 +1,308 @@
+#include "apt_taxi_graph.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+
+namespace avionicsbay {
+
+#define TAXI_HOLD_THRESHOLD_M 300   // Hold points farther than this from the closest one to the threshold are skipped
+
+static constexpr uint32_t NO_NODE = std::numeric_limits<uint32_t>::max();
+
+// Runway names are accepted with or without the RW prefix and the padding
+static std::string_view normalize_rwy_name(std::string_view rwy_name) {
+    size_t begin = rwy_name.find_first_not_of(' ');
+    if (begin == std::string_view::npos) {
+        return std::string_view();
+    }
+    rwy_name = rwy_name.substr(begin, rwy_name.find_last_not_of(' ') - begin + 1);
+    if (rwy_name.size() > 2 && rwy_name[0] == 'R' && rwy_name[1] == 'W') {
+        rwy_name.remove_prefix(2);
+    }
+    return rwy_name;
+}
+
+// Calls f for each item of a list (e.g. 16L,34R or 16L/34R)
+template<typename F>
+static void for_each_item(std::string_view list, char separator, F f) {
+    while (!list.empty()) {
+        size_t pos = list.find(separator);
+        std::string_view item = normalize_rwy_name(list.substr(0, pos));
+        if (!item.empty()) {
+            f(item);
+        }
+        if (pos == std::string_view::npos) {
+            break;
+        }
+        list.remove_prefix(pos + 1);
+    }
+}
+
+void AptTaxiGraph::build(const xpdata_apt_t &apt, const std::unordered_map<int, xpdata_coords_t> &nodes, const std::vector<InputEdge> &input_edges) {
+    origin = apt.apt_center;
+    const EnuFrame frame(origin.lat, origin.lon);
+
+    // The nodes, sorted by apt.dat id to get the same graph at every load
+    std::vector<int> ids;
+    ids.reserve(nodes.size());
+    for (const auto &node : nodes) {
+        ids.push_back(node.first);
+    }
+    std::sort(ids.begin(), ids.end());
+
+    std::unordered_map<int, uint32_t> node_index;
+    for (int id : ids) {
+        const xpdata_coords_t &c = nodes.at(id);
+        double east, north;
+        frame.to_enu(c.lat, c.lon, east, north);
+        node_index.emplace(id, coords.size());
+        coords.push_back(c);
+        xy.push_back(east);
+        xy.push_back(north);
+    }
+
+    // The edges with both nodes known, with interned names
+    struct ValidEdge {
+        uint32_t from, to;
+        const InputEdge *input;
+        uint32_t name;
+    };
+    std::vector<ValidEdge> valid_edges;
+    std::unordered_map<std::string, uint32_t> name_index;
+    for (const auto &e : input_edges) {
+        auto it_1 = node_index.find(e.node_1);
+        auto it_2 = node_index.find(e.node_2);
+        if (it_1 == node_index.end() || it_2 == node_index.end() || it_1->second == it_2->second) {
+            continue;
+        }
+        auto name_it = name_index.emplace(e.name, names.size());
+        if (name_it.second) {
+            names.push_back(e.name);
+        }
+        valid_edges.push_back({it_1->second, it_2->second, &e, name_it.first->second});
+    }
+
+    // CSR: count the outgoing edges of each node, then fill them
+    offsets.assign(coords.size() + 1, 0);
+    for (const auto &e : valid_edges) {
+        offsets[e.from + 1]++;
+        if (!e.input->oneway) {
+            offsets[e.to + 1]++;
+        }
+    }
+    for (size_t i=1; i < offsets.size(); i++) {
+        offsets[i] += offsets[i-1];
+    }
+
+    edges.resize(offsets.back());
+    std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+    for (const auto &e : valid_edges) {
+        float length_m = std::hypot(xy[2*e.to] - xy[2*e.from], xy[2*e.to+1] - xy[2*e.from+1]);
+        edges[next[e.from]++] = {e.to, e.name, length_m, e.input->is_runway};
+        if (!e.input->oneway) {
+            edges[next[e.to]++] = {e.from, e.name, length_m, e.input->is_runway};
+        }
+    }
+
+    // The hold points of a runway are the nodes between a taxiway edge out of the runway (or of
+    // its active zones) and an edge in it
+    std::vector<std::string> rwy_names;
+    for (const auto &e : valid_edges) {
+        auto add_rwy = [&](std::string_view rwy) {
+            if (std::find(rwy_names.begin(), rwy_names.end(), rwy) == rwy_names.end()) {
+                rwy_names.emplace_back(rwy);
+            }
+        };
+        if (e.input->is_runway) {
+            for_each_item(e.input->name, '/', add_rwy);
+        }
+        for_each_item(e.input->active_rwys, ',', add_rwy);
+    }
+
+    std::vector<uint8_t> node_side;     // Bit 0: touches an edge out of the runway, bit 1: in it
+    for (const auto &rwy : rwy_names) {
+        node_side.assign(coords.size(), 0);
+        for (const auto &e : valid_edges) {
+            bool inside = false;
+            auto check_rwy = [&](std::string_view item) { inside = inside || item == rwy; };
+            if (e.input->is_runway) {
+                for_each_item(e.input->name, '/', check_rwy);
+            }
+            for_each_item(e.input->active_rwys, ',', check_rwy);
+
+            uint8_t side = inside ? 2 : (e.input->is_runway ? 0 : 1);
+            node_side[e.from] |= side;
+            node_side[e.to]   |= side;
+        }
+
+        auto &holds = hold_points[rwy];
+        for (uint32_t i=0; i < coords.size(); i++) {
+            if (node_side[i] == 3) {
+                holds.push_back(i);
+            }
+        }
+    }
+
+    // Only the hold points at the threshold of each runway end (full length departures). Runways
+    // without a taxi network around them: the taxiway node closest to the threshold.
+    for (int i=0; i < apt.rwys_len; i++) {
+        const xpdata_apt_rwy_t &rwy = apt.rwys[i];
+        const std::pair<const char*, xpdata_coords_t> ends[] = {{rwy.name, rwy.coords}, {rwy.sibl_name, rwy.sibl_coords}};
+        for (const auto &end : ends) {
+            std::string_view end_name = normalize_rwy_name(std::string_view(end.first, strnlen(end.first, sizeof(rwy.name))));
+            auto &holds = hold_points[std::string(end_name)];
+
+            double east, north;
+            frame.to_enu(end.second.lat, end.second.lon, east, north);
+            auto dist = [&](uint32_t node) { return static_cast<float>(std::hypot(xy[2*node] - east, xy[2*node+1] - north)); };
+
+            if (holds.empty()) {
+                uint32_t node = nearest_node(east, north, true);
+                if (node != NO_NODE) {
+                    holds.push_back(node);
+                }
+                continue;
+            }
+
+            float min_dist = std::numeric_limits<float>::max();
+            for (uint32_t node : holds) {
+                min_dist = std::min(min_dist, dist(node));
+            }
+            holds.erase(std::remove_if(holds.begin(), holds.end(), [&](uint32_t node) {
+                return dist(node) > min_dist + TAXI_HOLD_THRESHOLD_M;
+            }), holds.end());
+        }
+    }
+
+    for (auto it = hold_points.begin(); it != hold_points.end(); ) {
+        it = it->second.empty() ? hold_points.erase(it) : std::next(it);
+    }
+}
+
+uint32_t AptTaxiGraph::nearest_node(float x, float y, bool taxiway_only) const noexcept {
+    uint32_t best = NO_NODE;
+    float best_dist = std::numeric_limits<float>::max();
+    for (uint32_t i=0; i + 1 < offsets.size(); i++) {
+        if (taxiway_only && std::none_of(edges.begin() + offsets[i], edges.begin() + offsets[i+1], [](const Edge &e) { return !e.is_runway; })) {
+            continue;
+        }
+        float dist = std::hypot(xy[2*i] - x, xy[2*i+1] - y);
+        if (dist < best_dist) {
+            best_dist = dist;
+            best = i;
+        }
+    }
+    return best;
+}
+
+bool AptTaxiGraph::find_route(xpdata_coords_t from, std::string_view rwy_name, const std::vector<std::string_view> &taxiways,
+                              std::vector<RoutePoint> &route) const {
+    route.clear();
+
+    auto holds_it = hold_points.find(std::string(normalize_rwy_name(rwy_name)));
+    if (holds_it == hold_points.end()) {
+        return false;
+    }
+    const std::vector<uint32_t> &targets = holds_it->second;
+
+    const EnuFrame frame(origin.lat, origin.lon);
+    double east, north;
+    frame.to_enu(from.lat, from.lon, east, north);
+    const uint32_t start = nearest_node(east, north, true);
+    if (start == NO_NODE) {
+        return false;
+    }
+
+    std::vector<bool> listed(names.size(), false);
+    for (auto taxiway : taxiways) {
+        for (size_t i=0; i < names.size(); i++) {
+            if (names[i] == taxiway) {
+                listed[i] = true;
+            }
+        }
+    }
+
+    std::vector<bool> is_target(coords.size(), false);
+    for (uint32_t t : targets) {
+        is_target[t] = true;
+    }
+
+    // Admissible heuristic: straight line to the closest target
+    auto heuristic = [&](uint32_t node) {
+        float h = std::numeric_limits<float>::max();
+        for (uint32_t t : targets) {
+            h = std::min(h, std::hypot(xy[2*t] - xy[2*node], xy[2*t+1] - xy[2*node+1]));
+        }
+        return h;
+    };
+
+    const float INF = std::numeric_limits<float>::infinity();
+    std::vector<float> cost(coords.size(), INF);
+    std::vector<uint32_t> prev_edge(coords.size(), NO_NODE);
+    std::vector<uint32_t> prev_node(coords.size(), NO_NODE);
+    std::vector<bool> closed(coords.size(), false);
+
+    using QueueItem = std::pair<float, uint32_t>;   // Estimated total cost, node
+    std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> open;
+    cost[start] = 0;
+    open.push({heuristic(start), start});
+
+    uint32_t reached = NO_NODE;
+    while (!open.empty()) {
+        uint32_t node = open.top().second;
+        open.pop();
+        if (closed[node]) {
+            continue;   // Stale entry: the heuristic is consistent, the first visit is the best
+        }
+        closed[node] = true;
+        if (is_target[node]) {
+            reached = node;
+            break;
+        }
+        for (uint32_t i=offsets[node]; i < offsets[node+1]; i++) {
+            const Edge &e = edges[i];
+            bool allowed = e.is_runway ? listed[e.name] : (taxiways.empty() || names[e.name].empty() || listed[e.name]);
+            if (!allowed) {
+                continue;
+            }
+            float new_cost = cost[node] + e.length_m;
+            if (new_cost < cost[e.to]) {
+                cost[e.to] = new_cost;
+                prev_edge[e.to] = i;
+                prev_node[e.to] = node;
+                open.push({new_cost + heuristic(e.to), e.to});
+            }
+        }
+    }
+
+    if (reached == NO_NODE) {
+        return false;
+    }
+
+    for (uint32_t node = reached; node != NO_NODE; node = prev_node[node]) {
+        const std::string *taxiway = prev_edge[node] != NO_NODE ? &names[edges[prev_edge[node]].name] : nullptr;
+        route.push_back({coords[node], taxiway});
+    }
+    std::reverse(route.begin(), route.end());
+    return true;
+}
+
+size_t AptTaxiGraph::memory_usage() const noexcept {
+    size_t total = sizeof(AptTaxiGraph);
+    total += coords.capacity() * sizeof(xpdata_coords_t) + xy.capacity() * sizeof(float);
+    total += offsets.capacity() * sizeof(uint32_t) + edges.capacity() * sizeof(Edge);
+    for (const auto &name : names) {
+        total += sizeof(std::string) + name.capacity();
+    }
+    for (const auto &x : hold_points) {
+        total += sizeof(x) + sizeof(void*) + x.second.capacity() * sizeof(uint32_t);
+    }
+    return total;
+}
+
+} // namespace avionicsbay
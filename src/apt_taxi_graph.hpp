@@ -0,0 +1,67 @@
+#ifndef APT_TAXI_GRAPH_H
+#define APT_TAXI_GRAPH_H
+
+#include "utilities/enu.hpp"
+#include "data_types.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace avionicsbay {
+
+// The taxi network of an airport (apt.dat rows 1201, 1202 and 1204) as a graph in compressed
+// sparse row form, with the hold points of each runway: where a taxiway enters the departure/ILS
+// active zone of the runway or, without zones, the runway itself. Built once by the details loader, then
+// only read: the routes can be computed concurrently from any thread.
+class AptTaxiGraph {
+public:
+    struct InputEdge {
+        int node_1;
+        int node_2;
+        bool oneway;            // From node_1 to node_2 only
+        bool is_runway;
+        std::string name;       // Taxiway name, or runway name for the runway edges (e.g. 16L/34R)
+        std::string active_rwys;// Departure and ILS active zones (rows 1204), comma-separated
+    };
+
+    struct RoutePoint {
+        xpdata_coords_t coords;
+        const std::string *taxiway;     // Of the edge reaching this point, nullptr for the first one
+    };
+
+    void build(const xpdata_apt_t &apt, const std::unordered_map<int, xpdata_coords_t> &nodes, const std::vector<InputEdge> &input_edges);
+
+    // A* from the node closest to `from` to the closest hold point at the threshold of the runway
+    // (e.g. 34R or RW34R). If taxiways is not empty, only the taxiways in it (and the unnamed
+    // edges, to enter the network) can be used. The runways are crossed, but taxied along only if
+    // listed too (e.g. 16L/34R, to backtrack). Returns false if there is no route.
+    bool find_route(xpdata_coords_t from, std::string_view rwy_name, const std::vector<std::string_view> &taxiways,
+                    std::vector<RoutePoint> &route) const;
+
+    size_t memory_usage() const noexcept;
+
+private:
+    struct Edge {
+        uint32_t to;
+        uint32_t name;          // Index in names
+        float length_m;
+        bool is_runway;
+    };
+
+    xpdata_coords_t origin = {};            // Of the local frame: the center of the airport
+    std::vector<xpdata_coords_t> coords;    // Per node
+    std::vector<float> xy;                  // Per node, 2 floats in the local frame of the airport
+    std::vector<uint32_t> offsets;          // Edges of node i: [offsets[i], offsets[i+1])
+    std::vector<Edge> edges;
+    std::vector<std::string> names;
+    std::unordered_map<std::string, std::vector<uint32_t>> hold_points;     // Key: runway name
+
+    uint32_t nearest_node(float x, float y, bool taxiway_only) const noexcept;
+};
+
+} // namespace avionicsbay
+
+#endif // APT_TAXI_GRAPH_H
@@ -0,0 +1,272 @@
+#include "apt_tessellator.hpp"
+
+#include "constants.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#define METERS_PER_DEG  111194.93  // On the mean Earth radius
+#define MAX_SUBDIV_DEPTH 16        // Max 2^16 segments per curve, whatever the tolerance
+
+namespace avionicsbay {
+
+static constexpr double LEVEL_TOLERANCES_M[APT_TESS_LEVELS] = { 0.25, 1., 4., 16., 64. };
+
+double AptTessellator::level_tolerance(int level) noexcept {
+    return LEVEL_TOLERANCES_M[std::min(std::max(level, 0), APT_TESS_LEVELS - 1)];
+}
+
+int AptTessellator::level_for_resolution(double meters_per_pixel) noexcept {
+    int level = 0;
+    while (level + 1 < APT_TESS_LEVELS && LEVEL_TOLERANCES_M[level + 1] <= meters_per_pixel) {
+        level++;
+    }
+    return level;
+}
+
+// Local planar coordinates in meters around a reference point, accurate enough at airport scale
+struct LocalPlane {
+    xpdata_coords_t ref;
+    double lon_scale;
+
+    explicit LocalPlane(const xpdata_coords_t &ref) : ref(ref), lon_scale(std::cos(ref.lat * M_PI / 180.)) {}
+
+    void to_xy(const xpdata_coords_t &c, double &x, double &y) const {
+        x = (c.lon - ref.lon) * lon_scale * METERS_PER_DEG;
+        y = (c.lat - ref.lat) * METERS_PER_DEG;
+    }
+};
+
+static double segment_distance(double px, double py, double ax, double ay, double bx, double by) {
+    const double dx = bx - ax;
+    const double dy = by - ay;
+    const double len_sq = dx * dx + dy * dy;
+    double t = len_sq > 0 ? std::min(std::max(((px - ax) * dx + (py - ay) * dy) / len_sq, 0.), 1.) : 0.;
+    return std::hypot(px - ax - t * dx, py - ay - t * dy);
+}
+
+static xpdata_coords_t lerp(const xpdata_coords_t &a, const xpdata_coords_t &b, double t) {
+    return { a.lat + (b.lat - a.lat) * t, a.lon + (b.lon - a.lon) * t };
+}
+
+static xpdata_coords_t mirror(const xpdata_coords_t &center, const xpdata_coords_t &p) {
+    return { 2 * center.lat - p.lat, 2 * center.lon - p.lon };
+}
+
+void AptTessellator::flatten(const xpdata_apt_node_t *nodes, int nodes_len, bool closed, std::vector<xpdata_apt_node_t> &out) const {
+    if (nodes_len <= 0) {
+        return;
+    }
+
+    for (int i=0; i < nodes_len - 1; i++) {
+        flatten_segment(nodes[i], nodes[i+1], out);
+    }
+
+    if (closed && nodes_len > 1) {
+        flatten_segment(nodes[nodes_len-1], nodes[0], out);
+    } else {
+        out.push_back({ nodes[nodes_len-1].coords, false, {0., 0.} });
+    }
+}
+
+// Appends the start node and the inner points of the segment, but not the end node
+void AptTessellator::flatten_segment(const xpdata_apt_node_t &from, const xpdata_apt_node_t &to, std::vector<xpdata_apt_node_t> &out) const {
+    out.push_back({ from.coords, false, {0., 0.} });
+
+    if (!from.is_bez && !to.is_bez) {
+        return;     // Straight edge
+    }
+
+    // The control point of a node leads the curve away from it, so the one approaching the next
+    // node is mirrored. With a single control point the curve is quadratic: raise it to a cubic.
+    xpdata_coords_t p[4];
+    p[0] = from.coords;
+    p[3] = to.coords;
+    if (from.is_bez && to.is_bez) {
+        p[1] = from.bez_cp;
+        p[2] = mirror(to.coords, to.bez_cp);
+    } else {
+        const xpdata_coords_t q = from.is_bez ? from.bez_cp : mirror(to.coords, to.bez_cp);
+        p[1] = lerp(p[0], q, 2. / 3.);
+        p[2] = lerp(p[3], q, 2. / 3.);
+    }
+
+    subdivide(p, 0, out);
+    out.pop_back();     // The end node, it will be pushed by the next segment
+}
+
+// de Casteljau split at t=0.5 until flat: appends the inner points and the end point
+void AptTessellator::subdivide(const xpdata_coords_t (&p)[4], int depth, std::vector<xpdata_apt_node_t> &out) const {
+    if (depth >= MAX_SUBDIV_DEPTH || is_flat(p)) {
+        out.push_back({ p[3], false, {0., 0.} });
+        return;
+    }
+
+    const xpdata_coords_t p01 = lerp(p[0], p[1], .5);
+    const xpdata_coords_t p12 = lerp(p[1], p[2], .5);
+    const xpdata_coords_t p23 = lerp(p[2], p[3], .5);
+    const xpdata_coords_t p012 = lerp(p01, p12, .5);
+    const xpdata_coords_t p123 = lerp(p12, p23, .5);
+    const xpdata_coords_t mid  = lerp(p012, p123, .5);
+
+    const xpdata_coords_t left[4]  = { p[0], p01, p012, mid };
+    const xpdata_coords_t right[4] = { mid, p123, p23, p[3] };
+    subdivide(left, depth + 1, out);
+    subdivide(right, depth + 1, out);
+}
+
+// True if both control points are within the tolerance from the chord. The curve lies in the
+// convex hull of its control points, so it does not deviate more than that.
+bool AptTessellator::is_flat(const xpdata_coords_t (&p)[4]) const noexcept {
+    const LocalPlane plane(p[0]);
+
+    double x1, y1, x2, y2, x3, y3;
+    plane.to_xy(p[1], x1, y1);
+    plane.to_xy(p[2], x2, y2);
+    plane.to_xy(p[3], x3, y3);
+
+    // Distance from the chord segment (not the line: the control points may lie beyond its ends)
+    return segment_distance(x1, y1, 0., 0., x3, y3) <= tolerance_m && segment_distance(x2, y2, 0., 0., x3, y3) <= tolerance_m;
+}
+
+void AptTessellator::simplify(std::vector<xpdata_apt_node_t> &nodes, bool closed, double tolerance_m) {
+    const size_t n = nodes.size();
+    if (n < 3) {
+        return;
+    }
+
+    // Closed rings get their first node repeated at the end, so that both cases are a polyline
+    const size_t len = closed ? n + 1 : n;
+    const LocalPlane plane(nodes[0].coords);
+    std::vector<double> x(len), y(len);
+    for (size_t i=0; i < n; i++) {
+        plane.to_xy(nodes[i].coords, x[i], y[i]);
+    }
+    if (closed) {
+        x[n] = x[0];
+        y[n] = y[0];
+    }
+
+    std::vector<bool> keep(len, false);
+    std::vector<std::pair<size_t, size_t>> stack;
+
+    if (closed) {
+        size_t farthest = 1;
+        for (size_t i=2; i < n; i++) {
+            if (std::hypot(x[i], y[i]) > std::hypot(x[farthest], y[farthest])) {
+                farthest = i;
+            }
+        }
+        keep[0] = keep[farthest] = keep[n] = true;
+        stack.push_back({0, farthest});
+        stack.push_back({farthest, n});
+    } else {
+        keep[0] = keep[n-1] = true;
+        stack.push_back({0, n-1});
+    }
+
+    while (!stack.empty()) {
+        auto [first, last] = stack.back();
+        stack.pop_back();
+
+        double max_dist = 0.;
+        size_t max_idx = first;
+        for (size_t i=first+1; i < last; i++) {
+            double dist = segment_distance(x[i], y[i], x[first], y[first], x[last], y[last]);
+            if (dist > max_dist) {
+                max_dist = dist;
+                max_idx = i;
+            }
+        }
+
+        if (max_dist > tolerance_m) {
+            keep[max_idx] = true;
+            stack.push_back({first, max_idx});
+            stack.push_back({max_idx, last});
+        }
+    }
+
+    size_t j = 0;
+    for (size_t i=0; i < n; i++) {
+        if (keep[i]) {
+            nodes[j++] = nodes[i];
+        }
+    }
+    nodes.resize(j);
+}
+
+static int orientation(double ax, double ay, double bx, double by, double cx, double cy) {
+    const double v = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+    return (v > 0) - (v < 0);
+}
+
+static bool on_segment(double ax, double ay, double bx, double by, double px, double py) {
+    return std::min(ax, bx) <= px && px <= std::max(ax, bx) && std::min(ay, by) <= py && py <= std::max(ay, by);
+}
+
+bool AptTessellator::are_rings_simple(const std::vector<std::vector<xpdata_apt_node_t>> &rings) {
+    if (rings.empty() || rings[0].empty()) {
+        return true;
+    }
+
+    struct Edge {
+        double ax, ay, bx, by;
+        int ring;
+        int idx;
+    };
+
+    const LocalPlane plane(rings[0][0].coords);
+    std::vector<Edge> edges;
+    for (size_t r=0; r < rings.size(); r++) {
+        const auto &ring = rings[r];
+        for (size_t i=0; i < ring.size(); i++) {
+            Edge e;
+            plane.to_xy(ring[i].coords, e.ax, e.ay);
+            plane.to_xy(ring[(i + 1) % ring.size()].coords, e.bx, e.by);
+            e.ring = r;
+            e.idx  = i;
+            if (e.ax > e.bx) {
+                std::swap(e.ax, e.bx);
+                std::swap(e.ay, e.by);
+            }
+            edges.push_back(e);
+        }
+    }
+
+    // Sweep along x: only the edges overlapping in x are tested
+    std::sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) { return a.ax < b.ax; });
+
+    for (size_t i=0; i < edges.size(); i++) {
+        const Edge &e1 = edges[i];
+        for (size_t j=i+1; j < edges.size() && edges[j].ax <= e1.bx; j++) {
+            const Edge &e2 = edges[j];
+
+            if (e1.ring == e2.ring) {
+                const int ring_len = rings[e1.ring].size();
+                const int diff = std::abs(e1.idx - e2.idx);
+                if (diff == 1 || diff == ring_len - 1) {
+                    continue;   // Consecutive edges share a node
+                }
+            }
+
+            const int o1 = orientation(e1.ax, e1.ay, e1.bx, e1.by, e2.ax, e2.ay);
+            const int o2 = orientation(e1.ax, e1.ay, e1.bx, e1.by, e2.bx, e2.by);
+            const int o3 = orientation(e2.ax, e2.ay, e2.bx, e2.by, e1.ax, e1.ay);
+            const int o4 = orientation(e2.ax, e2.ay, e2.bx, e2.by, e1.bx, e1.by);
+
+            if (o1 != o2 && o3 != o4) {
+                return false;
+            }
+            if ((o1 == 0 && on_segment(e1.ax, e1.ay, e1.bx, e1.by, e2.ax, e2.ay)) ||
+                (o2 == 0 && on_segment(e1.ax, e1.ay, e1.bx, e1.by, e2.bx, e2.by)) ||
+                (o3 == 0 && on_segment(e2.ax, e2.ay, e2.bx, e2.by, e1.ax, e1.ay)) ||
+                (o4 == 0 && on_segment(e2.ax, e2.ay, e2.bx, e2.by, e1.bx, e1.by))) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+} // namespace avionicsbay
@@ -0,0 +1,45 @@
+#ifndef APT_TESSELLATOR_H
+#define APT_TESSELLATOR_H
+
+#include "data_types.hpp"
+
+#include <vector>
+
+namespace avionicsbay {
+
+// Builds the levels of detail of the airport layouts (apt.dat rows 112, 114 and 116). Each level
+// has a tolerance: the Bezier curves are flattened by adaptive subdivision (a curve is split
+// until it deviates from its chord by less than the tolerance, so straight edges produce no extra
+// points), then the polylines are simplified with Douglas-Peucker at the same tolerance.
+class AptTessellator {
+public:
+    explicit AptTessellator(double tolerance_m) noexcept : tolerance_m(tolerance_m) {}
+
+    static double level_tolerance(int level) noexcept;          // Metres, level in [0, APT_TESS_LEVELS)
+    static int level_for_resolution(double meters_per_pixel) noexcept;  // The coarsest level under 1 px
+
+    double get_tolerance() const noexcept { return tolerance_m; }
+
+    // Appends to out the flattened nodes (never Bezier). If closed, the segment from the last
+    // node back to the first one is flattened too, but the first node is not repeated.
+    void flatten(const xpdata_apt_node_t *nodes, int nodes_len, bool closed, std::vector<xpdata_apt_node_t> &out) const;
+
+    // Douglas-Peucker, in place. Open lines keep their ends, closed rings (first node not
+    // repeated) are split at the first node and at the farthest one from it.
+    static void simplify(std::vector<xpdata_apt_node_t> &nodes, bool closed, double tolerance_m);
+
+    // True if no two edges of the closed rings (outer ring and holes) cross or touch, apart from
+    // the consecutive edges of the same ring
+    static bool are_rings_simple(const std::vector<std::vector<xpdata_apt_node_t>> &rings);
+
+private:
+    double tolerance_m;
+
+    void flatten_segment(const xpdata_apt_node_t &from, const xpdata_apt_node_t &to, std::vector<xpdata_apt_node_t> &out) const;
+    void subdivide(const xpdata_coords_t (&p)[4], int depth, std::vector<xpdata_apt_node_t> &out) const;
+    bool is_flat(const xpdata_coords_t (&p)[4]) const noexcept;
+};
+
+} // namespace avionicsbay
+
+#endif // APT_TESSELLATOR_H
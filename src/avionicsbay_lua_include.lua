@@ -1,5 +1,6 @@
 return [[
     typedef int xpdata_navaid_type_t;
+    typedef int xpdata_cifp_proc_type_t;
 
     typedef struct xpdata_coords_t {
         double lat;
@@ -56,6 +57,17 @@ return [[
         
     } xpdata_apt_rwy_t;
     
+    typedef struct xpdata_apt_rwy_geom_t {
+        double length;                  // Threshold to threshold (m)
+        double true_heading;            // From coords to sibl_coords (deg)
+        double mag_heading;             // Magnetic heading, with the WMM declination at the threshold (deg)
+        double sibl_true_heading;       // From sibl_coords to coords (deg)
+        double sibl_mag_heading;        // Magnetic heading, with the WMM declination at the sibling threshold (deg)
+    
+        xpdata_coords_t corners[4];     // Left/right of the threshold, right/left of the sibling
+        xpdata_coords_t ext_centerline[2];  // 10 nm out of the threshold and of the sibling
+    } xpdata_apt_rwy_geom_t;
+    
     typedef struct xpdata_apt_node_t {
     
         xpdata_coords_t coords;
@@ -86,6 +98,61 @@ return [[
         xpdata_coords_t coords;
     } xpdata_apt_gate_t;
     
+    typedef struct xpdata_apt_surface_t {
+        int pavement;           // Index in details.pavements (0-based), -1 if none
+        int surface;
+        int rwy;                // Index in rwys (0-based), -1 if none
+        int route;              // Index in details.routes (0-based) of the nearest taxi route edge, -1 if none within 2 km
+        double route_dist;      // m
+    } xpdata_apt_surface_t;
+    
+    typedef struct xpdata_apt_taxi_point_t {
+        xpdata_coords_t coords;
+        const char *taxiway;    // nil for the first point
+        int taxiway_len;
+    } xpdata_apt_taxi_point_t;
+    
+    typedef struct xpdata_apt_tess_t {
+        xpdata_apt_node_array_t *pavements;
+        int pavements_len;
+    
+        xpdata_apt_node_array_t *linear_features;
+        int linear_features_len;
+    
+        xpdata_apt_node_array_t *boundaries;
+        int boundaries_len;
+    } xpdata_apt_tess_t;
+    
+    typedef struct xpdata_apt_mesh_t {
+        const xpdata_coords_t *vertices;
+        const float *vertices_xy;   // The same vertices in the local frame: 2 per vertex
+        int vertices_len;
+    
+        const uint32_t *indices;    // 3 per triangle, over vertices (0-based)
+        int indices_len;
+    
+        const int *surfaces;        // 1 per triangle
+        const int *arrays;          // 1 per triangle: index of the source pavement
+        int triangles_len;
+    } xpdata_apt_mesh_t;
+    
+    typedef struct xpdata_apt_lines_xy_t {
+        const float *xy;            // 2 per point: east, north (m)
+        const int *start;           // First point of each line, start[len] is the total nr. of points
+        const int *array;           // Index of the source array of each line
+        int len;
+    } xpdata_apt_lines_xy_t;
+    
+    typedef struct xpdata_apt_enu_t {
+        xpdata_coords_t origin;     // apt_center
+    
+        xpdata_apt_lines_xy_t linear_features[5];
+        xpdata_apt_lines_xy_t boundaries[5];
+    
+        const float *gates_xy;      // 2 per gate
+        const float *routes_xy;     // 4 per route: node 1 and node 2 (NaN if the node is unknown)
+    } xpdata_apt_enu_t;
+    
     typedef struct xpdata_apt_details_t {
         xpdata_coords_t tower_pos; 
     
@@ -104,6 +171,10 @@ return [[
         xpdata_apt_gate_t  *gates;
         int gates_len;
     
+        xpdata_apt_tess_t tess[5];  // Level of detail, tolerance: 0.25, 1, 4, 16, 64 m (see get_apt_tess_level())
+        xpdata_apt_mesh_t pavements_mesh[5];    // Built on tess, same index
+        xpdata_apt_enu_t enu;
+    
     } xpdata_apt_details_t;
     
     typedef struct xpdata_apt_t {
@@ -116,6 +187,7 @@ return [[
         int altitude;
     
         const xpdata_apt_rwy_t *rwys;
+        const xpdata_apt_rwy_geom_t *rwys_geom;     // Parallel to rwys
         int rwys_len;
         
         xpdata_coords_t apt_center;
@@ -287,14 +359,56 @@ return [[
         const struct xpdata_cifp_rwy_data_t * data;
         int len;
     } xpdata_cifp_rwy_array_t;
+
+    typedef struct xpdata_cifp_ptr_array_t {
+        const struct xpdata_cifp_data_t * const * data;
+        int len;
+    } xpdata_cifp_ptr_array_t;
     
     
+    typedef struct xpdata_cifp_geometry_t {
+        const xpdata_coords_t *points;
+        const double *distances;        // Along-track distance from the first point (nm)
+        const int *legs;                // Index of the leg (in xpdata_cifp_data_t::legs) of each point
+        int len;
+        bool is_ready;                  // If false, the geometry is being computed: request it again later
+        bool not_found;                 // The airport is loaded but the procedure doesn't exist (or the
+                                        // CIFP failed to load): is_ready is true and len is 0
+    } xpdata_cifp_geometry_t;
+
     typedef struct xpdata_cifp_t {
         xpdata_cifp_array_t sids;
         xpdata_cifp_array_t stars;
         xpdata_cifp_array_t apprs;
         xpdata_cifp_rwy_array_t rwys;   // This contains extra info compared to no-cifp data
     } xpdata_cifp_t;
+
+    typedef struct xpdata_query_t {
+        int type;                       // Constants QUERY_*
+        xpdata_navaid_type_t navaid_type;   // Navaid queries only
+        const char *name;               // Key of the *_BY_NAME queries
+        unsigned int freq;              // Key of QUERY_NAVAID_BY_FREQ
+        xpdata_coords_t coords;         // Key of the *_BY_COORDS queries
+        bool use_ref;                   // If true, the result has the record closest to ref
+        xpdata_coords_t ref;
+    } xpdata_query_t;
+
+    typedef struct xpdata_query_result_t {
+        const void * const * records;   // xpdata_navaid_t, xpdata_fix_t or xpdata_apt_t, by query type
+        int len;
+        int nearest;                    // Index in records of the closest to ref, -1 if not requested
+    } xpdata_query_result_t;
+
+    typedef struct xpdata_event_t {
+        int type;                       // Constants EVENT_*
+        int value;                      // EVENT_APT_DETAILS, EVENT_CIFP_LOADED: APT_DETAILS_STATUS_LOADED
+                                        // or _FAILED (the CIFP is then empty), EVENT_LOST: number of
+                                        // events dropped
+        const xpdata_apt_t *apt;        // EVENT_APT_DETAILS, EVENT_NEAREST_APT (may be NULL), and
+                                        // EVENT_CIFP_LOADED if the airport is in the database
+        char apt_id[8];                 // EVENT_CIFP_LOADED, NUL-terminated: empty when the bulk
+                                        // database (load_all_cifp()) is ready
+    } xpdata_event_t;
         
 
 xpdata_navaid_array_t get_navaid_by_name  (xpdata_navaid_type_t, const char*);
@@ -307,7 +421,18 @@ xpdata_fix_array_t get_fixes_by_coords(double, double);
 xpdata_apt_array_t get_apts_by_name  (const char*);
 xpdata_apt_array_t get_apts_by_coords(double, double);
 const xpdata_apt_t* get_nearest_apt();
+int query_batch(const xpdata_query_t* queries, int queries_len, xpdata_query_result_t* results);
 void request_apts_details(const char* arpt_id);
+void request_apts_details_prio(const char* arpt_id, int priority);
+int get_apts_details_status(const char* arpt_id);
+// Reading apt->details is not an access for the LRU policy: call request_apts_details() or
+// get_apts_details_status() each frame for the airports on display. Airports accessed
+// since the last quiescent_state() are never evicted: without it the budget is not enforced
+void set_apts_details_memory_budget(size_t bytes);
+int get_apt_tess_level(double meters_per_pixel);
+xpdata_apt_surface_t get_apt_surface(const xpdata_apt_t *apt, double lat, double lon);
+int find_taxi_route(const xpdata_apt_t *apt, xpdata_coords_t from, const char* rwy_name, const char* const* taxiways, int taxiways_len, xpdata_apt_taxi_point_t *buffer, int buffer_len);
+int find_taxi_route_from_gate(const xpdata_apt_t *apt, const char* gate_name, const char* rwy_name, const char* const* taxiways, int taxiways_len, xpdata_apt_taxi_point_t *buffer, int buffer_len);
 
 int get_mora(double lat, double lon);
 
@@ -322,15 +447,36 @@ xpdata_awy_array_t get_awy_by_id(const char* id);
 xpdata_awy_array_t get_awy_by_start_wpt(const char* wpt_id);
 xpdata_awy_array_t get_awy_by_end_wpt(const char* wpt_id);
 
+// The points stay valid forever if quiescent_state() is never called. Otherwise only until
+// the next quiescent_state(): the results are cached and evicted, call it again next frame
 xpdata_triangulation_t triangulate(const xpdata_apt_node_array_t* array);
 
 xpdata_cifp_t get_cifp(const char* airport_id);
+const xpdata_cifp_rwy_data_t* get_cifp_rwy(const char* airport_id, const char* rwy_name);
+const xpdata_cifp_data_t* get_cifp_proc(const char* airport_id, xpdata_cifp_proc_type_t type, const char* proc_name, const char* trans_name);
+xpdata_cifp_ptr_array_t get_cifp_procs_by_rwy(const char* airport_id, xpdata_cifp_proc_type_t type, const char* rwy_name);
+xpdata_cifp_ptr_array_t get_cifp_apprs_by_type(const char* airport_id, char appr_type);
+xpdata_cifp_geometry_t get_cifp_geometry(const char* airport_id, xpdata_cifp_proc_type_t type, const char* proc_name, const char* trans_name);
 void load_cifp(const char* airport_id);
-bool is_cifp_ready();
+void load_all_cifp(void);
+bool is_cifp_ready(const char* airport_id);
+void pin_cifp(const char* airport_id, bool pinned);
+// Airports read since the last quiescent_state() are never evicted: without calls to
+// quiescent_state() the budget is not enforced
+void set_cifp_memory_budget(size_t bytes);
+
+void quiescent_state(void);
 
 bool xpdata_is_ready(void);
+int poll_events(xpdata_event_t* buffer, int max);
 
 double get_declination(double lat, double lon, unsigned short year);
+void get_declination_batch(const xpdata_coords_t* coords, int coords_len, unsigned short year, double* out);
+double get_navaid_declination(const xpdata_navaid_t* navaid);
+double get_fix_declination(const xpdata_fix_t* fix);
+double get_apt_declination(const xpdata_apt_t* apt);
+double get_geoid_height(double lat, double lon);
+void get_geoid_height_batch(const xpdata_coords_t* coords, int coords_len, double* out);
 unsigned int get_navdata_year();
 unsigned int get_navdata_month();
 
@@ -0,0 +1,286 @@
+-- Lazy views over the structs and arrays returned by the library (load the cdef of
+-- avionicsbay_lua_include first). Creating a view copies nothing: the fields are read from the C
+-- memory on access, the strings are converted once and cached by address. Arrays are 1-based:
+-- use .len (not #) and :iter() (not ipairs). :to_table() makes a deep copy in plain Lua tables.
+--
+-- A view is valid as long as the memory it wraps: the navaids, fixes, airports, holds and
+-- airways until terminate(), the CIFP data until it is evicted (see quiescent_state()). Call
+-- reset() before each initialize(): a new database may reuse the addresses of the old one.
+--
+--     local views = require("avionicsbay_lua_views")
+--     local fixes = views.fixes(AvionicsBay.c.get_fixes_by_name("ROMEO"))
+--     for i, fix in fixes:iter() do print(fix.id, fix.coords.lat) end
+
+local ffi = require("ffi")
+
+local M = {}
+
+-- The strings of the database never move nor change until terminate(): shared by all the views
+local db_strings = {}
+
+-- The caches are keyed by length, then by address: two strings may start at the same address
+local function cached(cache, ptr, len)
+    local by_addr = cache[len]
+    if by_addr == nil then
+        by_addr = {}
+        cache[len] = by_addr
+    end
+    return by_addr, tonumber(ffi.cast("uintptr_t", ptr))
+end
+
+local function str(ptr, len, cache)
+    if ptr == nil or len <= 0 then
+        return ""
+    end
+    local by_addr, key = cached(cache, ptr, len)
+    local s = by_addr[key]
+    if s == nil then
+        s = ffi.string(ptr, len)
+        by_addr[key] = s
+    end
+    return s
+end
+
+-- Fixed size char arrays, not always NUL-terminated (e.g. region codes)
+local function chars(arr, size, cache)
+    local by_addr, key = cached(cache, arr, size)
+    local s = by_addr[key]
+    if s == nil then
+        s = ffi.string(arr, size):match("^[^%z]*")
+        by_addr[key] = s
+    end
+    return s
+end
+
+-- Field converters: function(cdata, string_cache) -> value
+local function string_field(ptr_name, len_name)
+    return function(c, cache) return str(c[ptr_name], c[len_name], cache) end
+end
+
+local function chars_field(name, size)
+    return function(c, cache) return chars(c[name], size, cache) end
+end
+
+local function char_field(name)
+    return function(c) return c[name] ~= 0 and string.char(c[name]) or "" end
+end
+
+-- Arrays are described, not converted: the view is created on access, to_table copies the
+-- elements directly. ptr and len: function(cdata) -> pointer, length
+local function array_desc(ptr, len, elem_type)
+    return {ptr = ptr, len = len, elem = elem_type}
+end
+
+local function array_field(ptr_name, len_name, elem_type)
+    local len = type(len_name) == "number" and function() return len_name end or function(c) return c[len_name] end
+    return array_desc(function(c) return c[ptr_name] end, len, elem_type)
+end
+
+--**************************************************************************************************
+-- Views
+--**************************************************************************************************
+
+local copy_struct
+
+local function copy_value(v)
+    if type(v) == "cdata" then
+        if ffi.istype("xpdata_coords_t", v) then
+            return {lat = v.lat, lon = v.lon}
+        end
+        return tonumber(v) or v     -- Pointers are kept as they are
+    end
+    return v
+end
+
+local function copy_array(ptr, len, elem_type, cache)
+    local t = {}
+    if ptr ~= nil then
+        for i = 1, len do
+            t[i] = elem_type and copy_struct(elem_type, ptr[i-1], cache) or copy_value(ptr[i-1])
+        end
+    end
+    return t
+end
+
+copy_struct = function(T, c, cache)
+    local t = {}
+    for _, name in ipairs(T.fields) do
+        local f = T.conv[name]
+        if f == nil then
+            t[name] = copy_value(c[name])
+        elseif type(f) == "table" then
+            t[name] = copy_array(f.ptr(c), f.len(c), f.elem, cache)
+        else
+            t[name] = f(c, cache)
+        end
+    end
+    return t
+end
+
+local new_array
+
+local struct_methods = {}
+
+function struct_methods.to_table(self)
+    return copy_struct(self._t, self._c, self._s)
+end
+
+-- fields: the names copied by to_table, conv: the fields converted on access (the others are
+-- read as they are from the C struct)
+local function struct_type(fields, conv)
+    local T = {fields = fields, conv = conv}
+    T.mt = {
+        __index = function(self, k)
+            local f = conv[k]
+            if f == nil then
+                return struct_methods[k] or self._c[k]
+            elseif type(f) == "table" then
+                local c = self._c
+                local v = new_array(f.ptr(c), f.len(c), f.elem, self._s)
+                rawset(self, k, v)  -- Nested views are created once
+                return v
+            end
+            return f(self._c, self._s)
+        end
+    }
+    return T
+end
+
+local function new_struct(T, c, cache)
+    return setmetatable({_c = c, _s = cache, _t = T}, T.mt)
+end
+
+local array_methods = {}
+
+function array_methods.iter(self)
+    local i = 0
+    return function()
+        i = i + 1
+        if i <= self.len then
+            return i, self[i]
+        end
+    end
+end
+
+function array_methods.to_table(self)
+    return copy_array(self._p, self.len, self._elem, self._s)
+end
+
+local array_mt = {
+    __index = function(self, k)
+        if type(k) == "number" then
+            if k < 1 or k > self.len then
+                return nil
+            end
+            local c = self._p[k-1]
+            local v = self._elem and new_struct(self._elem, c, self._s) or c
+            rawset(self, k, v)
+            return v
+        end
+        return array_methods[k]
+    end
+}
+
+-- elem_type nil: the elements are returned as cdata
+new_array = function(ptr, len, elem_type, cache)
+    if ptr == nil then
+        len = 0
+    end
+    return setmetatable({_p = ptr, len = len, _elem = elem_type, _s = cache}, array_mt)
+end
+
+--**************************************************************************************************
+-- Types
+--**************************************************************************************************
+
+local navaid_t = struct_type(
+    {"id", "full_name", "type", "coords", "altitude", "frequency", "category", "bearing", "region_code", "is_coupled_dme"},
+    {id = string_field("id", "id_len"), full_name = string_field("full_name", "full_name_len"), region_code = chars_field("region_code", 2)})
+
+local fix_t = struct_type(
+    {"id", "coords", "region_code", "airport_id"},
+    {id = string_field("id", "id_len"), region_code = chars_field("region_code", 2), airport_id = chars_field("airport_id", 4)})
+
+local rwy_t = struct_type(
+    {"name", "sibl_name", "coords", "sibl_coords", "width", "surface_type", "has_ctr_lights"},
+    {name = chars_field("name", 4), sibl_name = chars_field("sibl_name", 4)})
+
+local rwy_geom_t = struct_type(
+    {"length", "true_heading", "mag_heading", "sibl_true_heading", "sibl_mag_heading", "corners", "ext_centerline"},
+    {corners = array_field("corners", 4), ext_centerline = array_field("ext_centerline", 2)})
+
+local apt_t = struct_type(
+    {"id", "full_name", "altitude", "rwys", "rwys_geom", "apt_center", "is_loaded_details"},
+    {id = string_field("id", "id_len"), full_name = string_field("full_name", "full_name_len"),
+     rwys = array_field("rwys", "rwys_len", rwy_t), rwys_geom = array_field("rwys_geom", "rwys_len", rwy_geom_t)})
+
+local hold_t = struct_type(
+    {"id", "apt_id", "navaid_type", "turn_direction", "region_code", "inbound_course", "leg_time", "dme_leg_length",
+     "max_altitude", "min_altitude", "holding_speed_limit"},
+    {id = string_field("id", "id_len"), apt_id = string_field("apt_id", "apt_id_len"),
+     turn_direction = char_field("turn_direction"), region_code = chars_field("region_code", 2)})
+
+local awy_t = struct_type(
+    {"id", "start_wpt", "start_wpt_type", "start_wpt_region_code", "end_wpt", "end_wpt_type", "end_wpt_region_code",
+     "base_alt", "top_alt"},
+    {id = string_field("id", "id_len"), start_wpt = string_field("start_wpt", "start_wpt_len"),
+     start_wpt_region_code = chars_field("start_wpt_region_code", 2), end_wpt = string_field("end_wpt", "end_wpt_len"),
+     end_wpt_region_code = chars_field("end_wpt_region_code", 2)})
+
+local cifp_leg_t = struct_type(
+    {"leg_name", "center_fix", "recomm_navaid", "radius", "cstr_altitude1", "cstr_altitude2", "cstr_speed", "theta", "rho",
+     "outb_mag", "rte_hold", "vpath_angle", "region_code_leg_name", "region_code_ctr_fix", "region_code_rec_navaid",
+     "leg_type", "cstr_alt_type", "cstr_speed_type", "turn_direction", "cstr_altitude1_fl", "cstr_altitude2_fl",
+     "outb_mag_in_true", "rte_hold_in_time", "fly_over_wpt", "approach_iaf", "approach_if", "approach_faf",
+     "holding_fix", "first_missed_app"},
+    {leg_name = string_field("leg_name", "leg_name_len"), center_fix = string_field("center_fix", "center_fix_len"),
+     recomm_navaid = string_field("recomm_navaid", "recomm_navaid_len"),
+     region_code_leg_name = chars_field("region_code_leg_name", 2), region_code_ctr_fix = chars_field("region_code_ctr_fix", 2),
+     region_code_rec_navaid = chars_field("region_code_rec_navaid", 2), turn_direction = char_field("turn_direction")})
+
+local cifp_data_t = struct_type(
+    {"type", "proc_name", "trans_name", "legs", "transition_altitude"},
+    {type = char_field("type"), proc_name = string_field("proc_name", "proc_name_len"),
+     trans_name = string_field("trans_name", "trans_name_len"), legs = array_field("legs", "legs_len", cifp_leg_t)})
+
+local cifp_rwy_t = struct_type(
+    {"ldg_threshold_alt", "rwy_name", "loc_ident", "ils_category"},
+    {rwy_name = string_field("rwy_name", "rwy_name_len"), loc_ident = string_field("loc_ident", "loc_ident_len"),
+     ils_category = char_field("ils_category")})
+
+local cifp_t = struct_type(
+    {"sids", "stars", "apprs", "rwys"},
+    {sids = array_desc(function(c) return c.sids.data end, function(c) return c.sids.len end, cifp_data_t),
+     stars = array_desc(function(c) return c.stars.data end, function(c) return c.stars.len end, cifp_data_t),
+     apprs = array_desc(function(c) return c.apprs.data end, function(c) return c.apprs.len end, cifp_data_t),
+     rwys = array_desc(function(c) return c.rwys.data end, function(c) return c.rwys.len end, cifp_rwy_t)})
+
+--**************************************************************************************************
+-- Constructors
+--**************************************************************************************************
+
+-- Forgets the strings of the database: to be called before initialize()
+function M.reset()
+    db_strings = {}
+end
+
+function M.navaids(arr) return new_array(arr.navaids, arr.len, navaid_t, db_strings) end
+function M.fixes(arr)   return new_array(arr.fixes, arr.len, fix_t, db_strings) end
+function M.apts(arr)    return new_array(arr.apts, arr.len, apt_t, db_strings) end
+function M.holds(arr)   return new_array(arr.holds, arr.len, hold_t, db_strings) end
+function M.awys(arr)    return new_array(arr.awys, arr.len, awy_t, db_strings) end
+
+function M.navaid(ptr) return ptr ~= nil and new_struct(navaid_t, ptr, db_strings) or nil end
+function M.fix(ptr)    return ptr ~= nil and new_struct(fix_t, ptr, db_strings) or nil end
+function M.apt(ptr)    return ptr ~= nil and new_struct(apt_t, ptr, db_strings) or nil end
+
+-- The CIFP memory is released on eviction and may be reused: each view has its own string cache
+function M.cifp(c_cifp)
+    return new_struct(cifp_t, c_cifp, {})
+end
+
+function M.cifp_procs(ptr_arr)
+    return new_array(ptr_arr.data, ptr_arr.len, cifp_data_t, {})
+end
+
+return M
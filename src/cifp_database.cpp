@@ -0,0 +1,371 @@
+#include "cifp_database.hpp"
+
+#include "cifp_parser.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+
+namespace avionicsbay {
+
+static constexpr char CIFP_DB_MAGIC[8] = {'A','V','B','C','I','F','P','\0'};
+
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~static_cast<uint64_t>(7);
+}
+
+template<typename T>
+static T* offset_to_ptr(uint64_t offset) {
+    return reinterpret_cast<T*>(static_cast<uintptr_t>(offset));
+}
+
+template<typename T>
+static uint64_t ptr_to_offset(const T* ptr) {
+    return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(ptr));
+}
+
+uint32_t cifp_db_layout_hash() noexcept {
+    // The database stores the structures as they are in memory: any change in their layout
+    // must invalidate the cached files
+    uint32_t hash = 2166136261u;
+    for (uint32_t v : { (uint32_t) sizeof(void*),
+                        (uint32_t) sizeof(xpdata_cifp_data_t), (uint32_t) offsetof(xpdata_cifp_data_t, legs),
+                        (uint32_t) sizeof(xpdata_cifp_leg_t),  (uint32_t) offsetof(xpdata_cifp_leg_t, leg_type),
+                        (uint32_t) sizeof(xpdata_cifp_rwy_data_t), (uint32_t) offsetof(xpdata_cifp_rwy_data_t, loc_ident),
+                        (uint32_t) sizeof(cifp_db_airport_t) }) {
+        hash = (hash ^ v) * 16777619u;
+    }
+    return hash;
+}
+
+//**************************************************************************************************
+// Builder
+//**************************************************************************************************
+
+const char* CIFPDatabaseBuilder::intern(const char* str, int len) {
+    std::string key(str, len);
+    auto it = strings_idx.find(key);
+    uint64_t offset;
+    if (it != strings_idx.end()) {
+        offset = it->second;
+    } else {
+        offset = strings.size();
+        strings.append(key);
+        strings.push_back('\0');
+        strings_idx.emplace(std::move(key), offset);
+    }
+    return offset_to_ptr<const char>(offset + 1);   // 0 is reserved for nullptr
+}
+
+void CIFPDatabaseBuilder::add_airport(const std::string &id, const CIFPAirport &apt) {
+    if (id.size() >= CIFP_DB_ID_LEN) {
+        return;     // Not representable, it will be loaded on demand as usual
+    }
+
+    BuiltAirport built;
+    built.id = id;
+    built.nr_sids  = apt.sids.size();
+    built.nr_stars = apt.stars.size();
+    built.nr_apps  = apt.apps.size();
+
+    // The legs are already contiguous and _legs_arr_ref is the index of the first leg
+    built.procs.reserve(built.nr_sids + built.nr_stars + built.nr_apps);
+    for (const auto *procs : {&apt.sids, &apt.stars, &apt.apps}) {
+        built.procs.insert(built.procs.end(), procs->begin(), procs->end());
+    }
+    built.legs = apt.legs;
+    built.rwys = apt.rwys;
+    std::stable_sort(built.rwys.begin(), built.rwys.end(), [](const xpdata_cifp_rwy_data_t &a, const xpdata_cifp_rwy_data_t &b) {
+        return std::string_view(a.rwy_name, a.rwy_name_len) < std::string_view(b.rwy_name, b.rwy_name_len);
+    });
+
+    std::lock_guard<std::mutex> lk(mx);
+    for (auto &proc : built.procs) {
+        proc.proc_name  = intern(proc.proc_name,  proc.proc_name_len);
+        proc.trans_name = intern(proc.trans_name, proc.trans_name_len);
+    }
+    for (auto &leg : built.legs) {
+        leg.leg_name      = intern(leg.leg_name,      leg.leg_name_len);
+        leg.center_fix    = intern(leg.center_fix,    leg.center_fix_len);
+        leg.recomm_navaid = intern(leg.recomm_navaid, leg.recomm_navaid_len);
+    }
+    for (auto &rwy : built.rwys) {
+        rwy.rwy_name  = intern(rwy.rwy_name,  rwy.rwy_name_len);
+        rwy.loc_ident = intern(rwy.loc_ident, rwy.loc_ident_len);
+    }
+    airports.push_back(std::move(built));
+}
+
+void CIFPDatabaseBuilder::write(std::ostream &os, uint64_t fingerprint) {
+    std::lock_guard<std::mutex> lk(mx);
+
+    std::sort(airports.begin(), airports.end(), [](const BuiltAirport &a, const BuiltAirport &b) {
+        return a.id < b.id;
+    });
+
+    // 1 - Compute the layout
+    std::vector<cifp_db_airport_t> table(airports.size());
+    uint64_t offset = align8(sizeof(cifp_db_header_t));
+    const uint64_t airports_offset = offset;
+    offset = align8(offset + table.size() * sizeof(cifp_db_airport_t));
+
+    for (size_t i=0; i < airports.size(); i++) {
+        const auto &apt = airports[i];
+        auto &entry = table[i];
+        std::memset(&entry, 0, sizeof(entry));
+        std::memcpy(entry.id, apt.id.c_str(), apt.id.size());
+        entry.nr_sids  = apt.nr_sids;
+        entry.nr_stars = apt.nr_stars;
+        entry.nr_apps  = apt.nr_apps;
+        entry.nr_legs  = apt.legs.size();
+        entry.nr_rwys  = apt.rwys.size();
+
+        entry.procs_offset = offset;
+        offset = align8(offset + apt.procs.size() * sizeof(xpdata_cifp_data_t));
+        entry.legs_offset = offset;
+        offset = align8(offset + apt.legs.size() * sizeof(xpdata_cifp_leg_t));
+        entry.rwys_offset = offset;
+        offset = align8(offset + apt.rwys.size() * sizeof(xpdata_cifp_rwy_data_t));
+    }
+
+    cifp_db_header_t header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, CIFP_DB_MAGIC, sizeof(header.magic));
+    header.version     = CIFP_DB_VERSION;
+    header.layout_hash = cifp_db_layout_hash();
+    header.fingerprint = fingerprint;
+    header.airports_offset = airports_offset;
+    header.nr_airports     = table.size();
+    header.strings_offset  = offset;
+    header.strings_size    = strings.size();
+    header.total_size      = offset + strings.size();
+
+    // 2 - Write everything
+    static const char zeros[8] = {0};
+    uint64_t written = 0;
+    auto write_at = [&os, &written](uint64_t position, const void* data, size_t len) {
+        os.write(zeros, position - written);    // Alignment padding
+        os.write(static_cast<const char*>(data), len);
+        written = position + len;
+    };
+
+    write_at(0, &header, sizeof(header));
+    write_at(airports_offset, table.data(), table.size() * sizeof(cifp_db_airport_t));
+
+    for (size_t i=0; i < airports.size(); i++) {
+        auto &apt = airports[i];
+        for (auto &proc : apt.procs) {
+            proc.legs = offset_to_ptr<xpdata_cifp_leg_t>(table[i].legs_offset + proc._legs_arr_ref * sizeof(xpdata_cifp_leg_t));
+            proc._legs_arr_ref = 0;
+        }
+        write_at(table[i].procs_offset, apt.procs.data(), apt.procs.size() * sizeof(xpdata_cifp_data_t));
+        write_at(table[i].legs_offset,  apt.legs.data(),  apt.legs.size()  * sizeof(xpdata_cifp_leg_t));
+        write_at(table[i].rwys_offset,  apt.rwys.data(),  apt.rwys.size()  * sizeof(xpdata_cifp_rwy_data_t));
+    }
+
+    write_at(header.strings_offset, strings.data(), strings.size());
+}
+
+//**************************************************************************************************
+// Database
+//**************************************************************************************************
+
+bool CIFPDatabase::open_file(const std::string &filename, uint64_t fingerprint) noexcept {
+    if (!file.open(filename)) {
+        return false;
+    }
+    base = file.data();
+    size = file.size();
+    if (!validate(fingerprint)) {
+        file.close();
+        return false;
+    }
+    return true;
+}
+
+bool CIFPDatabase::open_buffer(std::string &&buffer, uint64_t fingerprint) noexcept {
+    this->buffer = std::move(buffer);
+    base = &this->buffer[0];
+    size = this->buffer.size();
+    if (!validate(fingerprint)) {
+        this->buffer.clear();
+        return false;
+    }
+    return true;
+}
+
+bool CIFPDatabase::validate(uint64_t fingerprint) noexcept {
+    if (size < sizeof(cifp_db_header_t)) {
+        return false;
+    }
+    const auto* header = reinterpret_cast<const cifp_db_header_t*>(base);
+    if (std::memcmp(header->magic, CIFP_DB_MAGIC, sizeof(header->magic)) != 0
+        || header->version != CIFP_DB_VERSION
+        || header->layout_hash != cifp_db_layout_hash()
+        || header->fingerprint != fingerprint
+        || header->total_size != size
+        || header->airports_offset + header->nr_airports * sizeof(cifp_db_airport_t) > size
+        || header->strings_offset + header->strings_size > size
+        || (header->strings_size > 0 && base[header->strings_offset + header->strings_size - 1] != '\0')) {
+        return false;
+    }
+
+    airports     = reinterpret_cast<cifp_db_airport_t*>(base + header->airports_offset);
+    nr_airports  = header->nr_airports;
+    strings      = base + header->strings_offset;
+    strings_size = header->strings_size;
+    relocated.reset(new std::atomic<uint8_t>[nr_airports]);
+    for (size_t i=0; i < nr_airports; i++) {
+        relocated[i] = 0;
+    }
+    return true;
+}
+
+const cifp_db_airport_t* CIFPDatabase::find(const char* id) const noexcept {
+    if (airports == nullptr || std::strlen(id) >= CIFP_DB_ID_LEN) {
+        return nullptr;
+    }
+
+    char key[CIFP_DB_ID_LEN] = {0};
+    std::strncpy(key, id, CIFP_DB_ID_LEN-1);
+
+    auto it = std::lower_bound(airports, airports + nr_airports, key, [](const cifp_db_airport_t &a, const char* k) {
+        return std::memcmp(a.id, k, CIFP_DB_ID_LEN) < 0;
+    });
+    if (it == airports + nr_airports || std::memcmp(it->id, key, CIFP_DB_ID_LEN) != 0) {
+        return nullptr;
+    }
+    return it;
+}
+
+bool CIFPDatabase::has_airport(const char* id) const noexcept {
+    return find(id) != nullptr;
+}
+
+bool CIFPDatabase::relocate(cifp_db_airport_t &apt) noexcept {
+    const uint64_t nr_procs = (uint64_t) apt.nr_sids + apt.nr_stars + apt.nr_apps;
+    if (apt.procs_offset + nr_procs * sizeof(xpdata_cifp_data_t) > size
+        || apt.legs_offset + (uint64_t) apt.nr_legs * sizeof(xpdata_cifp_leg_t) > size
+        || apt.rwys_offset + (uint64_t) apt.nr_rwys * sizeof(xpdata_cifp_rwy_data_t) > size) {
+        return false;
+    }
+
+    bool ok = true;
+    auto fix_string = [this, &ok](const char* &str) {
+        uint64_t offset = ptr_to_offset(str);
+        if (offset == 0 || offset > strings_size) {
+            ok = false;
+            str = "";
+        } else {
+            str = strings + offset - 1;
+        }
+    };
+
+    const uint64_t legs_end = apt.legs_offset + (uint64_t) apt.nr_legs * sizeof(xpdata_cifp_leg_t);
+
+    auto* procs = reinterpret_cast<xpdata_cifp_data_t*>(base + apt.procs_offset);
+    for (uint64_t i=0; i < nr_procs; i++) {
+        fix_string(procs[i].proc_name);
+        fix_string(procs[i].trans_name);
+        uint64_t offset = ptr_to_offset(procs[i].legs);
+        if (offset < apt.legs_offset || procs[i].legs_len < 0 || offset + procs[i].legs_len * sizeof(xpdata_cifp_leg_t) > legs_end) {
+            ok = false;
+            procs[i].legs = nullptr;
+            procs[i].legs_len = 0;
+        } else {
+            procs[i].legs = reinterpret_cast<xpdata_cifp_leg_t*>(base + offset);
+        }
+    }
+
+    auto* legs = reinterpret_cast<xpdata_cifp_leg_t*>(base + apt.legs_offset);
+    for (uint32_t i=0; i < apt.nr_legs; i++) {
+        fix_string(legs[i].leg_name);
+        fix_string(legs[i].center_fix);
+        fix_string(legs[i].recomm_navaid);
+    }
+
+    auto* rwys = reinterpret_cast<xpdata_cifp_rwy_data_t*>(base + apt.rwys_offset);
+    for (uint32_t i=0; i < apt.nr_rwys; i++) {
+        fix_string(rwys[i].rwy_name);
+        fix_string(rwys[i].loc_ident);
+    }
+
+    return ok;
+}
+
+cifp_db_airport_t* CIFPDatabase::find_relocated(const char* id) noexcept {
+    const cifp_db_airport_t* c_apt = find(id);
+    if (c_apt == nullptr) {
+        return nullptr;
+    }
+    size_t idx = c_apt - airports;
+
+    if (relocated[idx] == 0) {
+        // First access to this airport: transform the offsets into pointers (the pages are
+        // private, so the file is not modified)
+        std::lock_guard<std::mutex> lk(mx_relocate);
+        if (relocated[idx] == 0) {
+            relocated[idx] = relocate(airports[idx]) ? 1 : 2;
+        }
+    }
+    return relocated[idx] == 1 ? &airports[idx] : nullptr;
+}
+
+bool CIFPDatabase::get_airport(const char* id, xpdata_cifp_t &out) noexcept {
+    const cifp_db_airport_t* c_apt = find_relocated(id);
+    if (c_apt == nullptr) {
+        return false;
+    }
+    const cifp_db_airport_t &apt = *c_apt;
+
+    const auto* procs = reinterpret_cast<const xpdata_cifp_data_t*>(base + apt.procs_offset);
+    out.sids.data  = apt.nr_sids  > 0 ? procs : nullptr;
+    out.sids.len   = apt.nr_sids;
+    out.stars.data = apt.nr_stars > 0 ? procs + apt.nr_sids : nullptr;
+    out.stars.len  = apt.nr_stars;
+    out.apprs.data = apt.nr_apps  > 0 ? procs + apt.nr_sids + apt.nr_stars : nullptr;
+    out.apprs.len  = apt.nr_apps;
+    out.rwys.data  = apt.nr_rwys  > 0 ? reinterpret_cast<const xpdata_cifp_rwy_data_t*>(base + apt.rwys_offset) : nullptr;
+    out.rwys.len   = apt.nr_rwys;
+    return true;
+}
+
+const xpdata_cifp_rwy_data_t* CIFPDatabase::get_runway(const char* id, std::string_view rwy_name) noexcept {
+    const cifp_db_airport_t* apt = find_relocated(id);
+    if (apt == nullptr) {
+        return nullptr;
+    }
+
+    const auto* rwys = reinterpret_cast<const xpdata_cifp_rwy_data_t*>(base + apt->rwys_offset);
+    auto it = std::lower_bound(rwys, rwys + apt->nr_rwys, rwy_name, [](const xpdata_cifp_rwy_data_t &r, std::string_view name) {
+        return std::string_view(r.rwy_name, r.rwy_name_len) < name;
+    });
+    if (it == rwys + apt->nr_rwys || std::string_view(it->rwy_name, it->rwy_name_len) != rwy_name) {
+        return nullptr;
+    }
+    return it;
+}
+
+const CIFPProcIndex* CIFPDatabase::get_index(const char* id) noexcept {
+    xpdata_cifp_t cifp = {};
+    if (!get_airport(id, cifp)) {
+        return nullptr;
+    }
+    const size_t idx = find(id) - airports;
+
+    std::lock_guard<std::mutex> lk(mx_index);
+    auto &index = indexes[idx];
+    if (!index) {
+        try {
+            index = std::make_unique<CIFPProcIndex>();
+            index->build(cifp);
+        } catch(...) {
+            index.reset();
+            return nullptr;
+        }
+    }
+    return index.get();
+}
+
+} // namespace avionicsbay
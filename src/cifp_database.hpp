@@ -0,0 +1,119 @@
+#ifndef CIFP_DATABASE_H
+#define CIFP_DATABASE_H
+
+#include "cifp_index.hpp"
+#include "utilities/mapped_file.hpp"
+#include "data_types.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace avionicsbay {
+
+struct CIFPAirport;
+
+// File format of the CIFP database. All the offsets are relative to the beginning of the file.
+// The records have the same layout of the structures returned by the API, except that the
+// pointer fields contain offsets until the airport is relocated (on its first access).
+constexpr uint32_t CIFP_DB_VERSION = 2;
+constexpr int CIFP_DB_ID_LEN = 8;
+
+typedef struct cifp_db_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t layout_hash;       // To detect a file generated by a different build/architecture
+    uint64_t fingerprint;       // Fingerprint of the CIFP directory the file was generated from
+    uint64_t total_size;
+    uint64_t airports_offset;   // Array of cifp_db_airport_t, sorted by id
+    uint64_t nr_airports;
+    uint64_t strings_offset;    // Interned null-terminated strings
+    uint64_t strings_size;
+} cifp_db_header_t;
+
+typedef struct cifp_db_airport_t {
+    char id[CIFP_DB_ID_LEN];    // Null-padded
+    uint64_t procs_offset;      // SIDs, then STARs, then approaches
+    uint32_t nr_sids;
+    uint32_t nr_stars;
+    uint32_t nr_apps;
+    uint32_t nr_legs;
+    uint64_t legs_offset;
+    uint64_t rwys_offset;       // Sorted by runway designator
+    uint32_t nr_rwys;
+    uint32_t padding;
+} cifp_db_airport_t;
+
+// Collects the parsed airports (from multiple threads) and serializes the database.
+class CIFPDatabaseBuilder {
+public:
+    void add_airport(const std::string &id, const CIFPAirport &apt);   // Thread-safe
+
+    void write(std::ostream &os, uint64_t fingerprint);
+
+    size_t get_nr_airports() const noexcept { return airports.size(); }
+
+private:
+    struct BuiltAirport {
+        std::string id;
+        std::vector<xpdata_cifp_data_t> procs;
+        uint32_t nr_sids, nr_stars, nr_apps;
+        std::vector<xpdata_cifp_leg_t> legs;
+        std::vector<xpdata_cifp_rwy_data_t> rwys;
+    };
+
+    std::mutex mx;
+    std::vector<BuiltAirport> airports;
+    std::string strings;
+    std::unordered_map<std::string, uint64_t> strings_idx;
+
+    const char* intern(const char* str, int len);  // mx must be held
+};
+
+// Read-only access to a database, either memory mapped or in memory
+class CIFPDatabase {
+public:
+    bool open_file(const std::string &filename, uint64_t fingerprint) noexcept;
+    bool open_buffer(std::string &&buffer, uint64_t fingerprint) noexcept;
+
+    bool has_airport(const char* id) const noexcept;
+    bool get_airport(const char* id, xpdata_cifp_t &out) noexcept;
+    const xpdata_cifp_rwy_data_t* get_runway(const char* id, std::string_view rwy_name) noexcept;
+    const CIFPProcIndex* get_index(const char* id) noexcept;   // Built on the first request
+
+    size_t get_nr_airports() const noexcept { return nr_airports; }
+
+private:
+    MappedFile file;
+    std::string buffer;
+
+    char* base = nullptr;
+    size_t size = 0;
+    cifp_db_airport_t* airports = nullptr;
+    size_t nr_airports = 0;
+    const char* strings = nullptr;
+    size_t strings_size = 0;
+
+    std::unique_ptr<std::atomic<uint8_t>[]> relocated;   // 0 = not yet, 1 = relocated, 2 = corrupted
+    std::mutex mx_relocate;
+
+    std::mutex mx_index;
+    std::unordered_map<size_t, std::unique_ptr<CIFPProcIndex>> indexes;  // key = airport index
+
+    bool validate(uint64_t fingerprint) noexcept;
+    const cifp_db_airport_t* find(const char* id) const noexcept;
+    cifp_db_airport_t* find_relocated(const char* id) noexcept;     // nullptr if not found or corrupted
+    bool relocate(cifp_db_airport_t &apt) noexcept;
+};
+
+uint32_t cifp_db_layout_hash() noexcept;
+
+} // namespace avionicsbay
+
+#endif // CIFP_DATABASE_H
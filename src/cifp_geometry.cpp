@@ -0,0 +1,483 @@
+#include "cifp_geometry.hpp"
+
+#include "constants.hpp"
+#include "great_circle.hpp"
+#include "plugin.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <string>
+
+#include "wmm_interface.hpp"
+
+#define LOG *this->logger << STARTL
+
+#define GEOM_GC_STEP_NM    5.0      // Max length of the tessellated great-circle segments
+#define GEOM_ARC_STEP_DEG  5.0      // Max angle of the tessellated arcs
+#define GEOM_OPEN_LEG_NM   3.0      // Length of legs terminated by altitude, intercept, radial
+#define GEOM_MANUAL_LEG_NM 5.0      // Length of legs terminated manually (VM, FM)
+#define GEOM_MAX_DME_NM    60.0     // Max length of legs terminated by a DME distance
+#define GEOM_HOLD_NM_MIN   3.5      // Nm per minute of holding legs defined in time
+#define GEOM_HOLD_RADIUS   1.5      // Holding turn radius (nm)
+
+#define GEOM_CACHE_SIZE 256         // Max nr. of polylines cached
+
+namespace avionicsbay {
+
+//**************************************************************************************************
+// Path construction
+//**************************************************************************************************
+
+namespace {
+
+// Builds the polyline of a single procedure, leg after leg
+class PathBuilder {
+public:
+    PathBuilder(const XPData &xpdata, const std::string &arpt_id, CIFPPolyline &out) : xpdata(xpdata), out(out) {
+        auto apts = xpdata.get_apts_by_name(arpt_id);
+        if (apts.second > 0) {
+            apt = apts.first[0];
+            ref = apt->apt_center;
+        }
+        year = xpdata.get_declination_year();
+    }
+
+    void start_from(const std::string &fix_name);
+    void add_leg(int leg_idx, const xpdata_cifp_leg_t &leg);
+
+private:
+    const XPData &xpdata;
+    CIFPPolyline &out;
+
+    const xpdata_apt_t* apt = nullptr;
+    xpdata_coords_t ref = {0, 0};   // Reference position to disambiguate the fixes
+    unsigned int year;
+
+    bool has_pos = false;
+    xpdata_coords_t pos;            // Current position
+    double course = 0;              // Current true course
+    int curr_leg = 0;
+
+    bool resolve(const char* name, int name_len, const char region[2], xpdata_coords_t &coords) const;
+
+    double true_course(const xpdata_cifp_leg_t &leg) const;
+
+    void emit(const xpdata_coords_t &point);
+    void move_to(const xpdata_coords_t &point);
+    void great_circle_to(const xpdata_coords_t &point);
+    void arc_to(const xpdata_coords_t &center, const xpdata_coords_t &end, char turn);
+    void straight(double crs, double dist_nm);
+    void dme_terminated(double crs, const xpdata_coords_t &navaid, double dme_nm);
+    void hold(const xpdata_coords_t &fix, double crs, char turn, double length_nm);
+};
+
+static bool is_left(char turn) {
+    return turn == 'L' || turn == 'M';
+}
+
+static bool region_matches(const char a[2], const char b[2]) {
+    return a[0] == 0 || (a[0] == b[0] && a[1] == b[1]);
+}
+
+bool PathBuilder::resolve(const char* name, int name_len, const char region[2], xpdata_coords_t &coords) const {
+    std::string id(name, name_len);
+    id.erase(id.find_last_not_of(' ') + 1);
+    if (id.empty()) {
+        return false;
+    }
+
+    // Runway thresholds first (e.g., RW34R)
+    if (apt != nullptr && id.size() > 2 && id[0] == 'R' && id[1] == 'W') {
+        std::string rwy_name = id.substr(2);
+        for (int i=0; i < apt->rwys_len; i++) {
+            if (rwy_name == apt->rwys[i].name) {
+                coords = apt->rwys[i].coords;
+                return true;
+            } else if (rwy_name == apt->rwys[i].sibl_name) {
+                coords = apt->rwys[i].sibl_coords;
+                return true;
+            }
+        }
+    }
+    if (apt != nullptr && id == std::string(apt->id, apt->id_len)) {
+        coords = apt->apt_center;
+        return true;
+    }
+
+    // Then fixes and navaids, the nearest one to the airport
+    double best = -1;
+    auto fixes = xpdata.get_fixes_by_name(id);
+    for (size_t i=0; i < fixes.second; i++) {
+        if (!region_matches(region, fixes.first[i]->region_code)) {
+            continue;
+        }
+        double dist = gc_distance_nm(ref, fixes.first[i]->coords);
+        if (best < 0 || dist < best) {
+            best = dist;
+            coords = fixes.first[i]->coords;
+        }
+    }
+
+    for (xpdata_navaid_type_t type : {NAV_ID_VOR, NAV_ID_NDB, NAV_ID_DME, NAV_ID_DME_ALONE, NAV_ID_LOC, NAV_ID_LOC_ALONE}) {
+        auto navaids = xpdata.get_navaids_by_name(type, id);
+        for (size_t i=0; i < navaids.second; i++) {
+            if (!region_matches(region, navaids.first[i]->region_code)) {
+                continue;
+            }
+            double dist = gc_distance_nm(ref, navaids.first[i]->coords);
+            if (best < 0 || dist < best) {
+                best = dist;
+                coords = navaids.first[i]->coords;
+            }
+        }
+    }
+
+    return best >= 0;
+}
+
+double PathBuilder::true_course(const xpdata_cifp_leg_t &leg) const {
+    double crs = leg.outb_mag / 10.;
+    if (!leg.outb_mag_in_true) {
+        const xpdata_coords_t &where = has_pos ? pos : ref;
+        crs += get_declination(where.lat, where.lon, year);
+    }
+    return normalize_deg(crs);
+}
+
+void PathBuilder::emit(const xpdata_coords_t &point) {
+    if (!out.points.empty()) {
+        const auto &last = out.points.back();
+        if (last.lat == point.lat && last.lon == point.lon) {
+            return;
+        }
+        out.distances.push_back(out.distances.back() + gc_distance_nm(last, point));
+    } else {
+        out.distances.push_back(0);
+    }
+    out.points.push_back(point);
+    out.legs.push_back(curr_leg);
+}
+
+void PathBuilder::move_to(const xpdata_coords_t &point) {
+    if (has_pos) {
+        great_circle_to(point);
+    } else {
+        emit(point);
+        pos = point;
+        has_pos = true;
+    }
+}
+
+void PathBuilder::great_circle_to(const xpdata_coords_t &point) {
+    double dist = gc_distance_nm(pos, point);
+    int steps = std::max(1, static_cast<int>(std::ceil(dist / GEOM_GC_STEP_NM)));
+    for (int i=1; i < steps; i++) {
+        emit(gc_intermediate(pos, point, static_cast<double>(i) / steps));
+    }
+    emit(point);
+    if (dist > 1e-6) {
+        course = normalize_deg(gc_bearing(point, pos) + 180.);    // Final course
+    }
+    pos = point;
+}
+
+void PathBuilder::arc_to(const xpdata_coords_t &center, const xpdata_coords_t &end, char turn) {
+    double start_radius = gc_distance_nm(center, pos);
+    double end_radius   = gc_distance_nm(center, end);
+    double start_brg = gc_bearing(center, pos);
+    double end_brg   = gc_bearing(center, end);
+
+    double cw = normalize_deg(end_brg - start_brg);  // Clockwise sweep (right turn)
+    double sweep;
+    if (is_left(turn)) {
+        sweep = cw - 360.;
+    } else if (turn == 'R' || turn == 'S') {
+        sweep = cw;
+    } else {
+        sweep = cw <= 180. ? cw : cw - 360.;    // Shortest
+    }
+
+    double length = std::abs(sweep) * DEG2RAD * std::max(start_radius, end_radius) + std::abs(end_radius - start_radius);
+    int steps = std::max(1, static_cast<int>(std::ceil(std::max(std::abs(sweep) / GEOM_ARC_STEP_DEG, length / GEOM_GC_STEP_NM))));
+    for (int i=1; i < steps; i++) {
+        double f = static_cast<double>(i) / steps;
+        emit(gc_destination(center, start_brg + f * sweep, start_radius + f * (end_radius - start_radius)));
+    }
+    emit(end);
+    course = normalize_deg(end_brg + (sweep >= 0 ? 90. : -90.));
+    pos = end;
+}
+
+void PathBuilder::straight(double crs, double dist_nm) {
+    great_circle_to(gc_destination(pos, crs, dist_nm));
+    course = crs;
+}
+
+void PathBuilder::dme_terminated(double crs, const xpdata_coords_t &navaid, double dme_nm) {
+    // Walk along the course until the DME distance is crossed
+    const double step = 0.5;
+    double prev_diff = gc_distance_nm(pos, navaid) - dme_nm;
+    for (double d = step; d <= GEOM_MAX_DME_NM; d += step) {
+        double diff = gc_distance_nm(gc_destination(pos, crs, d), navaid) - dme_nm;
+        if ((prev_diff <= 0) != (diff <= 0)) {
+            double t = prev_diff / (prev_diff - diff);
+            straight(crs, d - step + t * step);
+            return;
+        }
+        prev_diff = diff;
+    }
+    straight(crs, GEOM_OPEN_LEG_NM);
+}
+
+void PathBuilder::hold(const xpdata_coords_t &fix, double crs, char turn, double length_nm) {
+    // Racetrack: outbound turn, outbound leg, inbound turn, inbound leg to the fix
+    const double side = is_left(turn) ? -1. : 1.;
+    const double r = GEOM_HOLD_RADIUS;
+
+    xpdata_coords_t center1 = gc_destination(fix, crs + 90. * side, r);
+    double start_brg = normalize_deg(crs - 90. * side);
+    for (double a = GEOM_ARC_STEP_DEG; a <= 180.; a += GEOM_ARC_STEP_DEG) {
+        emit(gc_destination(center1, start_brg + a * side, r));
+    }
+
+    xpdata_coords_t abeam = gc_destination(fix, crs + 90. * side, 2 * r);
+    xpdata_coords_t outbound_end = gc_destination(abeam, crs + 180., length_nm);
+    pos = abeam;
+    great_circle_to(outbound_end);
+
+    xpdata_coords_t center2 = gc_destination(outbound_end, crs - 90. * side, r);
+    start_brg = normalize_deg(crs + 90. * side);
+    for (double a = GEOM_ARC_STEP_DEG; a <= 180.; a += GEOM_ARC_STEP_DEG) {
+        emit(gc_destination(center2, start_brg + a * side, r));
+    }
+    pos = out.points.back();
+    great_circle_to(fix);
+    course = crs;
+}
+
+void PathBuilder::start_from(const std::string &fix_name) {
+    xpdata_coords_t fix;
+    const char no_region[2] = {0, 0};
+    if (resolve(fix_name.c_str(), fix_name.size(), no_region, fix)) {
+        move_to(fix);
+    }
+}
+
+void PathBuilder::add_leg(int leg_idx, const xpdata_cifp_leg_t &leg) {
+    curr_leg = leg_idx;
+
+    xpdata_coords_t fix;
+    bool has_fix = resolve(leg.leg_name, leg.leg_name_len, leg.region_code_leg_name, fix);
+
+    switch (leg.leg_type) {
+        case NAV_CIFP_TYPE_IF:
+        case NAV_CIFP_TYPE_TF:
+        case NAV_CIFP_TYPE_CF:
+        case NAV_CIFP_TYPE_DF:
+        case NAV_CIFP_TYPE_PI:  // The procedure turn is not drawn
+            if (has_fix) {
+                move_to(fix);
+            }
+            break;
+
+        case NAV_CIFP_TYPE_RF:
+        case NAV_CIFP_TYPE_AF: {
+            if (!has_fix) {
+                break;
+            }
+            xpdata_coords_t center;
+            bool has_center = leg.leg_type == NAV_CIFP_TYPE_RF
+                            ? resolve(leg.center_fix, leg.center_fix_len, leg.region_code_ctr_fix, center)
+                            : resolve(leg.recomm_navaid, leg.recomm_navaid_len, leg.region_code_rec_navaid, center);
+            if (has_pos && has_center) {
+                arc_to(center, fix, leg.turn_direction);
+            } else {
+                move_to(fix);
+            }
+            break;
+        }
+
+        case NAV_CIFP_TYPE_HA:
+        case NAV_CIFP_TYPE_HF:
+        case NAV_CIFP_TYPE_HM: {
+            if (!has_fix) {
+                break;
+            }
+            move_to(fix);
+            double length = leg.rte_hold / 10.;
+            if (leg.rte_hold_in_time || length <= 0) {
+                length = (length > 0 ? length : 1.) * GEOM_HOLD_NM_MIN;
+            }
+            hold(fix, true_course(leg), leg.turn_direction, length);
+            break;
+        }
+
+        case NAV_CIFP_TYPE_FA:
+        case NAV_CIFP_TYPE_FC:
+        case NAV_CIFP_TYPE_FD:
+        case NAV_CIFP_TYPE_FM:
+        case NAV_CIFP_TYPE_CA:
+        case NAV_CIFP_TYPE_CD:
+        case NAV_CIFP_TYPE_CI:
+        case NAV_CIFP_TYPE_CR:
+        case NAV_CIFP_TYPE_VA:
+        case NAV_CIFP_TYPE_VD:
+        case NAV_CIFP_TYPE_VI:
+        case NAV_CIFP_TYPE_VM:
+        case NAV_CIFP_TYPE_VR: {
+            // Legs without a terminating fix: the F* legs start from their fix, the others
+            // from the current position
+            bool from_fix = leg.leg_type >= NAV_CIFP_TYPE_FA && leg.leg_type <= NAV_CIFP_TYPE_FM;
+            if (from_fix && has_fix) {
+                move_to(fix);
+            }
+            if (!has_pos) {
+                break;
+            }
+            double crs = true_course(leg);
+            xpdata_coords_t navaid;
+            if (leg.leg_type == NAV_CIFP_TYPE_FC) {
+                straight(crs, leg.rte_hold > 0 ? leg.rte_hold / 10. : GEOM_OPEN_LEG_NM);
+            } else if ((leg.leg_type == NAV_CIFP_TYPE_FD || leg.leg_type == NAV_CIFP_TYPE_CD || leg.leg_type == NAV_CIFP_TYPE_VD)
+                       && resolve(leg.recomm_navaid, leg.recomm_navaid_len, leg.region_code_rec_navaid, navaid)) {
+                dme_terminated(crs, navaid, leg.rte_hold > 0 ? leg.rte_hold / 10. : leg.rho / 10.);
+            } else if (leg.leg_type == NAV_CIFP_TYPE_FM || leg.leg_type == NAV_CIFP_TYPE_VM) {
+                straight(crs, GEOM_MANUAL_LEG_NM);
+            } else {
+                straight(crs, GEOM_OPEN_LEG_NM);
+            }
+            break;
+        }
+    }
+}
+
+} // namespace
+
+//**************************************************************************************************
+// CIFPGeometry
+//**************************************************************************************************
+
+CIFPGeometry::CIFPGeometry() : stop(false) {
+    this->logger    = get_logger();
+    this->reclaimer = get_reclaimer();
+    this->cifp      = get_cifp();
+    this->xpdata    = get_xpdata();
+
+    assert(this->logger && this->reclaimer && this->cifp && this->xpdata);
+
+    LOG << logger_level_t::DEBUG << "Initializing CIFP Geometry..." << ENDL;
+
+    worker_thread = std::thread(&CIFPGeometry::worker, this);
+}
+
+CIFPGeometry::~CIFPGeometry() {
+    {
+        std::lock_guard<std::mutex> lk(mx);
+        this->stop = true;
+    }
+    cv.notify_all();
+    worker_thread.join();
+}
+
+const CIFPPolyline* CIFPGeometry::get_polyline(const std::string &arpt_id, xpdata_cifp_proc_type_t type, const std::string &proc_name, const std::string &trans_name, bool &not_found) noexcept {
+    std::string key = arpt_id + ':' + std::to_string(type) + ':' + proc_name + ':' + trans_name;
+
+    std::lock_guard<std::mutex> lk(mx);
+    auto it = cache.find(key);
+    if (it != cache.end()) {
+        it->second.last_access = ++access_counter;
+        not_found = it->second.polyline == nullptr;
+        return it->second.polyline.get();
+    }
+
+    not_found = false;
+    if (pending.insert(key).second) {
+        queue.push_back({key, arpt_id, type, proc_name, trans_name});
+        cv.notify_one();
+    }
+    return nullptr;
+}
+
+void CIFPGeometry::worker() noexcept {
+
+#if defined(__linux__)
+    pthread_setname_np(pthread_self(), "CIFPGeometry");   // For debugging purposes
+#endif
+
+    while (true) {
+        Request req;
+        {
+            std::unique_lock<std::mutex> lk(mx);
+            cv.wait(lk, [this] { return this->stop || !this->queue.empty(); });
+            if (this->stop) {
+                return;
+            }
+            req = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        std::shared_ptr<CIFPPolyline> polyline;
+        bool not_found = false;
+        try {
+            polyline = compute(req, not_found);
+        } catch(...) {
+            LOG << logger_level_t::ERROR << "[CIFPGeometry] Unable to compute " << req.key << ENDL;
+        }
+
+        std::lock_guard<std::mutex> lk(mx);
+        pending.erase(req.key);
+        if (polyline || not_found) {
+            cache[req.key] = {std::move(polyline), ++access_counter};
+            evict_over_size();
+        }
+    }
+}
+
+std::shared_ptr<CIFPPolyline> CIFPGeometry::compute(const Request &req, bool &not_found) {
+    if (!xpdata->get_is_ready()) {
+        return nullptr;     // Not loaded yet, the next request will try again
+    }
+
+    // Keep the airport data alive while reading it, and read that same instance
+    const CIFPProcIndex* index = nullptr;
+    auto holder = cifp->acquire_airport(req.arpt_id.c_str(), index);
+    if (!holder) {
+        return nullptr;     // Same
+    }
+    const xpdata_cifp_data_t* proc = index->find(req.type, req.proc_name.c_str(), req.trans_name.c_str());
+    if (proc == nullptr) {
+        not_found = true;   // The airport is loaded: asking again won't help
+        return nullptr;
+    }
+
+    auto polyline = std::make_shared<CIFPPolyline>();
+    PathBuilder builder(*xpdata, req.arpt_id, *polyline);
+    if (req.type == NAV_CIFP_PROC_SID && req.trans_name.compare(0, 2, "RW") == 0) {
+        builder.start_from(req.trans_name);     // Runway transitions start at the runway threshold
+    }
+    for (int i=0; i < proc->legs_len; i++) {
+        builder.add_leg(i, proc->legs[i]);
+    }
+
+    polyline->points.shrink_to_fit();
+    polyline->distances.shrink_to_fit();
+    polyline->legs.shrink_to_fit();
+    return polyline;
+}
+
+void CIFPGeometry::evict_over_size() noexcept {
+    while (cache.size() > GEOM_CACHE_SIZE) {
+        auto lru_it = cache.begin();
+        for (auto it = cache.begin(); it != cache.end(); ++it) {
+            if (it->second.last_access < lru_it->second.last_access) {
+                lru_it = it;
+            }
+        }
+        if (lru_it->second.polyline) {
+            reclaimer->retire(std::move(lru_it->second.polyline));  // The user may still hold the pointers
+        }
+        cache.erase(lru_it);
+    }
+}
+
+} // namespace avionicsbay
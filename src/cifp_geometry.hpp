@@ -0,0 +1,79 @@
+#ifndef CIFP_GEOMETRY_H
+#define CIFP_GEOMETRY_H
+
+#include "utilities/epoch_reclaimer.hpp"
+#include "utilities/logger.hpp"
+#include "data_types.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace avionicsbay {
+
+class CIFPParser;
+class XPData;
+
+// The lateral path of a procedure: great-circle segments and tessellated arcs, as parallel arrays
+struct CIFPPolyline {
+    std::vector<xpdata_coords_t> points;
+    std::vector<double> distances;      // Along-track distance from the first point (nm)
+    std::vector<int> legs;              // Index of the leg each point belongs to
+};
+
+// Computes (in background) and caches the polylines of the CIFP procedures. The fixes are
+// resolved through XPData, so the navigation data must be ready.
+class CIFPGeometry {
+public:
+    CIFPGeometry();
+    virtual ~CIFPGeometry();
+
+    // Returns nullptr if the polyline is not ready yet: in that case it is queued for computation
+    // and the caller should request it again later. Also nullptr, with not_found set, if the
+    // airport is loaded but the procedure doesn't exist (or the CIFP failed to load).
+    const CIFPPolyline* get_polyline(const std::string &arpt_id, xpdata_cifp_proc_type_t type, const std::string &proc_name, const std::string &trans_name, bool &not_found) noexcept;
+
+private:
+    struct Request {
+        std::string key;
+        std::string arpt_id;
+        xpdata_cifp_proc_type_t type;
+        std::string proc_name;
+        std::string trans_name;
+    };
+
+    struct CachedPolyline {
+        std::shared_ptr<const CIFPPolyline> polyline;   // nullptr: the procedure doesn't exist
+        uint64_t last_access;
+    };
+
+    std::shared_ptr<Logger> logger;
+    std::shared_ptr<EpochReclaimer> reclaimer;
+    std::shared_ptr<CIFPParser> cifp;
+    std::shared_ptr<XPData> xpdata;
+
+    std::atomic<bool> stop;
+    std::thread worker_thread;
+
+    std::mutex mx;
+    std::condition_variable cv;
+    std::deque<Request> queue;
+    std::unordered_set<std::string> pending;
+    std::unordered_map<std::string, CachedPolyline> cache;
+    uint64_t access_counter = 0;
+
+    void worker() noexcept;
+    std::shared_ptr<CIFPPolyline> compute(const Request &req, bool &not_found);
+    void evict_over_size() noexcept;    // mx must be held
+};
+
+} // namespace avionicsbay
+
+#endif // CIFP_GEOMETRY_H
@@ -0,0 +1,146 @@
+#include "cifp_index.hpp"
+
+#include "constants.hpp"
+
+namespace avionicsbay {
+
+// The fields of the CIFP files may be padded with spaces
+static std::string_view trim(std::string_view str) {
+    size_t begin = str.find_first_not_of(' ');
+    if (begin == std::string_view::npos) {
+        return std::string_view();
+    }
+    size_t end = str.find_last_not_of(' ');
+    return str.substr(begin, end - begin + 1);
+}
+
+static std::string_view make_view(const char* str, int len) {
+    return str != nullptr && len > 0 ? trim(std::string_view(str, len)) : std::string_view();
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static std::string make_key(xpdata_cifp_proc_type_t type, std::string_view first, std::string_view second = std::string_view()) {
+    std::string key = std::to_string(type);
+    key.append(1, ':').append(first);
+    if (!second.empty()) {
+        key.append(1, ':').append(second);
+    }
+    return key;
+}
+
+// Runway of a SID/STAR transition: RW34R -> 34R, RW16B -> 16B (all the parallel runways)
+static std::string_view rwy_of_transition(std::string_view trans_name) {
+    if (trans_name.size() < 4 || trans_name[0] != 'R' || trans_name[1] != 'W' || !is_digit(trans_name[2]) || !is_digit(trans_name[3])) {
+        return std::string_view();
+    }
+    return trans_name.substr(2);
+}
+
+// Runway of an approach from its name: I34R -> 34R, R16LZ -> 16L, L35-Y -> 35, VDM-A -> none
+static std::string_view rwy_of_approach(std::string_view proc_name) {
+    if (proc_name.size() < 3 || !is_digit(proc_name[1]) || !is_digit(proc_name[2])) {
+        return std::string_view();
+    }
+    bool has_side = proc_name.size() > 3 && (proc_name[3] == 'L' || proc_name[3] == 'R' || proc_name[3] == 'C');
+    return proc_name.substr(1, has_side ? 3 : 2);
+}
+
+void CIFPProcIndex::add_rwy(xpdata_cifp_proc_type_t type, std::string_view rwy_name, const xpdata_cifp_data_t* proc) {
+    by_rwy[make_key(type, rwy_name)].push_back(proc);
+}
+
+void CIFPProcIndex::build(const xpdata_cifp_t &cifp) {
+
+    // The runways of the airport, to expand the transitions valid from all the parallel runways
+    std::vector<std::string_view> rwys;
+    for (int i=0; i < cifp.rwys.len; i++) {
+        rwys.push_back(make_view(cifp.rwys.data[i].rwy_name, cifp.rwys.data[i].rwy_name_len));
+    }
+
+    const std::pair<xpdata_cifp_proc_type_t, const xpdata_cifp_array_t*> all_procs[] = {
+        {NAV_CIFP_PROC_SID, &cifp.sids}, {NAV_CIFP_PROC_STAR, &cifp.stars}, {NAV_CIFP_PROC_APPCH, &cifp.apprs}
+    };
+
+    for (const auto &procs : all_procs) {
+        const xpdata_cifp_proc_type_t type = procs.first;
+        for (int i=0; i < procs.second->len; i++) {
+            const xpdata_cifp_data_t* proc = &procs.second->data[i];
+            std::string_view proc_name  = make_view(proc->proc_name, proc->proc_name_len);
+            std::string_view trans_name = make_view(proc->trans_name, proc->trans_name_len);
+
+            by_name.emplace(make_key(type, proc_name, trans_name), proc);
+
+            if (type == NAV_CIFP_PROC_APPCH) {
+                if (!proc_name.empty()) {
+                    apprs_by_type[proc_name[0]].push_back(proc);
+                }
+                std::string_view rwy_name = rwy_of_approach(proc_name);
+                if (!rwy_name.empty()) {
+                    add_rwy(type, rwy_name, proc);
+                }
+                continue;
+            }
+
+            std::string_view rwy_name = rwy_of_transition(trans_name);
+            if (rwy_name.size() == 3 && rwy_name[2] == 'B') {
+                bool found = false;
+                for (auto rwy : rwys) {
+                    if (rwy.size() >= 2 && rwy.substr(0, 2) == rwy_name.substr(0, 2)) {
+                        add_rwy(type, rwy, proc);
+                        found = true;
+                    }
+                }
+                if (!found) {
+                    add_rwy(type, rwy_name.substr(0, 2), proc);
+                }
+            } else if (!rwy_name.empty()) {
+                add_rwy(type, rwy_name, proc);
+            }
+        }
+    }
+}
+
+const xpdata_cifp_data_t* CIFPProcIndex::find(xpdata_cifp_proc_type_t type, std::string_view proc_name, std::string_view trans_name) const noexcept {
+    auto it = by_name.find(make_key(type, trim(proc_name), trim(trans_name)));
+    return it != by_name.end() ? it->second : nullptr;
+}
+
+std::pair<const xpdata_cifp_data_t* const*, size_t> CIFPProcIndex::find_by_rwy(xpdata_cifp_proc_type_t type, std::string_view rwy_name) const noexcept {
+    rwy_name = trim(rwy_name);
+    if (rwy_name.size() > 2 && rwy_name[0] == 'R' && rwy_name[1] == 'W') {
+        rwy_name.remove_prefix(2);  // Both RW34R and 34R are accepted
+    }
+
+    auto it = by_rwy.find(make_key(type, rwy_name));
+    if (it == by_rwy.end()) {
+        return {nullptr, 0};
+    }
+    return {it->second.data(), it->second.size()};
+}
+
+std::pair<const xpdata_cifp_data_t* const*, size_t> CIFPProcIndex::find_apprs_by_type(char appr_type) const noexcept {
+    auto it = apprs_by_type.find(appr_type);
+    if (it == apprs_by_type.end()) {
+        return {nullptr, 0};
+    }
+    return {it->second.data(), it->second.size()};
+}
+
+size_t CIFPProcIndex::memory_usage() const noexcept {
+    // Approximation: buckets, nodes, keys and pointer vectors
+    size_t total = sizeof(CIFPProcIndex);
+    total += (by_name.bucket_count() + by_rwy.bucket_count() + apprs_by_type.bucket_count()) * sizeof(void*);
+    total += by_name.size() * (sizeof(decltype(by_name)::value_type) + sizeof(void*) + 16);
+    for (const auto &x : by_rwy) {
+        total += sizeof(x) + sizeof(void*) + x.second.capacity() * sizeof(void*);
+    }
+    for (const auto &x : apprs_by_type) {
+        total += sizeof(x) + sizeof(void*) + x.second.capacity() * sizeof(void*);
+    }
+    return total;
+}
+
+} // namespace avionicsbay
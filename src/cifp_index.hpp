@@ -0,0 +1,36 @@
+#ifndef CIFP_INDEX_H
+#define CIFP_INDEX_H
+
+#include "data_types.hpp"
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace avionicsbay {
+
+// Lookup indexes over the procedures of a single airport. The indexes contain only pointers to
+// the airport data, so they must live as long as the airport they have been built on.
+class CIFPProcIndex {
+public:
+    void build(const xpdata_cifp_t &cifp);
+
+    const xpdata_cifp_data_t* find(xpdata_cifp_proc_type_t type, std::string_view proc_name, std::string_view trans_name) const noexcept;
+    std::pair<const xpdata_cifp_data_t* const*, size_t> find_by_rwy(xpdata_cifp_proc_type_t type, std::string_view rwy_name) const noexcept;
+    std::pair<const xpdata_cifp_data_t* const*, size_t> find_apprs_by_type(char appr_type) const noexcept;
+
+    size_t memory_usage() const noexcept;
+
+private:
+    std::unordered_map<std::string, const xpdata_cifp_data_t*> by_name;              // key = type:proc:trans
+    std::unordered_map<std::string, std::vector<const xpdata_cifp_data_t*>> by_rwy;  // key = type:rwy (e.g. 0:34R)
+    std::unordered_map<char, std::vector<const xpdata_cifp_data_t*>> apprs_by_type;  // key = first letter of the name
+
+    void add_rwy(xpdata_cifp_proc_type_t type, std::string_view rwy_name, const xpdata_cifp_data_t* proc);
+};
+
+} // namespace avionicsbay
+
+#endif // CIFP_INDEX_H
@@ -4,15 +4,25 @@
 #include "data_types.hpp"
 #include "plugin.hpp"
 #include "utilities/filesystem.hpp"
+#include "utilities/work_stealing.hpp"
 
+#include <array>
 #include <cassert>
-#include <chrono>
-#include <list>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
 
 #define LOG *this->logger << STARTL
 
 #define CIFP_FILE_DIR  "Resources/default data/CIFP/"
 
+#define CIFP_LOADER_THREADS 2
+#define CIFP_DEFAULT_MEM_BUDGET (32*1024*1024)
+
+#define CIFP_DB_CACHE_DIR  "Output/caches/"
+#define CIFP_DB_CACHE_FILE "avionicsbay_cifp.db"
+
 constexpr int F_ROW_TYPE = 1;
 constexpr int F_NAME     = 2;
 constexpr int F_TRANS    = 3;
@@ -49,22 +59,39 @@ constexpr int RWY_HEIGHT = 3;
 constexpr int RWY_LOC = 5;
 constexpr int RWY_CAT = 6;
 
-static std::list<std::string> all_string_container;
-
 namespace avionicsbay {
 
-extern std::vector<std::string> str_explode(std::string const & s, char delim);
-
-CIFPParser::CIFPParser(const std::string &xplane_directory) : xplane_directory(xplane_directory) {
+CIFPParser::CIFPParser(const std::string &xplane_directory) : xplane_directory(xplane_directory), stop(false),
+                                                               memory_budget(CIFP_DEFAULT_MEM_BUDGET), bulk_loading(false) {
 
     this->logger = get_logger();
+    this->reclaimer = get_reclaimer();
     
-    assert(this->logger);
+    assert(this->logger && this->reclaimer);
 
     LOG << logger_level_t::DEBUG << "Initializing CIFP Parser..." << ENDL;
 
+    for (int i=0; i < CIFP_LOADER_THREADS; i++) {
+        this->workers.emplace_back(&CIFPParser::worker, this);
+    }
+
 }
 
+CIFPParser::~CIFPParser() {
+    {
+        std::lock_guard<std::mutex> lk(mx_queue);
+        this->stop = true;
+    }
+    cv_queue.notify_all();
+
+    for (auto &t : workers) {
+        t.join();
+    }
+
+    if (bulk_thread.joinable()) {
+        bulk_thread.join();
+    }
+}
 
 void CIFPParser::perform_init_checks() {
     if (!is_a_directory(xplane_directory)) {
@@ -78,52 +105,406 @@ void CIFPParser::perform_init_checks() {
 }
 
 void CIFPParser::load_airport(const std::string &arpt_id) {
-    this->ap_future = std::async(std::launch::async, &CIFPParser::task, this, arpt_id);
-}
-
-bool CIFPParser::is_ready() noexcept {
-    if (! this->ap_future.valid()) {
-        return true;  // If it's not valid, the thread has been never called or finished running
+    {
+        std::lock_guard<std::mutex> lk(mx_loaded);
+        if (loaded_apts.count(arpt_id) > 0) {
+            return; // Already loaded
+        }
+        if (database && database->has_airport(arpt_id.c_str())) {
+            return; // Already in the bulk database
+        }
     }
-    if (this->ap_future.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
-        // Loaded
-        this->ap_future.get();
-        return true;
+
+    {
+        std::lock_guard<std::mutex> lk(mx_queue);
+        if (!pending_apts.insert(arpt_id).second) {
+            return; // Already queued or in-flight
+        }
+        queue.push_back(arpt_id);
     }
-    return false;
+    cv_queue.notify_one();
 }
 
-void CIFPParser::task(const std::string &arpt_id) noexcept {
+bool CIFPParser::is_ready() noexcept {
+    std::lock_guard<std::mutex> lk(mx_queue);
+    return pending_apts.empty() && !bulk_loading;
+}
 
-    if (already_loaded_apts.find(arpt_id) != already_loaded_apts.end()) {
-        return;
-    }
+bool CIFPParser::is_ready(const std::string &arpt_id) noexcept {
+    std::lock_guard<std::mutex> lk(mx_loaded);
+    return loaded_apts.count(arpt_id) > 0 || (database && database->has_airport(arpt_id.c_str()));
+}
 
-    already_loaded_apts.insert(arpt_id);
+void CIFPParser::worker() noexcept {
 
 #if defined(__linux__)
     pthread_setname_np(pthread_self(), "CIFPParser");   // For debugging purposes
 #endif
 
+    while (true) {
+        std::string arpt_id;
+        {
+            std::unique_lock<std::mutex> lk(mx_queue);
+            cv_queue.wait(lk, [this] { return this->stop || !this->queue.empty(); });
+            if (this->stop) {
+                return;
+            }
+            arpt_id = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        // A worker may have published it between the check of load_airport() and the queueing
+        bool is_loaded;
+        {
+            std::lock_guard<std::mutex> lk(mx_loaded);
+            is_loaded = loaded_apts.count(arpt_id) > 0;
+        }
+        if (!is_loaded) {
+            task(arpt_id);
+        }
+
+        std::lock_guard<std::mutex> lk(mx_queue);
+        pending_apts.erase(arpt_id);
+    }
+}
+
+void CIFPParser::task(const std::string &arpt_id) noexcept {
+
+    auto apt = std::make_unique<CIFPAirport>();
+    int status = APT_DETAILS_STATUS_LOADED;
+
     try {
-        parse_cifp_file(arpt_id);
+        parse_cifp_file(arpt_id, *apt);
     } 
     catch(const std::ifstream::failure &e) {
         LOG << logger_level_t::ERROR << "[CIFPParser] I/O exception: " << e.what() << ENDL;
-        return;
+        apt = std::make_unique<CIFPAirport>();   // Do not publish partial data
+        status = APT_DETAILS_STATUS_FAILED;
     }
     catch(...) {
         LOG << logger_level_t::CRIT << "[CIFPParser] Unexpected exception." << ENDL;
-        return;
+        apt = std::make_unique<CIFPAirport>();   // Do not publish partial data
+        status = APT_DETAILS_STATUS_FAILED;
+    }
+
+    // Even on failure we publish the (empty) airport, otherwise the users would wait forever
+    publish(arpt_id, std::move(apt), status);
+}
+
+void CIFPParser::publish(const std::string &arpt_id, std::unique_ptr<CIFPAirport> apt, int status) noexcept {
+    {
+        std::lock_guard<std::mutex> lk(mx_loaded);
+        auto &loaded = loaded_apts[arpt_id];
+        if (loaded.apt) {
+            // Loaded twice: the user plugin may still read the previous instance
+            memory_used -= loaded.apt->memory_usage;
+            reclaimer->retire(std::move(loaded.apt));
+        }
+        memory_used += apt->memory_usage;
+        loaded = { std::move(apt), ++access_counter, reclaimer->get_epoch() };
+        evict_over_budget();
+    }
+    push_loaded_event(arpt_id, status);
+}
+
+void CIFPParser::push_loaded_event(const std::string &arpt_id, int status) noexcept {
+    xpdata_event_t event = {EVENT_CIFP_LOADED, status, nullptr, ""};
+    arpt_id.copy(event.apt_id, sizeof(event.apt_id) - 1);
+
+    auto xpdata = get_xpdata();
+    if (!arpt_id.empty() && xpdata && xpdata->get_is_ready()) {
+        auto apts = xpdata->get_apts_by_name(arpt_id);
+        for (size_t i=0; i < apts.second; i++) {
+            if (arpt_id.compare(0, std::string::npos, apts.first[i]->id, apts.first[i]->id_len) == 0) {
+                event.apt = apts.first[i];
+                break;
+            }
+        }
+    }
+    push_event(event);
+}
+
+void CIFPParser::set_memory_budget(size_t bytes) noexcept {
+    std::lock_guard<std::mutex> lk(mx_loaded);
+    memory_budget = bytes;
+    evict_over_budget();
+}
+
+void CIFPParser::set_pinned(const std::string &arpt_id, bool pinned) noexcept {
+    std::lock_guard<std::mutex> lk(mx_loaded);
+    if (pinned) {
+        pinned_apts.insert(arpt_id);
+    } else {
+        pinned_apts.erase(arpt_id);
+        evict_over_budget();
     }
+}
+
+void CIFPParser::evict_over_budget() noexcept {
+    const uint64_t curr_epoch = reclaimer->get_epoch();
+
+    while (memory_used > memory_budget) {
+        auto lru_it = loaded_apts.end();
+        for (auto it = loaded_apts.begin(); it != loaded_apts.end(); ++it) {
+            if (it->second.last_access_epoch == curr_epoch || pinned_apts.count(it->first) > 0) {
+                continue;
+            }
+            if (lru_it == loaded_apts.end() || it->second.last_access < lru_it->second.last_access) {
+                lru_it = it;
+            }
+        }
 
+        if (lru_it == loaded_apts.end()) {
+            return; // Nothing can be evicted now
+        }
+
+        LOG << logger_level_t::DEBUG << "[CIFPParser] Evicting " << lru_it->first << " (" << lru_it->second.apt->memory_usage << " bytes)" << ENDL;
+
+        // Readers may still hold pointers into this airport: the reclaimer releases it later
+        memory_used -= lru_it->second.apt->memory_usage;
+        reclaimer->retire(std::move(lru_it->second.apt));
+        loaded_apts.erase(lru_it);
+    }
+}
+
+//**************************************************************************************************
+// Bulk mode
+//**************************************************************************************************
+
+void CIFPParser::load_all_airports() noexcept {
+    {
+        std::lock_guard<std::mutex> lk(mx_loaded);
+        if (bulk_loading || database) {
+            return; // Already loading or loaded
+        }
+        if (bulk_thread.joinable()) {
+            // A previous build failed or was stopped: the thread is at most pushing its event,
+            // it doesn't take mx_loaded anymore after clearing bulk_loading
+            bulk_thread.join();
+        }
+        bulk_loading = true;
+        bulk_thread = std::thread(&CIFPParser::bulk_task, this);
+    }
+}
+
+uint64_t CIFPParser::compute_cifp_fingerprint(const std::vector<std::string> &files) const noexcept {
+    // FNV-1a of the name, size and modification time of all the files
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](const void* data, size_t len) {
+        for (size_t i=0; i < len; i++) {
+            hash = (hash ^ static_cast<const unsigned char*>(data)[i]) * 1099511628211ull;
+        }
+    };
+
+    add(&CIFP_DB_VERSION, sizeof(CIFP_DB_VERSION));
+    for (const auto &name : files) {
+        long long size = 0, mtime = 0;
+        get_file_info(xplane_directory + '/' + CIFP_FILE_DIR + name, size, mtime);
+        add(name.c_str(), name.size()+1);
+        add(&size, sizeof(size));
+        add(&mtime, sizeof(mtime));
+    }
+    return hash;
+}
+
+void CIFPParser::bulk_task() noexcept {
+
+#if defined(__linux__)
+    pthread_setname_np(pthread_self(), "CIFPBulk");   // For debugging purposes
+#endif
+
+    std::vector<std::string> files;
+    for (auto &name : list_directory(xplane_directory + '/' + CIFP_FILE_DIR)) {
+        if (name.size() > 4 && name.compare(name.size()-4, 4, ".dat") == 0) {
+            files.push_back(std::move(name));
+        }
+    }
+    std::sort(files.begin(), files.end());
+
+    const uint64_t fingerprint = compute_cifp_fingerprint(files);
+    const std::string cache_dir  = xplane_directory + '/' + CIFP_DB_CACHE_DIR;
+    const std::string cache_file = cache_dir + CIFP_DB_CACHE_FILE;
+
+    auto db = std::make_shared<CIFPDatabase>();
+    bool ok = is_a_directory(cache_dir) && db->open_file(cache_file, fingerprint);
+
+    if (ok) {
+        LOG << logger_level_t::INFO << "[CIFPParser] Using the cached CIFP database " << cache_file << ENDL;
+    } else {
+        LOG << logger_level_t::INFO << "[CIFPParser] Building the CIFP database from " << files.size() << " files..." << ENDL;
+
+        CIFPDatabaseBuilder builder;
+        unsigned int nr_threads = std::max(2u, std::thread::hardware_concurrency()) - 1;  // 0 if unknown
+        parallel_for_stealing(files.size(), nr_threads, [this, &files, &builder](size_t i) {
+            if (this->stop) {
+                return;
+            }
+            const std::string arpt_id = files[i].substr(0, files[i].size()-4);
+            CIFPAirport apt;
+            try {
+                parse_cifp_file(arpt_id, apt, false);
+                builder.add_airport(arpt_id, apt);
+            } catch(...) {
+                LOG << logger_level_t::ERROR << "[CIFPParser] Bulk: unable to load " << arpt_id << ENDL;
+            }
+        });
+
+        if (this->stop) {
+            bulk_loading = false;
+            return;
+        }
+
+        if (is_a_directory(cache_dir)) {
+            const std::string tmp_file = cache_file + ".tmp";
+            {
+                std::ofstream ofs(tmp_file, std::ios::binary | std::ios::trunc);
+                builder.write(ofs, fingerprint);
+                ok = ofs.good();
+            }
+            std::remove(cache_file.c_str());
+            ok = ok && std::rename(tmp_file.c_str(), cache_file.c_str()) == 0;
+            ok = ok && db->open_file(cache_file, fingerprint);
+        }
+
+        if (!ok) {
+            LOG << logger_level_t::WARN << "[CIFPParser] Unable to cache the CIFP database, keeping it in memory." << ENDL;
+            std::ostringstream oss;
+            builder.write(oss, fingerprint);
+            ok = db->open_buffer(oss.str(), fingerprint);
+        }
+    }
+
+    if (ok) {
+        LOG << logger_level_t::INFO << "[CIFPParser] CIFP database ready: " << db->get_nr_airports() << " airports." << ENDL;
+        std::lock_guard<std::mutex> lk(mx_loaded);
+        database = std::move(db);
+    } else {
+        LOG << logger_level_t::ERROR << "[CIFPParser] Unable to build the CIFP database." << ENDL;
+    }
+
+    bulk_loading = false;
+
+    push_loaded_event("", ok ? APT_DETAILS_STATUS_LOADED : APT_DETAILS_STATUS_FAILED);   // All the airports
+}
+
+//**************************************************************************************************
+// Line decoding
+//**************************************************************************************************
+
+enum cifp_record_t : uint8_t {
+    CIFP_REC_UNKNOWN = 0,
+    CIFP_REC_SID,
+    CIFP_REC_STAR,
+    CIFP_REC_APPCH,
+    CIFP_REC_PRDAT,
+    CIFP_REC_RWY
+};
+
+struct cifp_two_chars_t {
+    char code[3];
+    uint8_t value;
+};
+
+// Table indexed by a two uppercase letters code, 0 means invalid code
+using two_chars_table_t = std::array<uint8_t, 26*26>;
+
+constexpr int two_chars_index(char a, char b) {
+    return (a - 'A') * 26 + (b - 'A');
+}
+
+template<size_t N>
+constexpr two_chars_table_t make_two_chars_table(const cifp_two_chars_t (&codes)[N]) {
+    two_chars_table_t table{};
+    for (size_t i=0; i < N; i++) {
+        table[two_chars_index(codes[i].code[0], codes[i].code[1])] = codes[i].value;
+    }
+    return table;
+}
+
+constexpr cifp_two_chars_t LEG_TYPES[] = {
+    {"IF", NAV_CIFP_TYPE_IF}, {"TF", NAV_CIFP_TYPE_TF}, {"CF", NAV_CIFP_TYPE_CF}, {"DF", NAV_CIFP_TYPE_DF},
+    {"FA", NAV_CIFP_TYPE_FA}, {"FC", NAV_CIFP_TYPE_FC}, {"FD", NAV_CIFP_TYPE_FD}, {"FM", NAV_CIFP_TYPE_FM},
+    {"CA", NAV_CIFP_TYPE_CA}, {"CD", NAV_CIFP_TYPE_CD}, {"CI", NAV_CIFP_TYPE_CI}, {"CR", NAV_CIFP_TYPE_CR},
+    {"RF", NAV_CIFP_TYPE_RF}, {"AF", NAV_CIFP_TYPE_AF}, {"VA", NAV_CIFP_TYPE_VA}, {"VD", NAV_CIFP_TYPE_VD},
+    {"VI", NAV_CIFP_TYPE_VI}, {"VM", NAV_CIFP_TYPE_VM}, {"VR", NAV_CIFP_TYPE_VR}, {"PI", NAV_CIFP_TYPE_PI},
+    {"HA", NAV_CIFP_TYPE_HA}, {"HF", NAV_CIFP_TYPE_HF}, {"HM", NAV_CIFP_TYPE_HM}
+};
+
+// The record type is identified by the first two letters, then the full prefix is checked
+constexpr cifp_two_chars_t RECORD_TYPES[] = {
+    {"SI", CIFP_REC_SID}, {"ST", CIFP_REC_STAR}, {"AP", CIFP_REC_APPCH}, {"PR", CIFP_REC_PRDAT}, {"RW", CIFP_REC_RWY}
+};
+
+constexpr std::string_view RECORD_PREFIXES[] = { "", "SID:", "STAR:", "APPCH:", "PRDAT:", "RWY:" };
+constexpr size_t RECORD_ID_OFFSET[] = { 0, 4, 5, 6, 6, 6 };    // RWY: the id skips the "RW" too
+
+constexpr two_chars_table_t LEG_TYPES_TABLE    = make_two_chars_table(LEG_TYPES);
+constexpr two_chars_table_t RECORD_TYPES_TABLE = make_two_chars_table(RECORD_TYPES);
+
+static_assert(LEG_TYPES_TABLE[two_chars_index('H', 'M')] == NAV_CIFP_TYPE_HM, "Invalid leg types table");
+static_assert(RECORD_TYPES_TABLE[two_chars_index('R', 'W')] == CIFP_REC_RWY, "Invalid record types table");
+
+static inline uint8_t lookup_two_chars(const two_chars_table_t &table, std::string_view str) {
+    if (str.size() < 2 || str[0] < 'A' || str[0] > 'Z' || str[1] < 'A' || str[1] > 'Z') {
+        return 0;
+    }
+    return table[two_chars_index(str[0], str[1])];
+}
+
+// Splits the line on commas in a single pass, skipping the empty fields (as str_explode does)
+static void decode_line(std::string_view line, CIFPFields &fields) {
+    fields.size = 0;
+    size_t begin = 0;
+    while (begin <= line.size() && fields.size < CIFPFields::MAX_FIELDS) {
+        size_t end = line.find(',', begin);
+        if (end == std::string_view::npos) {
+            end = line.size();
+        }
+        if (end > begin) {
+            fields.fields[fields.size++] = line.substr(begin, end - begin);
+        }
+        begin = end + 1;
+    }
+}
+
+// Same semantic of std::stoi: leading whitespaces and sign allowed, false if no digits or out of range
+static bool parse_int(std::string_view str, int &value) {
+    size_t i = 0;
+    while (i < str.size() && (str[i] == ' ' || (str[i] >= '\t' && str[i] <= '\r'))) {
+        i++;
+    }
+
+    bool negative = false;
+    if (i < str.size() && (str[i] == '+' || str[i] == '-')) {
+        negative = str[i] == '-';
+        i++;
+    }
+
+    const size_t first_digit = i;
+    int64_t result = 0;
+    for (; i < str.size() && str[i] >= '0' && str[i] <= '9'; i++) {
+        result = result * 10 + (str[i] - '0');
+        if (result > static_cast<int64_t>(INT32_MAX) + 1) {
+            return false;   // Out of range
+        }
+    }
+    if (i == first_digit) {
+        return false;   // No digits
+    }
+
+    result = negative ? -result : result;
+    if (result > INT32_MAX) {
+        return false;
+    }
+    value = static_cast<int>(result);
+    return true;
 }
 
 //**************************************************************************************************
 // Single Field Parsing
 //**************************************************************************************************
 
-char compute_turn(const std::string &turn, const std::string &tdv) {
+char compute_turn(std::string_view turn, std::string_view tdv) {
     if(turn.size() != 1 || tdv.size() != 1) {
         throw std::runtime_error("Invalid Turn/TDV.");
     }
@@ -141,7 +522,7 @@ char compute_turn(const std::string &turn, const std::string &tdv) {
 
 }
 
-uint8_t compute_spd_type(const std::string &spd_type) {
+uint8_t compute_spd_type(std::string_view spd_type) {
     if(spd_type.size() != 1) {
         throw std::runtime_error("Invalid SPD TYPE.");
     }
@@ -159,81 +540,25 @@ uint8_t compute_spd_type(const std::string &spd_type) {
     return NAV_CIFP_CSTR_SPD_NONE;
 }
 
-uint8_t get_leg_type(const std::string &leg_type) {
-    if (leg_type == "IF") {
-        return NAV_CIFP_TYPE_IF;
-    } else if (leg_type == "TF") {
-        return NAV_CIFP_TYPE_TF;
-    } else if (leg_type == "CF") {
-        return NAV_CIFP_TYPE_CF;
-    } else if (leg_type == "DF") {
-        return NAV_CIFP_TYPE_DF;
-    } else if (leg_type == "FA") {
-        return NAV_CIFP_TYPE_FA;
-    } else if (leg_type == "FC") {
-        return NAV_CIFP_TYPE_FC;
-    } else if (leg_type == "FD") {
-        return NAV_CIFP_TYPE_FD;
-    } else if (leg_type == "FM") {
-        return NAV_CIFP_TYPE_FM;
-    } else if (leg_type == "CA") {
-        return NAV_CIFP_TYPE_CA;
-    } else if (leg_type == "CD") {
-        return NAV_CIFP_TYPE_CD;
-    } else if (leg_type == "CI") {
-        return NAV_CIFP_TYPE_CI;
-    } else if (leg_type == "CR") {
-        return NAV_CIFP_TYPE_CR;
-    } else if (leg_type == "RF") {
-        return NAV_CIFP_TYPE_RF;
-    } else if (leg_type == "AF") {
-        return NAV_CIFP_TYPE_AF;
-    } else if (leg_type == "VA") {
-        return NAV_CIFP_TYPE_VA;
-    } else if (leg_type == "VD") {
-        return NAV_CIFP_TYPE_VD;
-    } else if (leg_type == "VI") {
-        return NAV_CIFP_TYPE_VI;
-    } else if (leg_type == "VM") {
-        return NAV_CIFP_TYPE_VM;
-    } else if (leg_type == "VR") {
-        return NAV_CIFP_TYPE_VR;
-    } else if (leg_type == "PI") {
-        return NAV_CIFP_TYPE_PI;
-    } else if (leg_type == "HA") {
-        return NAV_CIFP_TYPE_HA;
-    } else if (leg_type == "HF") {
-        return NAV_CIFP_TYPE_HF;
-    } else if (leg_type == "HM") {
-        return NAV_CIFP_TYPE_HM;
-    } else {
+uint8_t get_leg_type(std::string_view leg_type) {
+    uint8_t type = leg_type.size() == 2 ? lookup_two_chars(LEG_TYPES_TABLE, leg_type) : 0;
+    if (type == 0) {
         throw std::runtime_error("Invalid Leg type.");
     }
+    return type;
 }
 
-int safe_stoi(const std::string &str) {
-    try {
-        return std::stoi(str);
-    } catch(...) {
-        return 0;
-    }
+int safe_stoi(std::string_view str) {
+    int value;
+    return parse_int(str, value) ? value : 0;
 }
 
-int safe_alt(const std::string &str, bool &is_fl) {
-    is_fl = false;
-    std::string copy_str = str;
-    if (str[0] == 'F' && str[1] == 'L') {
-        is_fl = true;
-        copy_str = str.substr(2);
-    }
-    try {
-        return std::stoi(copy_str);
-    } catch(...) {
-        return 0;
-    }
+int safe_alt(std::string_view str, bool &is_fl) {
+    is_fl = str.size() >= 2 && str[0] == 'F' && str[1] == 'L';
+    return safe_stoi(is_fl ? str.substr(2) : str);
 }
 
-uint8_t compute_alt_type(const std::string &alt_type, const std::string &alt_val) {
+uint8_t compute_alt_type(std::string_view alt_type, std::string_view alt_val) {
     if(alt_type.size() != 1) {
         throw std::runtime_error("Invalid ALT Type.");
     }
@@ -250,7 +575,7 @@ uint8_t compute_alt_type(const std::string &alt_type, const std::string &alt_val
         case ' ':
             // The " " represents the "AT" constraints only if we have a value in
             // the first altitude, otherwise is a "NO CONSTRAINT" case
-            if(alt_val.find_first_not_of(' ') != std::string::npos)
+            if(alt_val.find_first_not_of(' ') != std::string_view::npos)
                 return NAV_CIFP_CSTR_ALT_AT;
             else
                 return NAV_CIFP_CSTR_ALT_NONE;
@@ -272,55 +597,84 @@ uint8_t compute_alt_type(const std::string &alt_type, const std::string &alt_val
 //**************************************************************************************************
 // Parsing
 //**************************************************************************************************
-void CIFPParser::parse_cifp_file(const std::string &arpt_id) {
+void CIFPParser::parse_cifp_file(const std::string &arpt_id, CIFPAirport &apt, bool verbose) {
     std::ifstream ifs;
     ifs.exceptions(std::ifstream::badbit);
     
     std::string filename = xplane_directory + '/' + CIFP_FILE_DIR + '/' + arpt_id + ".dat";
-    LOG << logger_level_t::INFO << "[CIFPParser] Trying to open " << filename << "..." << ENDL;
-    ifs.open(filename, std::ifstream::in);
-    
-    std::string line;
+    if (verbose) {
+        LOG << logger_level_t::INFO << "[CIFPParser] Trying to open " << filename << "..." << ENDL;
+    }
+    ifs.open(filename, std::ifstream::in | std::ifstream::binary);
+
+    // The files are small: read everything and decode the lines in place
+    std::string content;
+    if (ifs.is_open()) {
+        std::ostringstream oss;
+        oss << ifs.rdbuf();
+        content = oss.str();
+    }
+    ifs.close();
+
+    std::string_view remaining(content);
+    CIFPFields fields;
     int line_no = 0;
-    while (!ifs.eof() && std::getline(ifs, line)) {
+    while (!remaining.empty() && !this->stop) {
+        size_t eol = remaining.find('\n');
+        std::string_view line = remaining.substr(0, eol);
+        remaining = eol == std::string_view::npos ? std::string_view() : remaining.substr(eol + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);  // CRLF files
+        }
+
         if (line.size() > 0) {
-            parse_cifp_file_line(arpt_id, line_no, line);
+            decode_line(line, fields);
+            parse_cifp_file_line(apt, line_no, fields);
         }
         line_no++;
     }
 
-    ifs.close();
-    LOG << logger_level_t::INFO << "[CIFPParser] Total lines read from " << filename << ": " << line_no << ENDL;
+    if (verbose) {
+        LOG << logger_level_t::INFO << "[CIFPParser] Total lines read from " << filename << ": " << line_no << ENDL;
+    }
     
-    finalize_structures();
+    finalize_structures(apt);
     
 }
 
-void CIFPParser::parse_cifp_file_line(const std::string &arpt_id, int line_no, const std::string &line) {
-    auto splitted = str_explode(line, ',');
-    if (splitted.size() < 1) {
+void CIFPParser::parse_cifp_file_line(CIFPAirport &apt, int line_no, const CIFPFields &splitted) {
+    if (splitted.size < 1) {
         return;     // Empty line
     }
     
     try {
-        if (splitted[0].rfind("SID:", 0) == 0) {
-            int id = std::stoi(splitted[0].substr(4));
-            this->parse_sid(arpt_id, id, splitted);
-        }
-        else if (splitted[0].rfind("STAR:", 0) == 0) {
-            int id = std::stoi(splitted[0].substr(5));
-            this->parse_star(arpt_id, id, splitted);
-        }
-        else if (splitted[0].rfind("APPCH:", 0) == 0) {
-            int id = std::stoi(splitted[0].substr(6));
-            this->parse_appch(arpt_id, id, splitted);
+        std::string_view record = splitted[0];
+        uint8_t rec_type = lookup_two_chars(RECORD_TYPES_TABLE, record);
+        if (rec_type == CIFP_REC_UNKNOWN || record.substr(0, RECORD_PREFIXES[rec_type].size()) != RECORD_PREFIXES[rec_type]) {
+            return; // Not supported
         }
-        else if (splitted[0].rfind("PRDAT:", 0) == 0) {
+        if (rec_type == CIFP_REC_PRDAT) {
             return; // Currently not implemented
         }
-        else if (splitted[0].rfind("RWY:", 0) == 0) {
-            int id = std::stoi(splitted[0].substr(6));
-            this->parse_rwy(splitted[0].substr(6), id, splitted);
+
+        int id;
+        if (record.size() < RECORD_ID_OFFSET[rec_type] || !parse_int(record.substr(RECORD_ID_OFFSET[rec_type]), id)) {
+            throw std::runtime_error("Invalid record id.");
+        }
+
+        switch (rec_type) {
+            case CIFP_REC_SID:
+                this->parse_sid(apt, id, splitted);
+                break;
+            case CIFP_REC_STAR:
+                this->parse_star(apt, id, splitted);
+                break;
+            case CIFP_REC_APPCH:
+                this->parse_appch(apt, id, splitted);
+                break;
+            case CIFP_REC_RWY:
+                this->parse_rwy(apt, record.substr(RECORD_ID_OFFSET[rec_type]), id, splitted);
+                break;
         }
     } catch(const std::runtime_error &err) {
         LOG << logger_level_t::ERROR << "[CIFPParser] Line " << line_no << " error: " << err.what() << ENDL;
@@ -329,36 +683,50 @@ void CIFPParser::parse_cifp_file_line(const std::string &arpt_id, int line_no, c
     }
 }
 
-int CIFPParser::create_new_cifp_data(std::unordered_map<std::string, std::vector<xpdata_cifp_data_t>> &vec_ref, const std::string &arpt_id, const std::vector<std::string> &splitted) {
+static const char* store_string(CIFPAirport &apt, std::string_view str, int &len) {
+    len = str.size();
+    return apt.arena.copy_string(str.data(), str.size());
+}
+
+template<typename K, typename V>
+static size_t map_memory_usage(const std::unordered_map<K, V> &map) {
+    // Approximation: one bucket pointer + one node (value and next pointer) per element
+    return map.bucket_count() * sizeof(void*) + map.size() * (sizeof(typename std::unordered_map<K, V>::value_type) + sizeof(void*));
+}
+
+static size_t compute_memory_usage(const CIFPAirport &apt) {
+    size_t total = sizeof(CIFPAirport) + apt.arena.bytes_reserved();
+
+    total += (apt.sids.capacity() + apt.stars.capacity() + apt.apps.capacity()) * sizeof(xpdata_cifp_data_t);
+    total += apt.rwys.capacity() * sizeof(xpdata_cifp_rwy_data_t);
+
+    total += apt.legs.capacity() * sizeof(xpdata_cifp_leg_t);
+
+    total += map_memory_usage(apt.sids_idx) + map_memory_usage(apt.stars_idx) + map_memory_usage(apt.apps_idx);
+    total += map_memory_usage(apt.rwys_idx);
+    total += apt.index.memory_usage();
+
+    return total;
+}
+
+int CIFPParser::create_new_cifp_data(CIFPAirport &apt, std::vector<xpdata_cifp_data_t> &procs, const CIFPFields &splitted) {
     xpdata_cifp_data_t new_proc;
     
     new_proc.type = splitted[F_ROW_TYPE][0];
     
-    all_string_container.push_back(splitted[F_NAME]);
-    new_proc.proc_name = all_string_container.back().c_str();
-    new_proc.proc_name_len = all_string_container.back().size();
-
-    all_string_container.push_back(splitted[F_TRANS]);
-    new_proc.trans_name = all_string_container.back().c_str();
-    new_proc.trans_name_len = all_string_container.back().size();
+    new_proc.proc_name  = store_string(apt, splitted[F_NAME], new_proc.proc_name_len);
+    new_proc.trans_name = store_string(apt, splitted[F_TRANS], new_proc.trans_name_len);
 
-    legs_array[legs_array_progressive] = {};
-    new_proc._legs_arr_ref = legs_array_progressive++;
+    new_proc._legs_arr_ref = apt.nr_procs++;    // Procedure id until finalize_structures()
 
-    try {
-        new_proc.transition_altitude = std::stoi(splitted[F_LEG_TRANS_ALT]);
-    } catch(const std::invalid_argument &) {
-        new_proc.transition_altitude = 0;
-    }
-    vec_ref[arpt_id].push_back(new_proc);
-    return vec_ref[arpt_id].size()-1;
+    new_proc.transition_altitude = safe_stoi(splitted[F_LEG_TRANS_ALT]);
+    procs.push_back(new_proc);
+    return procs.size()-1;
 }
 
-void CIFPParser::parse_leg(xpdata_cifp_leg_t &new_leg, const std::vector<std::string> &splitted) {
+void CIFPParser::parse_leg(CIFPAirport &apt, xpdata_cifp_leg_t &new_leg, const CIFPFields &splitted) {
     
-    all_string_container.push_back(splitted[F_LEG_NAME]);
-    new_leg.leg_name     = all_string_container.back().c_str();
-    new_leg.leg_name_len = all_string_container.back().size();
+    new_leg.leg_name = store_string(apt, splitted[F_LEG_NAME], new_leg.leg_name_len);
 
     if (splitted[F_LEG_NAME+1].size() == 2) {
         new_leg.region_code_leg_name[0] = splitted[F_LEG_NAME+1][0];
@@ -373,10 +741,12 @@ void CIFPParser::parse_leg(xpdata_cifp_leg_t &new_leg, const std::vector<std::st
     new_leg.radius   = safe_stoi(splitted[F_LEG_RADIUS]);
     new_leg.theta    = safe_stoi(splitted[F_LEG_THETA]);
     new_leg.rho      = safe_stoi(splitted[F_LEG_RHO]);
-    new_leg.outb_mag_in_true = splitted[F_LEG_OB_MAG][splitted[F_LEG_OB_MAG].size()-1] == 'T';
-    new_leg.outb_mag = safe_stoi(new_leg.outb_mag_in_true ? splitted[F_LEG_OB_MAG].substr(0,splitted[F_LEG_OB_MAG].size()-1) : splitted[F_LEG_OB_MAG]);
-    new_leg.rte_hold_in_time = splitted[F_LEG_RTE_HOLD][0] == 'T';
-    new_leg.rte_hold = safe_stoi(new_leg.rte_hold_in_time ? splitted[F_LEG_RTE_HOLD].substr(1) : splitted[F_LEG_RTE_HOLD]);
+    std::string_view outb_mag = splitted[F_LEG_OB_MAG];
+    new_leg.outb_mag_in_true = !outb_mag.empty() && outb_mag.back() == 'T';
+    new_leg.outb_mag = safe_stoi(new_leg.outb_mag_in_true ? outb_mag.substr(0, outb_mag.size()-1) : outb_mag);
+    std::string_view rte_hold = splitted[F_LEG_RTE_HOLD];
+    new_leg.rte_hold_in_time = !rte_hold.empty() && rte_hold[0] == 'T';
+    new_leg.rte_hold = safe_stoi(new_leg.rte_hold_in_time ? rte_hold.substr(1) : rte_hold);
     
     new_leg.cstr_alt_type  = compute_alt_type(splitted[F_LEG_ALT_TYPE], splitted[F_LEG_ALT1]);
     new_leg.cstr_altitude1 = safe_alt(splitted[F_LEG_ALT1], new_leg.cstr_altitude1_fl);
@@ -387,9 +757,7 @@ void CIFPParser::parse_leg(xpdata_cifp_leg_t &new_leg, const std::vector<std::st
     
     new_leg.vpath_angle = -safe_stoi(splitted[F_LEG_ANGLE]);
 
-    all_string_container.push_back(splitted[F_LEG_CTR_FIX]);
-    new_leg.center_fix     = all_string_container.back().c_str();
-    new_leg.center_fix_len = all_string_container.back().size();
+    new_leg.center_fix = store_string(apt, splitted[F_LEG_CTR_FIX], new_leg.center_fix_len);
     if (splitted[F_LEG_CTR_FIX+1].size() == 2) {
         new_leg.region_code_ctr_fix[0] = splitted[F_LEG_CTR_FIX+1][0];
         new_leg.region_code_ctr_fix[1] = splitted[F_LEG_CTR_FIX+1][1];
@@ -397,9 +765,7 @@ void CIFPParser::parse_leg(xpdata_cifp_leg_t &new_leg, const std::vector<std::st
         new_leg.region_code_ctr_fix[0] = new_leg.region_code_ctr_fix[1] = 0;
     }
 
-    all_string_container.push_back(splitted[F_LEG_RECC_NAVAID]);
-    new_leg.recomm_navaid     = all_string_container.back().c_str();
-    new_leg.recomm_navaid_len = all_string_container.back().size();
+    new_leg.recomm_navaid = store_string(apt, splitted[F_LEG_RECC_NAVAID], new_leg.recomm_navaid_len);
     if (splitted[F_LEG_RECC_NAVAID+1].size() == 2) {
         new_leg.region_code_rec_navaid[0] = splitted[F_LEG_RECC_NAVAID+1][0];
         new_leg.region_code_rec_navaid[1] = splitted[F_LEG_RECC_NAVAID+1][1];
@@ -413,7 +779,7 @@ void CIFPParser::parse_leg(xpdata_cifp_leg_t &new_leg, const std::vector<std::st
     new_leg.holding_fix  = false;
     new_leg.first_missed_app = false;
     
-    const std::string &flags = splitted[F_LEG_FLAGS];
+    std::string_view flags = splitted[F_LEG_FLAGS];
     if(flags.size() >=2) {
         if (flags[1] == 'B' || flags[1] == 'Y') {
             new_leg.fly_over_wpt = true;
@@ -443,175 +809,210 @@ void CIFPParser::parse_leg(xpdata_cifp_leg_t &new_leg, const std::vector<std::st
     }
 }
 
-void CIFPParser::parse_sid(const std::string &arpt_id, int id, const std::vector<std::string> &splitted) {
-    if (splitted.size() < F_LEG_CTR_FIX+1) {
+void CIFPParser::parse_proc_leg(CIFPAirport &apt, std::vector<xpdata_cifp_data_t> &procs, std::unordered_map<std::string, int> &procs_idx, const CIFPFields &splitted) {
+    if (splitted.size < F_LEG_CTR_FIX+1) {
         return;     // Error line
     }
 
-    auto index_str = arpt_id + ":" + splitted[F_NAME] + ":" + splitted[F_TRANS];  // For internal use only
+    std::string index_str;  // For internal use only
+    index_str.reserve(splitted[F_NAME].size() + splitted[F_TRANS].size() + 1);
+    index_str.append(splitted[F_NAME]).append(1, ':').append(splitted[F_TRANS]);
 
     int index;
-    if (data_sid_idx.find(index_str) == data_sid_idx.end()) {
+    auto idx_it = procs_idx.find(index_str);
+    if (idx_it == procs_idx.end()) {
         // Not yet seen
-        index = create_new_cifp_data(data_sid, arpt_id, splitted);
-        data_sid_idx[index_str] = index;
+        index = create_new_cifp_data(apt, procs, splitted);
+        procs_idx[index_str] = index;
     } else {
-        index = data_sid_idx.at(index_str);
+        index = idx_it->second;
     }
 
-    int leg_array_id = data_sid.at(arpt_id).at(index)._legs_arr_ref;
-    
     xpdata_cifp_leg_t new_leg;
 
-    parse_leg(new_leg, splitted);
+    parse_leg(apt, new_leg, splitted);
+
+    apt.legs.push_back(std::move(new_leg));
+    apt.legs_owner.push_back(procs.at(index)._legs_arr_ref);
+}
+
+void CIFPParser::parse_sid(CIFPAirport &apt, int id, const CIFPFields &splitted) {
+    parse_proc_leg(apt, apt.sids, apt.sids_idx, splitted);
+}
 
-    legs_array[leg_array_id].push_back(std::move(new_leg));
+void CIFPParser::parse_star(CIFPAirport &apt, int id, const CIFPFields &splitted) {
+    parse_proc_leg(apt, apt.stars, apt.stars_idx, splitted);
 }
 
-void CIFPParser::parse_star(const std::string &arpt_id, int id, const std::vector<std::string> &splitted) {
+void CIFPParser::parse_appch(CIFPAirport &apt, int id, const CIFPFields &splitted) {
+    parse_proc_leg(apt, apt.apps, apt.apps_idx, splitted);
+}
 
-    if (splitted.size() < F_LEG_CTR_FIX+1) {
+void CIFPParser::parse_rwy(CIFPAirport &apt, std::string_view rwy_id, int id, const CIFPFields &splitted) {
+    if (splitted.size < 9) {
         return;     // Error line
     }
 
+    xpdata_cifp_rwy_data_t rwy;
 
-    auto index_str = arpt_id + ":" + splitted[F_NAME] + ":" + splitted[F_TRANS];  // For internal use only
-
+    rwy.rwy_name = store_string(apt, rwy_id, rwy.rwy_name_len);
 
-    int index;
-    if (data_star_idx.find(index_str) == data_star_idx.end()) {
-        // Not yet seen
-        index = create_new_cifp_data(data_star, arpt_id, splitted);
-        data_star_idx[index_str] = index;
-    } else {
-        index = data_star_idx.at(index_str);
+    if (!parse_int(splitted[RWY_HEIGHT], rwy.ldg_threshold_alt)) {
+        throw std::runtime_error("Invalid RWY threshold height.");
     }
 
-    int leg_array_id = data_star.at(arpt_id).at(index)._legs_arr_ref;
-    
-    xpdata_cifp_leg_t new_leg;
-
-    parse_leg(new_leg, splitted);
+    rwy.loc_ident = store_string(apt, splitted[RWY_LOC], rwy.loc_ident_len);
 
-    legs_array[leg_array_id].push_back(std::move(new_leg));
+    rwy.ils_category = splitted[RWY_CAT].size() > 0 ? splitted[RWY_CAT][0] : ' ';
 
+    apt.rwys_idx.emplace(std::string(rwy_id), apt.rwys.size());   // The first record wins
+    apt.rwys.push_back(std::move(rwy));
 }
 
-void CIFPParser::parse_appch(const std::string &arpt_id, int id, const std::vector<std::string> &splitted) {
-    if (splitted.size() < F_LEG_CTR_FIX+1) {
-        return;     // Error line
-    }
 
+void CIFPParser::finalize_structures(CIFPAirport &apt) {
 
-    auto index_str = arpt_id + ":" + splitted[F_NAME] + ":" + splitted[F_TRANS];  // For internal use only
-    
-    int index;
-    if (data_app_idx.find(index_str) == data_app_idx.end()) {
-        // Not yet seen
-        index = create_new_cifp_data(data_app, arpt_id, splitted);
-        data_app_idx[index_str] = index;
-    } else {
-        index = data_app_idx.at(index_str);
+    // Only the airport just loaded is touched, the others have been already published.
+    // The legs are in file order: group them by procedure (a stable counting sort), so that
+    // every procedure becomes a contiguous slice of a single array.
+    std::vector<int> first_leg(apt.nr_procs, 0);
+    std::vector<int> nr_legs(apt.nr_procs, 0);
+    for (int owner : apt.legs_owner) {
+        nr_legs[owner]++;
     }
 
-    int leg_array_id = data_app.at(arpt_id).at(index)._legs_arr_ref;
-    
-    xpdata_cifp_leg_t new_leg;
-
-    parse_leg(new_leg, splitted);
-
-    legs_array[leg_array_id].push_back(std::move(new_leg));
-}
+    int offset = 0;
+    for (auto *procs : {&apt.sids, &apt.stars, &apt.apps}) {
+        for (auto &proc : *procs) {
+            int owner = proc._legs_arr_ref;
+            first_leg[owner] = offset;
+            proc._legs_arr_ref = offset;
+            proc.legs_len = nr_legs[owner];
+            offset += nr_legs[owner];
+        }
+    }
 
-void CIFPParser::parse_rwy(const std::string &rwy_id, int id, const std::vector<std::string> &splitted) {
-    if (splitted.size() < 9) {
-        return;     // Error line
+    std::vector<xpdata_cifp_leg_t> sorted_legs(apt.legs.size());
+    for (size_t i=0; i < apt.legs.size(); i++) {
+        sorted_legs[first_leg[apt.legs_owner[i]]++] = apt.legs[i];
     }
+    apt.legs = std::move(sorted_legs);
+    apt.legs_owner = std::vector<int>();
 
-    xpdata_cifp_rwy_data_t rwy;
+    for (auto *procs : {&apt.sids, &apt.stars, &apt.apps}) {
+        for (auto &proc : *procs) {
+            proc.legs = apt.legs.data() + proc._legs_arr_ref;
+        }
+    }
 
-    all_string_container.push_back(rwy_id);
-    rwy.rwy_name     = all_string_container.back().c_str();
-    rwy.rwy_name_len = all_string_container.back().size();
+    xpdata_cifp_t view = {};
+    view.sids  = {apt.sids.data(),  (int) apt.sids.size()};
+    view.stars = {apt.stars.data(), (int) apt.stars.size()};
+    view.apprs = {apt.apps.data(),  (int) apt.apps.size()};
+    view.rwys  = {apt.rwys.data(),  (int) apt.rwys.size()};
+    apt.index.build(view);
 
-    rwy.ldg_threshold_alt = std::stoi(splitted[RWY_HEIGHT]);
+    apt.memory_usage = compute_memory_usage(apt);
+}
 
-    all_string_container.push_back(splitted[RWY_LOC]);
-    rwy.loc_ident     = all_string_container.back().c_str();
-    rwy.loc_ident_len = all_string_container.back().size();
+const CIFPAirport* CIFPParser::access_airport(const char* name) noexcept {
+    auto apt_it = loaded_apts.find(name);
+    if (apt_it == loaded_apts.end()) {
+        return nullptr;
+    }
 
-    rwy.ils_category = splitted[RWY_CAT].size() > 0 ? splitted[RWY_CAT][0] : ' ';
+    apt_it->second.last_access = ++access_counter;
+    apt_it->second.last_access_epoch = reclaimer->get_epoch();
 
-    this->rwys_array.push_back(std::move(rwy));
+    return apt_it->second.apt.get();
 }
 
+xpdata_cifp_t CIFPParser::get_full_cifp(const char* name) {
+    xpdata_cifp_t to_ret = {};
 
-void CIFPParser::finalize_structures() {
-
-    /** SID **/
-    for (auto apt_it = data_sid.begin(); apt_it != data_sid.end(); apt_it++) {
-        for(auto sid_it = apt_it->second.begin(); sid_it != apt_it->second.end(); sid_it++) {
-            int ref = sid_it->_legs_arr_ref;
-            sid_it->legs = legs_array.at(ref).data();
-            sid_it->legs_len = legs_array.at(ref).size();
+    std::lock_guard<std::mutex> lk(mx_loaded);
+    const CIFPAirport* c_apt = access_airport(name);
+    if (c_apt == nullptr) {
+        if (database) {
+            database->get_airport(name, to_ret);    // Bulk mode: just a lookup in the mapped file
         }
+        return to_ret;  // Not loaded (yet) or evicted
     }
 
-    /** STAR **/
-    for (auto apt_it = data_star.begin(); apt_it != data_star.end(); apt_it++) {
-        for(auto star_it = apt_it->second.begin(); star_it != apt_it->second.end(); star_it++) {
-            int ref = star_it->_legs_arr_ref;
-            star_it->legs = legs_array.at(ref).data();
-            star_it->legs_len = legs_array.at(ref).size();
-        }
+    const CIFPAirport &apt = *c_apt;
+
+    to_ret.sids.data  = apt.sids.data();
+    to_ret.sids.len   = apt.sids.size();
+    to_ret.stars.data = apt.stars.data();
+    to_ret.stars.len  = apt.stars.size();
+    to_ret.apprs.data = apt.apps.data();
+    to_ret.apprs.len  = apt.apps.size();
+    to_ret.rwys.data  = apt.rwys.data();
+    to_ret.rwys.len   = apt.rwys.size();
+
+    return to_ret;
+}
+
+const xpdata_cifp_rwy_data_t* CIFPParser::get_rwy(const char* name, const char* rwy_name) {
+    std::string_view designator(rwy_name);
+    if (designator.size() > 2 && designator[0] == 'R' && designator[1] == 'W') {
+        designator.remove_prefix(2);    // Both RW34R and 34R are accepted
     }
 
-    /** APPR **/
-    for (auto apt_it = data_app.begin(); apt_it != data_app.end(); apt_it++) {
-        for(auto app_it = apt_it->second.begin(); app_it != apt_it->second.end(); app_it++) {
-            int ref = app_it->_legs_arr_ref;
-            app_it->legs = legs_array.at(ref).data();
-            app_it->legs_len = legs_array.at(ref).size();
-        }
+    std::lock_guard<std::mutex> lk(mx_loaded);
+    const CIFPAirport* apt = access_airport(name);
+    if (apt == nullptr) {
+        return database ? database->get_runway(name, designator) : nullptr;
     }
 
+    auto rwy_it = apt->rwys_idx.find(std::string(designator));
+    return rwy_it != apt->rwys_idx.end() ? &apt->rwys[rwy_it->second] : nullptr;
 }
 
-xpdata_cifp_t CIFPParser::get_full_cifp(const char* name) {
-    xpdata_cifp_t to_ret;
-    try {
-        to_ret.sids.data = data_sid.at(name).data();
-        to_ret.sids.len = data_sid.at(name).size();
-    } catch(...) {
-        to_ret.sids.data = nullptr;
-        to_ret.sids.len = 0;
+std::shared_ptr<const void> CIFPParser::acquire_airport(const char* name, const CIFPProcIndex* &index) noexcept {
+    std::lock_guard<std::mutex> lk(mx_loaded);
+    auto apt_it = loaded_apts.find(name);
+    if (apt_it != loaded_apts.end()) {
+        index = &apt_it->second.apt->index;
+        return apt_it->second.apt;
     }
-    
-    try {
-        to_ret.stars.data = data_star.at(name).data();
-        to_ret.stars.len = data_star.at(name).size();
-    } catch(...) {
-        to_ret.stars.data = nullptr;
-        to_ret.stars.len = 0;
+    index = database ? database->get_index(name) : nullptr;
+    if (index != nullptr) {
+        return database;
     }
+    return nullptr;
+}
 
-    try {
-        to_ret.apprs.data = data_app.at(name).data();
-        to_ret.apprs.len = data_app.at(name).size();
-    } catch(...) {
-        to_ret.apprs.data = nullptr;
-        to_ret.apprs.len = 0;
+const CIFPProcIndex* CIFPParser::access_index(const char* name) noexcept {
+    const CIFPAirport* apt = access_airport(name);
+    if (apt != nullptr) {
+        return &apt->index;
+    }
+    return database ? database->get_index(name) : nullptr;
+}
+
+const xpdata_cifp_data_t* CIFPParser::get_proc(const char* name, xpdata_cifp_proc_type_t type, const char* proc_name, const char* trans_name) {
+    if (name == nullptr || proc_name == nullptr) {
+        return nullptr;
     }
+    std::lock_guard<std::mutex> lk(mx_loaded);
+    const CIFPProcIndex* index = access_index(name);
+    return index ? index->find(type, proc_name, trans_name ? trans_name : "") : nullptr;
+}
 
-    try {
-        to_ret.rwys.data = rwys_array.data();
-        to_ret.rwys.len = rwys_array.size();
-    } catch(...) {
-        to_ret.rwys.data = nullptr;
-        to_ret.rwys.len = 0;
+std::pair<const xpdata_cifp_data_t* const*, size_t> CIFPParser::get_procs_by_rwy(const char* name, xpdata_cifp_proc_type_t type, const char* rwy_name) {
+    if (name == nullptr || rwy_name == nullptr) {
+        return {nullptr, 0};
     }
+    std::lock_guard<std::mutex> lk(mx_loaded);
+    const CIFPProcIndex* index = access_index(name);
+    return index ? index->find_by_rwy(type, rwy_name) : std::pair<const xpdata_cifp_data_t* const*, size_t>(nullptr, 0);
+}
 
-    return to_ret;
+std::pair<const xpdata_cifp_data_t* const*, size_t> CIFPParser::get_apprs_by_type(const char* name, char appr_type) {
+    std::lock_guard<std::mutex> lk(mx_loaded);
+    const CIFPProcIndex* index = access_index(name);
+    return index ? index->find_apprs_by_type(appr_type) : std::pair<const xpdata_cifp_data_t* const*, size_t>(nullptr, 0);
 }
 
 } // namespace avionicsbay
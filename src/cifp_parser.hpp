@@ -1,66 +1,154 @@
 #ifndef CIFP_PARSER_H
 #define CIFP_PARSER_H
 
+#include "cifp_database.hpp"
+#include "cifp_index.hpp"
+#include "utilities/arena.hpp"
+#include "utilities/epoch_reclaimer.hpp"
 #include "utilities/logger.hpp"
 #include "data_types.hpp"
 
 #include <algorithm>
-#include <future>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
-    
+
 namespace avionicsbay {
 
+// All the CIFP data of a single airport. An instance is filled by a loader thread and it is
+// published (and never modified again) only when the whole file has been parsed.
+struct CIFPAirport {
+    std::vector<xpdata_cifp_data_t> sids;
+    std::vector<xpdata_cifp_data_t> stars;
+    std::vector<xpdata_cifp_data_t> apps;
+
+    std::unordered_map<std::string, int> sids_idx;     // key = sid:trans ; value = sids index
+    std::unordered_map<std::string, int> stars_idx;    // key = star:trans ; value = stars index
+    std::unordered_map<std::string, int> apps_idx;     // key = app:trans ; value = apps index
+
+    // All the legs of the airport in a single array: SIDs, then STARs, then approaches, each
+    // procedure being the view [_legs_arr_ref, _legs_arr_ref + legs_len) over it
+    std::vector<xpdata_cifp_leg_t> legs;
+    std::vector<int> legs_owner;                       // While parsing only: procedure id of each leg
+    int nr_procs = 0;                                  // While parsing only: procedure ids assigned
+
+    std::vector<xpdata_cifp_rwy_data_t> rwys;
+    std::unordered_map<std::string, int> rwys_idx;     // key = runway designator (e.g. 34R) ; value = rwys index
+
+    CIFPProcIndex index;                               // Public lookups, built when finalized
+
+    Arena arena;                                       // Storage for all the const char* above
+
+    size_t memory_usage = 0;                           // Approx. bytes, computed when finalized
+};
+
+// The fields of a CIFP line, as views over the line itself. Empty fields are skipped and the
+// fields beyond size (or MAX_FIELDS) are returned as empty views.
+struct CIFPFields {
+    static constexpr int MAX_FIELDS = 48;
+
+    std::string_view fields[MAX_FIELDS];
+    int size = 0;
+
+    std::string_view operator[](int i) const noexcept { return i < size ? fields[i] : std::string_view(); }
+};
+
 class CIFPParser {
 public:
     CIFPParser(const std::string & xplane_directory);
+    virtual ~CIFPParser();
 
     void perform_init_checks();
 
     void load_airport(const std::string &arpt_id);
+    void load_all_airports() noexcept;                   // Bulk mode, see bulk_task()
 
-    bool is_ready() noexcept;
+    bool is_ready() noexcept;                            // True if no airport is queued or loading (and no bulk load)
+    bool is_ready(const std::string &arpt_id) noexcept;  // True if the airport has been loaded
 
     xpdata_cifp_t get_full_cifp(const char* name);
+    const xpdata_cifp_rwy_data_t* get_rwy(const char* name, const char* rwy_name);  // nullptr if not found
+
+    // Keeps the data of the airport alive (even if evicted) while the returned pointer is held,
+    // for library threads reading it outside the epochs of the user plugin. nullptr if not loaded.
+    // index is the lookup of that same instance; the access is not counted for the LRU policy.
+    std::shared_ptr<const void> acquire_airport(const char* name, const CIFPProcIndex* &index) noexcept;
+
+    const xpdata_cifp_data_t* get_proc(const char* name, xpdata_cifp_proc_type_t type, const char* proc_name, const char* trans_name);
+    std::pair<const xpdata_cifp_data_t* const*, size_t> get_procs_by_rwy(const char* name, xpdata_cifp_proc_type_t type, const char* rwy_name);
+    std::pair<const xpdata_cifp_data_t* const*, size_t> get_apprs_by_type(const char* name, char appr_type);
+
+    void set_memory_budget(size_t bytes) noexcept;      // Enforced only across quiescent states, see evict_over_budget()
+    void set_pinned(const std::string &arpt_id, bool pinned) noexcept;
 
 private:
 
     std::string xplane_directory;
 
     std::shared_ptr<Logger> logger;
+    std::shared_ptr<EpochReclaimer> reclaimer;
+
+    std::atomic<bool> stop;
+    std::vector<std::thread> workers;
+
+    std::mutex mx_queue;
+    std::condition_variable cv_queue;
+    std::deque<std::string> queue;                      // Airports waiting for a loader thread
+    std::unordered_set<std::string> pending_apts;       // Airports queued or being loaded
+
+    struct LoadedAirport {
+        std::shared_ptr<const CIFPAirport> apt;
+        uint64_t last_access;       // For the LRU policy
+        uint64_t last_access_epoch; // Airports used in the current epoch are never evicted
+    };
+
+    std::mutex mx_loaded;
+    std::unordered_map<std::string, LoadedAirport> loaded_apts;
+    std::unordered_set<std::string> pinned_apts;        // Never evicted (origin, destination, ...)
+    uint64_t access_counter = 0;
+    size_t memory_used = 0;
+    size_t memory_budget;
+
+    std::thread bulk_thread;
+    std::atomic<bool> bulk_loading;
+    std::shared_ptr<CIFPDatabase> database;             // Guarded by mx_loaded, nullptr if no bulk load
+
+    void worker() noexcept;
+    void task(const std::string &arpt_id) noexcept;
+    void publish(const std::string &arpt_id, std::unique_ptr<CIFPAirport> apt, int status) noexcept;
+    void push_loaded_event(const std::string &arpt_id, int status) noexcept;   // Empty id: the bulk database
+    // mx_loaded must be held. The airports accessed in the current epoch may be in use by the user
+    // plugin: while it never calls quiescent_state(), the epoch doesn't advance and nothing is evicted.
+    void evict_over_budget() noexcept;
+    const CIFPAirport* access_airport(const char* name) noexcept;   // mx_loaded must be held
+    const CIFPProcIndex* access_index(const char* name) noexcept;   // mx_loaded must be held
 
-    std::future<void> ap_future;
-
-    std::unordered_map<std::string, std::vector<xpdata_cifp_data_t>> data_sid;    // key = airport id
-    std::unordered_map<std::string, int> data_sid_idx;    // key = airport id:sid:trans ; value = data_sid index
-    std::unordered_map<std::string, std::vector<xpdata_cifp_data_t>> data_star;    // key = airport id
-    std::unordered_map<std::string, int> data_star_idx;    // key = airport id:sid:trans ; value = data_sid index
-    std::unordered_map<std::string, std::vector<xpdata_cifp_data_t>> data_app;    // key = airport id
-    std::unordered_map<std::string, int> data_app_idx;    // key = airport id:sid:trans ; value = data_sid index
-    
-    int legs_array_progressive=0;
-    std::unordered_map<int, std::vector<xpdata_cifp_leg_t>> legs_array;
-    std::vector<xpdata_cifp_rwy_data_t> rwys_array;
+    void bulk_task() noexcept;
+    uint64_t compute_cifp_fingerprint(const std::vector<std::string> &files) const noexcept;
 
-    std::unordered_set<std::string> already_loaded_apts;
+    void parse_cifp_file(const std::string &arpt_id, CIFPAirport &apt, bool verbose=true);
+    void parse_cifp_file_line(CIFPAirport &apt, int line_no, const CIFPFields &splitted);
 
-    void task(const std::string &arpt_id) noexcept;
-    void parse_cifp_file(const std::string &arpt_id);
-    void parse_cifp_file_line(const std::string &arpt_id, int line_no, const std::string &line);
+    void parse_sid(CIFPAirport &apt, int line_no, const CIFPFields &splitted);
+    void parse_star(CIFPAirport &apt, int line_no, const CIFPFields &splitted);
+    void parse_appch(CIFPAirport &apt, int line_no, const CIFPFields &splitted);
+    void parse_rwy(CIFPAirport &apt, std::string_view rwy_id, int line_no, const CIFPFields &splitted);
 
-    void parse_sid(const std::string &arpt_id, int line_no, const std::vector<std::string> &splitted);
-    void parse_star(const std::string &arpt_id, int line_no, const std::vector<std::string> &splitted);
-    void parse_appch(const std::string &arpt_id, int line_no, const std::vector<std::string> &splitted);
-    void parse_rwy(const std::string &arpt_id, int line_no, const std::vector<std::string> &splitted);
+    void parse_proc_leg(CIFPAirport &apt, std::vector<xpdata_cifp_data_t> &procs, std::unordered_map<std::string, int> &procs_idx, const CIFPFields &splitted);
+    void parse_leg(CIFPAirport &apt, xpdata_cifp_leg_t &new_leg, const CIFPFields &splitted);
 
-    void parse_leg(xpdata_cifp_leg_t &new_leg, const std::vector<std::string> &splitted);
+    void finalize_structures(CIFPAirport &apt);
 
-    void finalize_structures();
-
-    int create_new_cifp_data(std::unordered_map<std::string, std::vector<xpdata_cifp_data_t>> &vec_ref, const std::string &arpt_id, const std::vector<std::string> &splitted);
+    int create_new_cifp_data(CIFPAirport &apt, std::vector<xpdata_cifp_data_t> &procs, const CIFPFields &splitted);
 
 };
 
@@ -68,4 +156,3 @@ private:
 } // namespace avionicsbay
 
 #endif
-
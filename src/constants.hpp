@@ -40,6 +40,10 @@
 #define NAV_CIFP_TYPE_HM 23
 
 
+#define NAV_CIFP_PROC_SID   0
+#define NAV_CIFP_PROC_STAR  1
+#define NAV_CIFP_PROC_APPCH 2
+
 #define NAV_CIFP_CSTR_ALT_NONE 0
 #define NAV_CIFP_CSTR_ALT_ABOVE 1
 #define NAV_CIFP_CSTR_ALT_BELOW 2
@@ -52,4 +56,33 @@
 #define NAV_CIFP_CSTR_SPD_ABOVE 1
 #define NAV_CIFP_CSTR_SPD_BELOW 2
 #define NAV_CIFP_CSTR_SPD_AT 3
+
+#define APT_DETAILS_PRIO_CURRENT  0     // The airport the aircraft is at
+#define APT_DETAILS_PRIO_DEST     1     // Destination and alternate airports
+#define APT_DETAILS_PRIO_PREFETCH 2
+
+#define APT_DETAILS_STATUS_NONE    0    // Never requested
+#define APT_DETAILS_STATUS_QUEUED  1
+#define APT_DETAILS_STATUS_LOADING 2
+#define APT_DETAILS_STATUS_LOADED  3
+#define APT_DETAILS_STATUS_FAILED  4
+
+#define APT_RWY_EXT_CENTERLINE_NM 10    // Length of xpdata_apt_rwy_geom_t::ext_centerline
+
+#define APT_TESS_LEVELS       5         // Levels of detail of xpdata_apt_details_t::tess, from 0
+                                        // (finest) with tolerances 0.25, 1, 4, 16 and 64 m
+#define QUERY_NAVAID_BY_NAME   0      // xpdata_query_t::type
+#define QUERY_NAVAID_BY_FREQ   1
+#define QUERY_NAVAID_BY_COORDS 2
+#define QUERY_FIX_BY_NAME      3
+#define QUERY_FIX_BY_COORDS    4
+#define QUERY_APT_BY_NAME      5
+#define QUERY_APT_BY_COORDS    6
+
+#define EVENT_DATA_READY       0      // xpdata_event_t::type
+#define EVENT_CIFP_LOADED      1
+#define EVENT_APT_DETAILS      2
+#define EVENT_NEAREST_APT      3
+#define EVENT_LOST             4      // The queue was full: check the states with the getters
+
 #endif // CONSTANTS_H
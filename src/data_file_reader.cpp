@@ -1,12 +1,17 @@
 #include "data_file_reader.hpp"
 
+#include "apt_mesh.hpp"
+#include "apt_tessellator.hpp"
 #include "utilities/filesystem.hpp"
 #include "constants.hpp"
 #include "data_types.hpp"
 #include "plugin.hpp"
+#include "utilities/enu.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cmath>
 #include <fstream>
 #include <list>
 #include <sstream>
@@ -24,10 +29,13 @@
 #define APT_FILE_PATH "Resources/default scenery/default apt dat/Earth nav data/apt.dat"
 
 #define NEAREST_APT_UPDATE_SEC 2
+#define APT_DETAILS_THREADS    3    // Origin, destination and alternate are loaded together
+
+#define APT_LOD_RETRIES        4    // Halvings of the tolerance before giving up simplifying a polygon
 
 namespace avionicsbay {
 
-static std::list<std::string> all_string_container;
+static std::list<std::string> all_string_container;    // Used only by the DataFileReader thread
 
 //**************************************************************************************************
 // String support
@@ -103,13 +111,16 @@ DataFileReader::DataFileReader(const std::string &xplane_directory) : stop(false
 
     
     this->my_thread = std::thread(&DataFileReader::worker, this);
+    for (int i=0; i < APT_DETAILS_THREADS; i++) {
+        this->apt_details_threads.emplace_back(&DataFileReader::apt_details_worker, this);
+    }
     
     LOG << logger_level_t::INFO << "DataFileReader thread started." << ENDL;
 
 }
 
 
-void DataFileReader::request_apts_details(const std::string &id) noexcept {
+void DataFileReader::request_apts_details(const std::string &id, int priority) noexcept {
     if (!xpdata->get_is_ready()) {
         return; // XPData not yet initialized
     }
@@ -121,9 +132,49 @@ void DataFileReader::request_apts_details(const std::string &id) noexcept {
     }
 
     // If it's not zero it should be 1 because airport id is unique
+    xpdata_apt_t *apt = arpt.first[0];
+    priority = std::min(std::max(priority, APT_DETAILS_PRIO_CURRENT), APT_DETAILS_PRIO_PREFETCH);
+
+    if (xpdata->touch_apt_details(apt)) {
+        return; // Already loaded
+    }
+
+    std::lock_guard<std::mutex> lk(mx_apt_details);
+    auto it = apt_details_requests.find(apt);
+    if (it == apt_details_requests.end() || it->second.status == APT_DETAILS_STATUS_FAILED
+                                         || it->second.status == APT_DETAILS_STATUS_LOADED) {  // Loaded, then evicted
+        apt_details_requests[apt] = { .status = APT_DETAILS_STATUS_QUEUED, .priority = priority };
+        apt_details_queue[priority].push_back(apt);
+        cv_apt_details.notify_one();
+    } else if (it->second.status == APT_DETAILS_STATUS_QUEUED && priority < it->second.priority) {
+        auto &old_queue = apt_details_queue[it->second.priority];
+        old_queue.erase(std::find(old_queue.begin(), old_queue.end(), apt));
+        apt_details_queue[priority].push_back(apt);
+        it->second.priority = priority;
+    }
+    // Otherwise it is already loading or loaded: nothing to do
+}
+
+int DataFileReader::get_apts_details_status(const std::string &id) noexcept {
+    if (!xpdata->get_is_ready()) {
+        return APT_DETAILS_STATUS_NONE;
+    }
+
+    auto arpt = xpdata->get_apts_by_name(id);
+    if (arpt.second == 0) {
+        return APT_DETAILS_STATUS_NONE;
+    }
+
+    if (xpdata->touch_apt_details(arpt.first[0])) {
+        return APT_DETAILS_STATUS_LOADED;
+    }
 
     std::lock_guard<std::mutex> lk(mx_apt_details);
-    this->detail_arpt = arpt.first[0];
+    auto it = apt_details_requests.find(arpt.first[0]);
+    if (it == apt_details_requests.end() || it->second.status == APT_DETAILS_STATUS_LOADED) {
+        return APT_DETAILS_STATUS_NONE;  // Never requested, or evicted
+    }
+    return it->second.status;
 }
 
 //**************************************************************************************************
@@ -223,25 +274,22 @@ void DataFileReader::worker() noexcept {
     xpdata->set_is_ready(true);
 
     LOG << logger_level_t::INFO << "[DataFileReader] Data Ready." << ENDL;
+    push_event({EVENT_DATA_READY, 0, nullptr, ""});
+
+    xpdata->compute_declinations();     // The lookups work meanwhile, evaluating the WMM
 
+    const xpdata_apt_t *prev_nearest = nullptr;
     while(!this->stop) {
         xpdata->update_nearest_airport(); // No need synchronization for this
 
-        std::unique_lock<std::mutex> lk(mx_apt_details);
-        cv_apt_details.wait_for(lk, std::chrono::seconds(NEAREST_APT_UPDATE_SEC));
-
-        xpdata_apt_t *temp_arpt=nullptr;
-
-        // Do we need to update detailed info of an airport?
-        if (this->detail_arpt != nullptr) {
-            temp_arpt = this->detail_arpt;
-            this->detail_arpt = nullptr;
+        const xpdata_apt_t *nearest = xpdata->get_nearest_airport();
+        if (nearest != prev_nearest) {
+            push_event({EVENT_NEAREST_APT, 0, nearest, ""});
+            prev_nearest = nearest;
         }
 
-        lk.unlock();
-        if (temp_arpt != nullptr) {
-            parse_apts_details(temp_arpt);  // This may be very heavy, don't put this in the mutex
-        }
+        std::unique_lock<std::mutex> lk(mx_worker);
+        cv_worker.wait_for(lk, std::chrono::seconds(NEAREST_APT_UPDATE_SEC), [this] { return this->stop.load(); });
     }
     
     xpdata->set_is_ready(false);
@@ -483,6 +531,7 @@ void DataFileReader::parse_apts_file_header(int line_no, ssize_t seek_pos, const
             .full_name_len = full_name_len,
             .altitude = std::stoi(splitted[1]),
             .rwys = nullptr,
+            .rwys_geom = nullptr,
             .rwys_len = 0,
             .pos_seek = seek_pos
         };
@@ -550,15 +599,68 @@ void DataFileReader::parse_apts_file_runway(int line_no, const std::vector<std::
     
 }
 
-void DataFileReader::parse_apts_details(xpdata_apt_t *arpt) {
+void DataFileReader::apt_details_worker() noexcept {
+
+#if defined(__linux__)
+    pthread_setname_np(pthread_self(), "AptDetails");   // For debugging purposes
+#endif
+
+    while (true) {
+        xpdata_apt_t *arpt = nullptr;
+        {
+            std::unique_lock<std::mutex> lk(mx_apt_details);
+            cv_apt_details.wait(lk, [this] {
+                return this->stop || std::any_of(std::begin(apt_details_queue), std::end(apt_details_queue),
+                                                 [](const auto &q) { return !q.empty(); });
+            });
+            if (this->stop) {
+                break;
+            }
+            for (auto &q : apt_details_queue) {
+                if (!q.empty()) {
+                    arpt = q.front();
+                    q.pop_front();
+                    break;
+                }
+            }
+            apt_details_requests[arpt].status = APT_DETAILS_STATUS_LOADING;
+        }
+
+        int status = APT_DETAILS_STATUS_LOADED;
+        try {
+            AptDetailsContext ctx;
+            ctx.arpt = arpt;
+            parse_apts_details(ctx);    // This may be very heavy, don't put this in the mutex
+        }
+        catch(const std::ifstream::failure &e) {
+            LOG << logger_level_t::ERROR << "[DataFileReader] [Loading=" << arpt->id << "] I/O exception: " << e.what() << ENDL;
+            status = APT_DETAILS_STATUS_FAILED;
+        }
+        catch(...) {
+            LOG << logger_level_t::CRIT << "[DataFileReader] [Loading=" << arpt->id << "] Unexpected exception." << ENDL;
+            status = APT_DETAILS_STATUS_FAILED;
+        }
+
+        if (this->stop) {
+            break;      // Interrupted, nothing has been published
+        }
+
+        {
+            std::lock_guard<std::mutex> lk(mx_apt_details);
+            status = get_loaded_details_flag(arpt) ? APT_DETAILS_STATUS_LOADED : status;
+            apt_details_requests[arpt].status = status;
+        }
+        push_event({EVENT_APT_DETAILS, status, arpt, ""});
+    }
+}
+
+void DataFileReader::parse_apts_details(AptDetailsContext &ctx) {
+    xpdata_apt_t *arpt = ctx.arpt;
 
-    if (arpt->is_loaded_details) {
+    if (get_loaded_details_flag(arpt)) {
         return;  // Nothing to do
     }
-    
-    xpdata->allocate_apt_details(arpt); // Allocate and set the point of xpdata_apt_t
 
-    
     std::ifstream ifs;
     ifs.exceptions(std::ifstream::badbit);
     
@@ -574,7 +676,7 @@ void DataFileReader::parse_apts_details(xpdata_apt_t *arpt) {
 
     bool first_airport_header = false;
     while (!ifs.eof() && std::getline(ifs, line) && !this->stop) {
-        if (parse_apts_details_line(arpt, line_no, line)) {
+        if (parse_apts_details_line(ctx, line_no, line)) {
         
             // This is the logic to stop: when I encounter the first airport it's my airport (just
             // after the seek), then the next airport (and first_airport_header will be true),
@@ -590,11 +692,14 @@ void DataFileReader::parse_apts_details(xpdata_apt_t *arpt) {
     ifs.close();
     LOG << logger_level_t::INFO << "[DataFileReader] Total lines read from " << filename << ": " << line_no << ENDL;
     
-    xpdata->finalize_apt_details(arpt);  // Set the last pointers into the final struct and flag is_loaded_details
+    if (!this->stop) {
+        parse_apts_details_finalize(ctx);
+        xpdata->publish_apt_details(arpt, std::move(ctx.out));  // Set the pointer into xpdata_apt_t and flag is_loaded_details
+    }
     
 }
 
-void DataFileReader::parse_apts_details_tower(xpdata_apt_t *arpt, const std::vector<std::string> &splitted) {
+void DataFileReader::parse_apts_details_tower(AptDetailsContext &ctx, const std::vector<std::string> &splitted) {
     if (splitted.size() < 3) {
         return;     //  Should not happen
     }
@@ -602,11 +707,11 @@ void DataFileReader::parse_apts_details_tower(xpdata_apt_t *arpt, const std::vec
     double lat = std::stod(splitted[1]);
     double lon = std::stod(splitted[2]);
     
-    arpt->details->tower_pos.lat = lat;
-    arpt->details->tower_pos.lon = lon;
+    ctx.out->details.tower_pos.lat = lat;
+    ctx.out->details.tower_pos.lon = lon;
 }
 
-void DataFileReader::parse_apts_details_arpt_gate(xpdata_apt_t *arpt, const std::vector<std::string> &splitted) {
+void DataFileReader::parse_apts_details_arpt_gate(AptDetailsContext &ctx, const std::vector<std::string> &splitted) {
     if (splitted.size() < 7) {
         return;     // Invalid gate
     }
@@ -615,9 +720,8 @@ void DataFileReader::parse_apts_details_arpt_gate(xpdata_apt_t *arpt, const std:
         return; // It means it's a runway, we are not interested in runways here.
     }
 
-    all_string_container.emplace_back(splitted[6]);
-    const char* gate_name = all_string_container.back().c_str();
-    int gate_name_len = all_string_container.back().size();
+    const char* gate_name = ctx.out->arena.copy_string(splitted[6].c_str(), splitted[6].size());
+    int gate_name_len = splitted[6].size();
 
     double lat = std::stod(splitted[1]);
     double lon = std::stod(splitted[2]);
@@ -628,11 +732,11 @@ void DataFileReader::parse_apts_details_arpt_gate(xpdata_apt_t *arpt, const std:
         .coords     = { .lat=lat, .lon=lon }
     };
 
-    xpdata->push_apt_gate(arpt, std::move(gate));
+    ctx.gates.push_back(std::move(gate));
     
 }
 
-void DataFileReader::parse_apts_details_linear_start(const std::vector<std::string> &splitted) {
+void DataFileReader::parse_apts_details_linear_start(AptDetailsContext &ctx, const std::vector<std::string> &splitted) {
     if (splitted.size() < 3) {
         return;     // Invalid line
     }
@@ -642,7 +746,7 @@ void DataFileReader::parse_apts_details_linear_start(const std::vector<std::stri
 
     if (splitted.size() >= 4) {
         // We have also the color specified
-        current_color = std::stoi(splitted[3]);
+        ctx.current_color = std::stoi(splitted[3]);
     }
 
     xpdata_apt_node_t node = {
@@ -650,10 +754,10 @@ void DataFileReader::parse_apts_details_linear_start(const std::vector<std::stri
         .is_bez = false,
     };
 
-    this->curr_node_list.push_back(std::move(node));
+    ctx.curr_node_list.push_back(std::move(node));
 }
 
-void DataFileReader::parse_apts_details_beizer_start(const std::vector<std::string> &splitted) {
+void DataFileReader::parse_apts_details_beizer_start(AptDetailsContext &ctx, const std::vector<std::string> &splitted) {
     if (splitted.size() < 5) {
         return;     // Invalid line
     }
@@ -665,7 +769,7 @@ void DataFileReader::parse_apts_details_beizer_start(const std::vector<std::stri
 
     if (splitted.size() >= 6) {
         // We have also the color specified
-        current_color = std::stoi(splitted[5]);
+        ctx.current_color = std::stoi(splitted[5]);
     }
 
     xpdata_apt_node_t node = {
@@ -674,63 +778,306 @@ void DataFileReader::parse_apts_details_beizer_start(const std::vector<std::stri
         .bez_cp     = { .lat=c_lat, .lon=c_lon },
     };
 
-    this->curr_node_list.push_back(std::move(node));
+    ctx.curr_node_list.push_back(std::move(node));
 }
 
-void DataFileReader::parse_apts_details_save(xpdata_apt_t *arpt) {
+void DataFileReader::parse_apts_details_save(AptDetailsContext &ctx, bool closed) {
 
-    if (apt_detail_status == ROW_NONE) {
+    if (ctx.status == ROW_NONE) {
         // This should not happen
         LOG << logger_level_t::CRIT << "[DataFileReader] Detailed parser: incongruent status on line-close." << ENDL;
-        this->curr_node_list.clear();
+        ctx.curr_node_list.clear();
         return;
     }
 
 
-    // 2 - Store the vector in XPData - note, we need a copy here
-    if (apt_detail_status == ROW_TAXI) {
-        xpdata->push_apt_taxi(arpt, current_color, curr_node_list);
-    } else if (apt_detail_status == ROW_LINE) {
-        xpdata->push_apt_line(arpt, current_color, curr_node_list);
-    } else if (apt_detail_status == ROW_BOUND) {
-        xpdata->push_apt_bound(arpt, current_color, curr_node_list);
-    } else if (apt_detail_status == ROW_HOLE) {
-        xpdata->push_apt_hole(arpt, current_color, curr_node_list);
+    // 2 - Copy the nodes in the arena of the airport
+    xpdata_apt_node_array_t new_node_array = {
+        .color = ctx.current_color,
+        .nodes = ctx.out->arena.copy_array(ctx.curr_node_list.data(), ctx.curr_node_list.size()),
+        .nodes_len = static_cast<int>(ctx.curr_node_list.size()),
+        .hole = nullptr
+    };
+
+    if (ctx.status == ROW_HOLE) {
+        if (ctx.last_arrays == nullptr || ctx.last_arrays->empty()) {
+            // This should not happen
+            LOG << logger_level_t::CRIT << "[DataFileReader] Detailed parser: hole without a taxi/line/bound." << ENDL;
+        } else {
+            // The hole belongs to the last array pushed, chained after its previous holes
+            xpdata_apt_node_array_t *hole = ctx.out->arena.allocate_array<xpdata_apt_node_array_t>(1);
+            *hole = new_node_array;
+            xpdata_apt_node_array_t *last_element = &ctx.last_arrays->back();
+            while (last_element->hole != nullptr) {
+                last_element = last_element->hole;
+            }
+            last_element->hole = hole;
+        }
+    } else {
+        if (ctx.status == ROW_TAXI) {
+            ctx.last_arrays = &ctx.pavements;
+            ctx.pavements_surface.push_back(ctx.surface);
+        } else if (ctx.status == ROW_LINE) {
+            ctx.last_arrays = &ctx.linear_features;
+            ctx.linear_features_closed.push_back(closed);
+        } else {
+            ctx.last_arrays = &ctx.boundaries;
+        }
+        ctx.last_arrays->push_back(new_node_array);
     }
 
     // 3 - Clear the vector and the color for the next path
-    this->current_color = 0;
-    this->curr_node_list.clear();
+    ctx.current_color = 0;
+    ctx.curr_node_list.clear();
+}
+
+// A level of detail of a polygon and its holes, into the arena. If the simplified rings cross
+// each other the tolerance is halved, until the rings are only flattened. Rings left unchanged
+// share the nodes of the original ones.
+static xpdata_apt_node_array_t lod_polygon(const AptTessellator &tessellator, Arena &arena, const xpdata_apt_node_array_t &array) {
+    std::vector<const xpdata_apt_node_array_t*> src_rings;
+    std::vector<std::vector<xpdata_apt_node_t>> flat_rings;
+    for (const xpdata_apt_node_array_t *ring = &array; ring != nullptr; ring = ring->hole) {
+        src_rings.push_back(ring);
+        flat_rings.emplace_back();
+        tessellator.flatten(ring->nodes, ring->nodes_len, true, flat_rings.back());
+    }
+
+    std::vector<std::vector<xpdata_apt_node_t>> rings;
+    std::vector<const xpdata_apt_node_array_t*> rings_src;
+    for (int attempt=0; attempt <= APT_LOD_RETRIES; attempt++) {
+        rings.clear();
+        rings_src.clear();
+        if (attempt == APT_LOD_RETRIES) {
+            rings = flat_rings;     // Give up: flattened only
+            rings_src = src_rings;
+            break;
+        }
+
+        const double tolerance = tessellator.get_tolerance() / (1 << attempt);
+        for (size_t i=0; i < flat_rings.size(); i++) {
+            std::vector<xpdata_apt_node_t> ring = flat_rings[i];
+            AptTessellator::simplify(ring, true, tolerance);
+            if (ring.size() < 3) {
+                if (i == 0) {
+                    break;      // The polygon collapsed
+                }
+                continue;       // The hole collapsed: drop it
+            }
+            rings.push_back(std::move(ring));
+            rings_src.push_back(src_rings[i]);
+        }
+
+        if (!rings.empty() && AptTessellator::are_rings_simple(rings)) {
+            break;
+        }
+    }
+
+    auto store_ring = [&](const std::vector<xpdata_apt_node_t> &ring, const xpdata_apt_node_array_t *src) {
+        xpdata_apt_node_array_t result = *src;
+        result.hole = nullptr;
+        bool has_bez = std::any_of(src->nodes, src->nodes + src->nodes_len, [](const xpdata_apt_node_t &n) { return n.is_bez; });
+        if (has_bez || static_cast<int>(ring.size()) != src->nodes_len) {
+            result.nodes = arena.copy_array(ring.data(), ring.size());
+            result.nodes_len = ring.size();
+        }
+        return result;
+    };
+
+    xpdata_apt_node_array_t result = store_ring(rings[0], rings_src[0]);
+    xpdata_apt_node_array_t *last = &result;
+    for (size_t i=1; i < rings.size(); i++) {
+        last->hole = arena.allocate_array<xpdata_apt_node_array_t>(1);
+        *last->hole = store_ring(rings[i], rings_src[i]);
+        last = last->hole;
+    }
+
+    return result;
+}
+
+// A level of detail of a linear feature, into the arena. Closed lines repeat their first node.
+static xpdata_apt_node_array_t lod_line(const AptTessellator &tessellator, Arena &arena, const xpdata_apt_node_array_t &array,
+                                        bool closed, std::vector<xpdata_apt_node_t> &buffer) {
+    xpdata_apt_node_array_t result = array;
+    result.hole = nullptr;
+
+    buffer.clear();
+    tessellator.flatten(array.nodes, array.nodes_len, closed, buffer);
+    const size_t flat_len = buffer.size();
+    AptTessellator::simplify(buffer, closed, tessellator.get_tolerance());
+    if (closed && buffer.size() < 3) {
+        buffer.clear();     // Collapsed: flattened only
+        tessellator.flatten(array.nodes, array.nodes_len, closed, buffer);
+    }
+
+    bool has_bez = std::any_of(array.nodes, array.nodes + array.nodes_len, [](const xpdata_apt_node_t &n) { return n.is_bez; });
+    if (has_bez || closed || buffer.size() != flat_len) {
+        if (closed && !buffer.empty()) {
+            buffer.push_back(buffer.front());   // Lines are drawn, not filled: close them explicitly
+        }
+        result.nodes = arena.copy_array(buffer.data(), buffer.size());
+        result.nodes_len = buffer.size();
+    }
+
+    return result;
+}
+
+// Converts the arrays (and their holes) to lines in the local frame. Polygon rings are closed by
+// repeating their first point, so that all the lines can be drawn as strips.
+static void store_lines_xy(Arena &arena, const EnuFrame &frame, const xpdata_apt_node_array_t *arrays, int arrays_len,
+                           bool are_polygons, xpdata_apt_lines_xy_t &lines) {
+    std::vector<float> xy;
+    std::vector<int> start;
+    std::vector<int> array_idx;
+
+    auto push_point = [&](const xpdata_coords_t &coords) {
+        double east, north;
+        frame.to_enu(coords.lat, coords.lon, east, north);
+        xy.push_back(east);
+        xy.push_back(north);
+    };
+
+    for (int i=0; i < arrays_len; i++) {
+        for (const xpdata_apt_node_array_t *ring = &arrays[i]; ring != nullptr; ring = ring->hole) {
+            start.push_back(xy.size() / 2);
+            array_idx.push_back(i);
+            for (int j=0; j < ring->nodes_len; j++) {
+                push_point(ring->nodes[j].coords);
+            }
+            if (are_polygons && ring->nodes_len > 0) {
+                push_point(ring->nodes[0].coords);
+            }
+        }
+    }
+    start.push_back(xy.size() / 2);
+
+    lines.xy    = arena.copy_array(xy.data(), xy.size());
+    lines.start = arena.copy_array(start.data(), start.size());
+    lines.array = arena.copy_array(array_idx.data(), array_idx.size());
+    lines.len   = array_idx.size();
+}
+
+void DataFileReader::parse_apts_details_finalize(AptDetailsContext &ctx) {
+    XPDataAptDetails &out = *ctx.out;
+    const EnuFrame frame(ctx.arpt->apt_center.lat, ctx.arpt->apt_center.lon);
+
+    out.details.pavements = out.arena.copy_array(ctx.pavements.data(), ctx.pavements.size());
+    out.details.pavements_len = ctx.pavements.size();
+
+    out.details.linear_features = out.arena.copy_array(ctx.linear_features.data(), ctx.linear_features.size());
+    out.details.linear_features_len = ctx.linear_features.size();
+
+    out.details.boundaries = out.arena.copy_array(ctx.boundaries.data(), ctx.boundaries.size());
+    out.details.boundaries_len = ctx.boundaries.size();
+
+    out.details.gates = out.arena.copy_array(ctx.gates.data(), ctx.gates.size());
+    out.details.gates_len = ctx.gates.size();
+
+    out.details.routes = out.arena.copy_array(ctx.routes.data(), ctx.routes.size());
+    out.details.routes_len = ctx.routes.size();
+
+    // The levels of detail, built here once for all the zoom levels
+    std::vector<xpdata_apt_node_t> buffer;
+    std::vector<xpdata_apt_node_array_t> lod_arrays;
+    auto lod_all = [&](const AptTessellator &tessellator, const std::vector<xpdata_apt_node_array_t> &arrays,
+                       const std::vector<bool> *lines_closed, int &len) {
+        lod_arrays.clear();
+        for (size_t i=0; i < arrays.size(); i++) {
+            if (lines_closed != nullptr) {
+                lod_arrays.push_back(lod_line(tessellator, out.arena, arrays[i], (*lines_closed)[i], buffer));
+            } else {
+                lod_arrays.push_back(lod_polygon(tessellator, out.arena, arrays[i]));
+            }
+        }
+        len = lod_arrays.size();
+        return out.arena.copy_array(lod_arrays.data(), lod_arrays.size());
+    };
+
+    for (int level=0; level < APT_TESS_LEVELS; level++) {
+        // Half of the tolerance to the flattening, half to the simplification: the layout stays
+        // within the tolerance of the level from the original curves
+        const AptTessellator tessellator(AptTessellator::level_tolerance(level) / 2);
+        xpdata_apt_tess_t &tess = out.details.tess[level];
+        tess.pavements       = lod_all(tessellator, ctx.pavements, nullptr, tess.pavements_len);
+        tess.linear_features = lod_all(tessellator, ctx.linear_features, &ctx.linear_features_closed, tess.linear_features_len);
+        tess.boundaries      = lod_all(tessellator, ctx.boundaries, nullptr, tess.boundaries_len);
+
+        // All the pavements in a single mesh, ready to be drawn
+        AptMeshBuilder mesh_builder(frame);
+        for (int i=0; i < tess.pavements_len; i++) {
+            mesh_builder.add_polygon(tess.pavements[i], i, ctx.pavements_surface[i]);
+        }
+        mesh_builder.store(out.arena, out.details.pavements_mesh[level]);
+
+        store_lines_xy(out.arena, frame, tess.linear_features, tess.linear_features_len, false, out.details.enu.linear_features[level]);
+        store_lines_xy(out.arena, frame, tess.boundaries, tess.boundaries_len, true, out.details.enu.boundaries[level]);
+    }
+
+    // Gates and routes in the local frame
+    out.details.enu.origin = ctx.arpt->apt_center;
+
+    std::vector<float> xy;
+    for (const auto &gate : ctx.gates) {
+        double east, north;
+        frame.to_enu(gate.coords.lat, gate.coords.lon, east, north);
+        xy.push_back(east);
+        xy.push_back(north);
+    }
+    out.details.enu.gates_xy = out.arena.copy_array(xy.data(), xy.size());
+
+    xy.clear();
+    for (const auto &route : ctx.routes) {
+        for (int node_id : {route.route_node_1, route.route_node_2}) {
+            auto node_it = out.routes_id.find(node_id);
+            double east = NAN, north = NAN;
+            if (node_it != out.routes_id.end()) {
+                frame.to_enu(node_it->second.lat, node_it->second.lon, east, north);
+            }
+            xy.push_back(east);
+            xy.push_back(north);
+        }
+    }
+    out.details.enu.routes_xy = out.arena.copy_array(xy.data(), xy.size());
+
+    out.taxi_graph.build(*ctx.arpt, out.routes_id, ctx.taxi_edges);
+    out.spatial_index.build(*ctx.arpt, out.details, frame);
+
+    // Approximation: arena chunks, taxi graph, spatial index, plus buckets and nodes of the route points map
+    out.memory_usage = sizeof(XPDataAptDetails) + out.arena.bytes_reserved() + out.taxi_graph.memory_usage() + out.spatial_index.memory_usage()
+                     + out.routes_id.bucket_count() * sizeof(void*)
+                     + out.routes_id.size() * (sizeof(decltype(out.routes_id)::value_type) + sizeof(void*));
 }
 
-void DataFileReader::parse_apts_details_linear_close(xpdata_apt_t *arpt, const std::vector<std::string> &splitted) {
+void DataFileReader::parse_apts_details_linear_close(AptDetailsContext &ctx, const std::vector<std::string> &splitted) {
 
     // Add the last node to the vector
-    this->parse_apts_details_linear_start(splitted);
+    this->parse_apts_details_linear_start(ctx, splitted);
     
     // And then save to XPData
-    parse_apts_details_save(arpt); 
+    parse_apts_details_save(ctx, true);
 }
 
-void DataFileReader::parse_apts_details_linear_end(xpdata_apt_t *arpt, const std::vector<std::string> &splitted) {
-    this->parse_apts_details_linear_close(arpt, splitted);  // At present their are handled in the same way
+void DataFileReader::parse_apts_details_linear_end(AptDetailsContext &ctx, const std::vector<std::string> &splitted) {
+    this->parse_apts_details_linear_start(ctx, splitted);
+    parse_apts_details_save(ctx, false);   // Same as close, but the path is open
 }
 
-void DataFileReader::parse_apts_details_beizer_close(xpdata_apt_t *arpt, const std::vector<std::string> &splitted) {
+void DataFileReader::parse_apts_details_beizer_close(AptDetailsContext &ctx, const std::vector<std::string> &splitted) {
 
     // Add the last node to the vector
-    this->parse_apts_details_beizer_start(splitted);
+    this->parse_apts_details_beizer_start(ctx, splitted);
     
     // And then save to XPData
-    parse_apts_details_save(arpt); 
+    parse_apts_details_save(ctx, true);
 }
 
-void DataFileReader::parse_apts_details_beizer_end(xpdata_apt_t *arpt, const std::vector<std::string> &splitted) {
-    this->parse_apts_details_beizer_close(arpt, splitted);  // At present their are handled in the same way
+void DataFileReader::parse_apts_details_beizer_end(AptDetailsContext &ctx, const std::vector<std::string> &splitted) {
+    this->parse_apts_details_beizer_start(ctx, splitted);
+    parse_apts_details_save(ctx, false);   // Same as close, but the path is open
 }
 
 
-void DataFileReader::parse_apts_details_route_point(xpdata_apt_t *arpt, const std::vector<std::string> &splitted) {
+void DataFileReader::parse_apts_details_route_point(AptDetailsContext &ctx, const std::vector<std::string> &splitted) {
     if (splitted.size() < 5) {
         return;     //  Should not happen
     }
@@ -739,21 +1086,30 @@ void DataFileReader::parse_apts_details_route_point(xpdata_apt_t *arpt, const st
     double lon   = std::stod(splitted[2]);
     int route_id = std::stoi(splitted[4]);
     
-    xpdata->push_apt_route_id(arpt, route_id, { .lat = lat, .lon = lon });
+    ctx.out->routes_id[route_id] = { .lat = lat, .lon = lon };
 }
 
-void DataFileReader::parse_apts_details_route_taxi(xpdata_apt_t *arpt, const std::vector<std::string> &splitted) {
+void DataFileReader::parse_apts_details_route_taxi(AptDetailsContext &ctx, const std::vector<std::string> &splitted) {
     if (splitted.size() < 6) {
         return;     //  Should not happen
     }
 
-    if (splitted[4] == "runway") {
-        return;     // I'm not interested in runway routes
+    const bool is_runway = splitted[4] == "runway";
+    ctx.taxi_edges.push_back({
+        .node_1 = std::stoi(splitted[1]),
+        .node_2 = std::stoi(splitted[2]),
+        .oneway = splitted[3] == "oneway",
+        .is_runway = is_runway,
+        .name = splitted[5],
+        .active_rwys = std::string()
+    });
+
+    if (is_runway) {
+        return;     // Only in the taxi graph, not in the routes
     }
 
-    all_string_container.emplace_back(splitted[5]);
-    const char* route_name = all_string_container.back().c_str();
-    int route_name_len = all_string_container.back().size();
+    const char* route_name = ctx.out->arena.copy_string(splitted[5].c_str(), splitted[5].size());
+    int route_name_len = splitted[5].size();
 
     xpdata_apt_route_t new_route = {
         .name = route_name,
@@ -762,10 +1118,27 @@ void DataFileReader::parse_apts_details_route_taxi(xpdata_apt_t *arpt, const std
         .route_node_2 = std::stoi(splitted[2])
     };
 
-    xpdata->push_apt_route_taxi(arpt, std::move(new_route));
+    ctx.routes.push_back(std::move(new_route));
+}
+
+void DataFileReader::parse_apts_details_route_zone(AptDetailsContext &ctx, const std::vector<std::string> &splitted) {
+    if (splitted.size() < 3 || ctx.taxi_edges.empty()) {
+        return;     //  Should not happen
+    }
+
+    if (splitted[1] != "departure" && splitted[1] != "ils") {
+        return;     // Arrival zones don't need a hold short
+    }
+
+    // The active zone applies to the last edge
+    std::string &active_rwys = ctx.taxi_edges.back().active_rwys;
+    if (!active_rwys.empty()) {
+        active_rwys += ',';
+    }
+    active_rwys += splitted[2];
 }
 
-bool DataFileReader::parse_apts_details_line(xpdata_apt_t * arpt, int line_no, const std::string &line) {
+bool DataFileReader::parse_apts_details_line(AptDetailsContext &ctx, int line_no, const std::string &line) {
     if (line.size() == 0) {
         return false;
     }
@@ -783,36 +1156,39 @@ bool DataFileReader::parse_apts_details_line(xpdata_apt_t * arpt, int line_no, c
             return true; // Airport header
         }
         else if (id == "14") { // Airport tower
-            parse_apts_details_tower(arpt, splitted);
+            parse_apts_details_tower(ctx, splitted);
         }
         else if (id == "110") { // Taxyways
-            apt_detail_status = ROW_TAXI;
+            ctx.status = ROW_TAXI;
+            ctx.surface = splitted.size() > 1 ? std::stoi(splitted[1]) : 0;
         } else if ( id == "120" ) { // Linear feature
-            apt_detail_status = ROW_LINE;
+            ctx.status = ROW_LINE;
         } else if ( id == "130" ) { // Linear feature
-            apt_detail_status = ROW_BOUND;
+            ctx.status = ROW_BOUND;
         } else if ( id == "111" ) {
-            parse_apts_details_linear_start(splitted);
+            parse_apts_details_linear_start(ctx, splitted);
         } else if ( id == "112" ) {
-            parse_apts_details_beizer_start(splitted);
+            parse_apts_details_beizer_start(ctx, splitted);
         } else if ( id == "113" ) {
-            parse_apts_details_linear_close(arpt, splitted);
-            apt_detail_status = ROW_HOLE;
+            parse_apts_details_linear_close(ctx, splitted);
+            ctx.status = ROW_HOLE;
         } else if ( id == "114" ) {
-            parse_apts_details_beizer_close(arpt, splitted);
-            apt_detail_status = ROW_HOLE;
+            parse_apts_details_beizer_close(ctx, splitted);
+            ctx.status = ROW_HOLE;
         } else if ( id == "115" ) {
-            parse_apts_details_linear_end(arpt, splitted);
-            apt_detail_status = ROW_HOLE;
+            parse_apts_details_linear_end(ctx, splitted);
+            ctx.status = ROW_HOLE;
         } else if ( id == "116" ) {
-            parse_apts_details_beizer_end(arpt, splitted);
-            apt_detail_status = ROW_HOLE;
+            parse_apts_details_beizer_end(ctx, splitted);
+            ctx.status = ROW_HOLE;
         } else if ( id == "1201" ) {
-            parse_apts_details_route_point(arpt, splitted);
+            parse_apts_details_route_point(ctx, splitted);
         } else if ( id == "1202" ) {
-            parse_apts_details_route_taxi(arpt, splitted);
+            parse_apts_details_route_taxi(ctx, splitted);
+        } else if ( id == "1204" ) {
+            parse_apts_details_route_zone(ctx, splitted);
         } else if ( id == "1300" ) {
-            parse_apts_details_arpt_gate(arpt, splitted);
+            parse_apts_details_arpt_gate(ctx, splitted);
         }
 
     } catch(const std::invalid_argument &e) {
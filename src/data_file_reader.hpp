@@ -2,12 +2,17 @@
 #define DATA_FILE_READER_H
 
 #include "utilities/logger.hpp"
+#include "constants.hpp"
 #include "xpdata.hpp"
 
 #include <condition_variable>
+#include <deque>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace avionicsbay {
 
@@ -18,19 +23,27 @@ public:
     virtual ~DataFileReader() {
         this->worker_stop();   // This is too late, but better than nothing
         this->my_thread.join();
+        for (auto &t : this->apt_details_threads) {
+            t.join();
+        }
     }
 
     void worker() noexcept;
     void worker_stop() noexcept {
         this->stop = true;
-        cv_apt_details.notify_one();
+        cv_worker.notify_all();
+        std::lock_guard<std::mutex> lk(mx_apt_details);
+        cv_apt_details.notify_all();
     }
     
     bool is_worker_running() {
         return this->running;
     }
 
-    void request_apts_details(const std::string &id) noexcept;
+    // Queues the loading of the airport details. A request for an airport already queued only
+    // raises its priority (APT_DETAILS_PRIO_*, lower is more urgent).
+    void request_apts_details(const std::string &id, int priority) noexcept;
+    int get_apts_details_status(const std::string &id) noexcept;   // APT_DETAILS_STATUS_*
 
 
 private:
@@ -42,23 +55,48 @@ private:
     
     std::string prev_awy_double_entry;
 
-    xpdata_apt_t *detail_arpt = nullptr;    // The airport to load the details
-    
     std::thread my_thread;
-
-    std::mutex mx_apt_details;
-    std::condition_variable cv_apt_details;
+    std::mutex mx_worker;
+    std::condition_variable cv_worker;
 
     static constexpr int ROW_NONE = 0;
     static constexpr int ROW_TAXI = 1;
     static constexpr int ROW_LINE = 2;
     static constexpr int ROW_BOUND = 3;
     static constexpr int ROW_HOLE = 4;
-    
-    int apt_detail_status = ROW_NONE;
-    bool apt_detail_is_in_hole = false;
-    int current_color = 0;
-    std::vector<xpdata_apt_node_t> curr_node_list;
+
+    // The parsing state of the details of one airport: each loader has its own
+    struct AptDetailsContext {
+        xpdata_apt_t *arpt;
+        int status = ROW_NONE;
+        int current_color = 0;
+        int surface = 0;                                                // Of the current pavement
+        std::vector<xpdata_apt_node_t> curr_node_list;
+        std::vector<xpdata_apt_node_array_t> *last_arrays = nullptr;   // Where the holes go
+
+        // Copied into the arena once their size is known
+        std::vector<xpdata_apt_node_array_t> pavements;
+        std::vector<int> pavements_surface;
+        std::vector<xpdata_apt_node_array_t> linear_features;
+        std::vector<bool> linear_features_closed;
+        std::vector<xpdata_apt_node_array_t> boundaries;
+        std::vector<xpdata_apt_gate_t> gates;
+        std::vector<xpdata_apt_route_t> routes;
+        std::vector<AptTaxiGraph::InputEdge> taxi_edges;                // Runway edges included
+
+        std::unique_ptr<XPDataAptDetails> out = std::make_unique<XPDataAptDetails>();
+    };
+
+    struct AptDetailsRequest {
+        int status;
+        int priority;
+    };
+
+    std::vector<std::thread> apt_details_threads;
+    std::mutex mx_apt_details;
+    std::condition_variable cv_apt_details;
+    std::deque<xpdata_apt_t*> apt_details_queue[APT_DETAILS_PRIO_PREFETCH+1];    // One per priority
+    std::unordered_map<const xpdata_apt_t*, AptDetailsRequest> apt_details_requests;
 
     void perform_init_checks();
 
@@ -72,20 +110,23 @@ private:
     void parse_apts_file_line(int line_no, ssize_t seek_pos, const std::string &line);
     void parse_apts_file_header(int line_no, ssize_t seek_pos, const std::vector<std::string> &splitted);
     void parse_apts_file_runway(int line_no, const std::vector<std::string> &splitted);
-    void parse_apts_details(xpdata_apt_t *detail_arpt);
-    bool parse_apts_details_line(xpdata_apt_t *, int line_no, const std::string &line); // Returns true if airport header found
-    void parse_apts_details_tower(xpdata_apt_t *detail_arpt, const std::vector<std::string> &splitted);
-    void parse_apts_details_linear_start(const std::vector<std::string> &splitted);
-    void parse_apts_details_beizer_start(const std::vector<std::string> &splitted);
-    void parse_apts_details_linear_close(xpdata_apt_t *arpt, const std::vector<std::string> &splitted);
-    void parse_apts_details_beizer_close(xpdata_apt_t *arpt, const std::vector<std::string> &splitted);
-    void parse_apts_details_linear_end(xpdata_apt_t *arpt, const std::vector<std::string> &splitted);
-    void parse_apts_details_beizer_end(xpdata_apt_t *arpt, const std::vector<std::string> &splitted);
-    void parse_apts_details_route_point(xpdata_apt_t *arpt, const std::vector<std::string> &splitted);
-    void parse_apts_details_route_taxi(xpdata_apt_t *arpt, const std::vector<std::string> &splitted);
-    void parse_apts_details_arpt_gate(xpdata_apt_t *arpt, const std::vector<std::string> &splitted);
-
-    void parse_apts_details_save(xpdata_apt_t *arpt);
+    void apt_details_worker() noexcept;
+    void parse_apts_details(AptDetailsContext &ctx);
+    bool parse_apts_details_line(AptDetailsContext &ctx, int line_no, const std::string &line); // Returns true if airport header found
+    void parse_apts_details_tower(AptDetailsContext &ctx, const std::vector<std::string> &splitted);
+    void parse_apts_details_linear_start(AptDetailsContext &ctx, const std::vector<std::string> &splitted);
+    void parse_apts_details_beizer_start(AptDetailsContext &ctx, const std::vector<std::string> &splitted);
+    void parse_apts_details_linear_close(AptDetailsContext &ctx, const std::vector<std::string> &splitted);
+    void parse_apts_details_beizer_close(AptDetailsContext &ctx, const std::vector<std::string> &splitted);
+    void parse_apts_details_linear_end(AptDetailsContext &ctx, const std::vector<std::string> &splitted);
+    void parse_apts_details_beizer_end(AptDetailsContext &ctx, const std::vector<std::string> &splitted);
+    void parse_apts_details_route_point(AptDetailsContext &ctx, const std::vector<std::string> &splitted);
+    void parse_apts_details_route_taxi(AptDetailsContext &ctx, const std::vector<std::string> &splitted);
+    void parse_apts_details_route_zone(AptDetailsContext &ctx, const std::vector<std::string> &splitted);
+    void parse_apts_details_arpt_gate(AptDetailsContext &ctx, const std::vector<std::string> &splitted);
+
+    void parse_apts_details_save(AptDetailsContext &ctx, bool closed);
+    void parse_apts_details_finalize(AptDetailsContext &ctx);
     
     void parse_mora_file();
     void parse_mora_line(int line_no, const std::string &line);
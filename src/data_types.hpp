@@ -3,7 +3,10 @@
 
 #include <cstdint>
 
+#include "constants.hpp"
+
 typedef int xpdata_navaid_type_t;
+typedef int xpdata_cifp_proc_type_t;
 
 typedef struct xpdata_coords_t {
     double lat;
@@ -60,6 +63,19 @@ typedef struct xpdata_apt_rwy_t {
     
 } xpdata_apt_rwy_t;
 
+typedef struct xpdata_apt_rwy_geom_t {
+    double length;                  // Threshold to threshold (m)
+    double true_heading;            // From coords to sibl_coords (deg)
+    double mag_heading;             // Magnetic heading, with the WMM declination at the threshold (deg)
+    double sibl_true_heading;       // From sibl_coords to coords (deg)
+    double sibl_mag_heading;        // Magnetic heading, with the WMM declination at the sibling threshold (deg)
+
+    xpdata_coords_t corners[4];     // Left and right of the threshold, then right and left of the
+                                    // sibling threshold (as seen along true_heading)
+    xpdata_coords_t ext_centerline[2];  // Extended centerline ends, APT_RWY_EXT_CENTERLINE_NM out
+                                        // of the threshold and of the sibling threshold
+} xpdata_apt_rwy_geom_t;
+
 typedef struct xpdata_apt_node_t {
 
     xpdata_coords_t coords;
@@ -90,6 +106,72 @@ typedef struct xpdata_apt_gate_t {
     xpdata_coords_t coords;
 } xpdata_apt_gate_t;
 
+// A point of a taxi route (see find_taxi_route())
+typedef struct xpdata_apt_taxi_point_t {
+    xpdata_coords_t coords;
+    const char *taxiway;    // Of the edge reaching this point (runway name when crossing a runway), nullptr for the first point
+    int taxiway_len;
+} xpdata_apt_taxi_point_t;
+
+// What is under a point of an airport (see get_apt_surface())
+typedef struct xpdata_apt_surface_t {
+    int pavement;           // Index in details.pavements, -1 if not on a pavement (the topmost one if they overlap)
+    int surface;            // Surface type of the pavement (apt.dat row 110)
+    int rwy;                // Index in rwys, -1 if not on a runway
+    int route;              // Index in details.routes of the nearest taxi route edge, -1 if none within 2 km
+    double route_dist;      // Distance from the route edge (m)
+} xpdata_apt_surface_t;
+
+// A level of detail of the layout of an airport: the Bezier curves flattened and the polylines
+// simplified within the tolerance of the level (see get_apt_tess_level()). The arrays are
+// parallel to the ones of xpdata_apt_details_t (same length and order) and contain no Bezier
+// nodes. Holes collapsed by the simplification are dropped, simplified rings never cross each
+// other. Closed linear features repeat their first node at the end.
+typedef struct xpdata_apt_tess_t {
+    xpdata_apt_node_array_t *pavements;
+    int pavements_len;
+
+    xpdata_apt_node_array_t *linear_features;
+    int linear_features_len;
+
+    xpdata_apt_node_array_t *boundaries;
+    int boundaries_len;
+} xpdata_apt_tess_t;
+
+// All the pavements of an airport merged in a single indexed mesh
+typedef struct xpdata_apt_mesh_t {
+    const xpdata_coords_t *vertices;
+    const float *vertices_xy;   // The same vertices in the local frame: 2 per vertex (see xpdata_apt_enu_t)
+    int vertices_len;
+
+    const uint32_t *indices;    // 3 per triangle, over vertices
+    int indices_len;
+
+    const int *surfaces;        // 1 per triangle: surface type of the pavement (apt.dat row 110)
+    const int *arrays;          // 1 per triangle: index of the source pavement
+    int triangles_len;
+} xpdata_apt_mesh_t;
+
+// A set of lines in the local frame of the airport
+typedef struct xpdata_apt_lines_xy_t {
+    const float *xy;            // 2 per point: east, north (m)
+    const int *start;           // First point of each line, start[len] is the total nr. of points
+    const int *array;           // Index of the source array of each line (holes share the index of their polygon)
+    int len;
+} xpdata_apt_lines_xy_t;
+
+// The geometry of the airport in a local East-North-Up frame: metres from apt_center (tangent
+// plane), as packed float32. Only a per-frame transform is needed to render it.
+typedef struct xpdata_apt_enu_t {
+    xpdata_coords_t origin;     // apt_center
+
+    xpdata_apt_lines_xy_t linear_features[APT_TESS_LEVELS];    // From tess, same index
+    xpdata_apt_lines_xy_t boundaries[APT_TESS_LEVELS];         // From tess, same index
+
+    const float *gates_xy;      // 2 per gate
+    const float *routes_xy;     // 4 per route: node 1 and node 2 (NaN if the node is unknown)
+} xpdata_apt_enu_t;
+
 typedef struct xpdata_apt_details_t {
     xpdata_coords_t tower_pos; 
 
@@ -108,6 +190,10 @@ typedef struct xpdata_apt_details_t {
     xpdata_apt_gate_t  *gates;
     int gates_len;
 
+    xpdata_apt_tess_t tess[APT_TESS_LEVELS];   // Index: level of detail, 0 is the finest
+    xpdata_apt_mesh_t pavements_mesh[APT_TESS_LEVELS];  // Built on tess, same index
+    xpdata_apt_enu_t enu;
+
 } xpdata_apt_details_t;
 
 typedef struct xpdata_apt_t {
@@ -120,6 +206,7 @@ typedef struct xpdata_apt_t {
     int altitude;
 
     const xpdata_apt_rwy_t *rwys;
+    const xpdata_apt_rwy_geom_t *rwys_geom;     // Parallel to rwys
     int rwys_len;
     
     xpdata_coords_t apt_center;
@@ -127,7 +214,8 @@ typedef struct xpdata_apt_t {
     long pos_seek;   // For internal use only, do not modify this value
     
     bool is_loaded_details;
-    xpdata_apt_details_t *details;
+    xpdata_apt_details_t *details;  // Valid only while is_loaded_details is true (details may be
+                                    // evicted, see set_apts_details_memory_budget())
     
 } xpdata_apt_t;
 
@@ -291,6 +379,21 @@ typedef struct xpdata_cifp_rwy_array_t {
     int len;
 } xpdata_cifp_rwy_array_t;
 
+typedef struct xpdata_cifp_ptr_array_t {
+    const struct xpdata_cifp_data_t * const * data;
+    int len;
+} xpdata_cifp_ptr_array_t;
+
+
+typedef struct xpdata_cifp_geometry_t {
+    const xpdata_coords_t *points;
+    const double *distances;        // Along-track distance from the first point (nm)
+    const int *legs;                // Index of the leg (in xpdata_cifp_data_t::legs) of each point
+    int len;
+    bool is_ready;                  // If false, the geometry is being computed: request it again later
+    bool not_found;                 // The airport is loaded but the procedure doesn't exist (or the
+                                    // CIFP failed to load): is_ready is true and len is 0
+} xpdata_cifp_geometry_t;
 
 typedef struct xpdata_cifp_t {
     xpdata_cifp_array_t sids;
@@ -299,4 +402,33 @@ typedef struct xpdata_cifp_t {
     xpdata_cifp_rwy_array_t rwys;   // This contains extra info compared to no-cifp data
 } xpdata_cifp_t;
 
+/******************************* QUERIES *******************************/
+typedef struct xpdata_query_t {
+    int type;                       // Constants QUERY_*
+    xpdata_navaid_type_t navaid_type;   // Navaid queries only
+    const char *name;               // Key of the *_BY_NAME queries
+    unsigned int freq;              // Key of QUERY_NAVAID_BY_FREQ
+    xpdata_coords_t coords;         // Key of the *_BY_COORDS queries
+    bool use_ref;                   // If true, the result has the record closest to ref
+    xpdata_coords_t ref;
+} xpdata_query_t;
+
+typedef struct xpdata_query_result_t {
+    const void * const * records;   // xpdata_navaid_t, xpdata_fix_t or xpdata_apt_t, by query type
+    int len;
+    int nearest;                    // Index in records of the closest to ref, -1 if not requested
+} xpdata_query_result_t;
+
+/******************************* EVENTS ********************************/
+typedef struct xpdata_event_t {
+    int type;                       // Constants EVENT_*
+    int value;                      // EVENT_APT_DETAILS, EVENT_CIFP_LOADED: APT_DETAILS_STATUS_LOADED
+                                    // or _FAILED (the CIFP is then empty), EVENT_LOST: number of
+                                    // events dropped
+    const xpdata_apt_t *apt;        // EVENT_APT_DETAILS, EVENT_NEAREST_APT (may be NULL), and
+                                    // EVENT_CIFP_LOADED if the airport is in the database
+    char apt_id[8];                 // EVENT_CIFP_LOADED, NUL-terminated: empty when the bulk
+                                    // database (load_all_cifp()) is ready
+} xpdata_event_t;
+
 #endif // DATA_TYPES_H
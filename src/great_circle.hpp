@@ -0,0 +1,64 @@
+#ifndef GREAT_CIRCLE_H
+#define GREAT_CIRCLE_H
+
+#include "data_types.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#define EARTH_RADIUS_NM 3440.065
+
+namespace avionicsbay {
+
+// Spherical Earth: enough for navigation displays, not for surveying
+
+constexpr double DEG2RAD = M_PI / 180.;
+constexpr double RAD2DEG = 180. / M_PI;
+
+inline double normalize_deg(double deg) {
+    deg = std::fmod(deg, 360.);
+    return deg < 0 ? deg + 360. : deg;
+}
+
+inline double gc_distance_nm(const xpdata_coords_t &a, const xpdata_coords_t &b) {
+    double dlat = (b.lat - a.lat) * DEG2RAD;
+    double dlon = (b.lon - a.lon) * DEG2RAD;
+    double h = std::sin(dlat/2) * std::sin(dlat/2) + std::cos(a.lat * DEG2RAD) * std::cos(b.lat * DEG2RAD) * std::sin(dlon/2) * std::sin(dlon/2);
+    return 2 * EARTH_RADIUS_NM * std::asin(std::sqrt(std::min(1., h)));
+}
+
+inline double gc_bearing(const xpdata_coords_t &a, const xpdata_coords_t &b) {
+    double dlon = (b.lon - a.lon) * DEG2RAD;
+    double y = std::sin(dlon) * std::cos(b.lat * DEG2RAD);
+    double x = std::cos(a.lat * DEG2RAD) * std::sin(b.lat * DEG2RAD) - std::sin(a.lat * DEG2RAD) * std::cos(b.lat * DEG2RAD) * std::cos(dlon);
+    return normalize_deg(std::atan2(y, x) * RAD2DEG);
+}
+
+inline xpdata_coords_t gc_destination(const xpdata_coords_t &a, double bearing, double dist_nm) {
+    double d = dist_nm / EARTH_RADIUS_NM;
+    double brg = bearing * DEG2RAD;
+    double lat1 = a.lat * DEG2RAD;
+    double lon1 = a.lon * DEG2RAD;
+    double lat2 = std::asin(std::sin(lat1) * std::cos(d) + std::cos(lat1) * std::sin(d) * std::cos(brg));
+    double lon2 = lon1 + std::atan2(std::sin(brg) * std::sin(d) * std::cos(lat1), std::cos(d) - std::sin(lat1) * std::sin(lat2));
+    return {lat2 * RAD2DEG, normalize_deg(lon2 * RAD2DEG + 180.) - 180.};
+}
+
+inline xpdata_coords_t gc_intermediate(const xpdata_coords_t &a, const xpdata_coords_t &b, double f) {
+    double d = gc_distance_nm(a, b) / EARTH_RADIUS_NM;
+    if (d < 1e-9) {
+        return a;
+    }
+    double lat1 = a.lat * DEG2RAD, lon1 = a.lon * DEG2RAD;
+    double lat2 = b.lat * DEG2RAD, lon2 = b.lon * DEG2RAD;
+    double A = std::sin((1-f) * d) / std::sin(d);
+    double B = std::sin(f * d) / std::sin(d);
+    double x = A * std::cos(lat1) * std::cos(lon1) + B * std::cos(lat2) * std::cos(lon2);
+    double y = A * std::cos(lat1) * std::sin(lon1) + B * std::cos(lat2) * std::sin(lon2);
+    double z = A * std::sin(lat1) + B * std::sin(lat2);
+    return {std::atan2(z, std::sqrt(x*x + y*y)) * RAD2DEG, std::atan2(y, x) * RAD2DEG};
+}
+
+} // namespace avionicsbay
+
+#endif // GREAT_CIRCLE_H
@@ -10,11 +10,14 @@
 
 #define LOG *logger << avionicsbay::STARTL
 
+using avionicsbay::CIFPGeometry;
 using avionicsbay::CIFPParser;
 using avionicsbay::Logger;
 using avionicsbay::ENDL;
 using avionicsbay::logger_level_t;
 using avionicsbay::DataFileReader;
+using avionicsbay::EpochReclaimer;
+using avionicsbay::EventQueue;
 using avionicsbay::XPData;
 
 static std::string fatal_error;
@@ -25,9 +28,12 @@ static std::mutex mx_acf_lat_lon;
 
 static std::shared_ptr<Logger> logger;
 static std::shared_ptr<XPData> xpdata;
+static std::shared_ptr<EpochReclaimer> reclaimer;
+static std::shared_ptr<EventQueue> events;
 
 static std::shared_ptr<DataFileReader> dfr;
 static std::shared_ptr<CIFPParser> cifp;
+static std::shared_ptr<CIFPGeometry> cifp_geometry;
 
 namespace avionicsbay {
     std::shared_ptr<Logger> get_logger() noexcept {
@@ -46,6 +52,24 @@ namespace avionicsbay {
         return cifp;
     }
 
+    std::shared_ptr<CIFPGeometry> get_cifp_geometry() noexcept {
+        return cifp_geometry;
+    }
+
+    std::shared_ptr<EpochReclaimer> get_reclaimer() noexcept {
+        return reclaimer;
+    }
+
+    std::shared_ptr<EventQueue> get_events() noexcept {
+        return events;
+    }
+
+    void push_event(const xpdata_event_t &event) noexcept {
+        if (events) {
+            events->push(event);    // If full, dropped and reported by poll_events()
+        }
+    }
+
     void set_acf_cur_pos(double lat, double lon) noexcept {
         std::lock_guard<std::mutex> lk(mx_acf_lat_lon);
         acf_lat = lat;
@@ -94,8 +118,15 @@ bool initialize(const char* xplane_path, const char* plane_path) {
     LOG << logger_level_t::INFO << "Initializing avionicsbay..." << ENDL;
     LOG << logger_level_t::INFO << "Version: " << AVIONICSBAY_VERSION << " - Commit Hash: " << GIT_COMMIT_HASH << ENDL;
     
+    reclaimer = std::make_shared<EpochReclaimer>();
+    events = std::make_shared<EventQueue>();
     xpdata = std::make_shared<XPData>();
 
+    // Before the DataFileReader: the runway headings need the declination
+    if (! avionicsbay::init_wmm_interface(plane_path)) {
+        return false;
+    }
+
     if (! avionicsbay::init_data_file_reader(xplane_path)) {
         return false;
     }
@@ -104,9 +135,7 @@ bool initialize(const char* xplane_path, const char* plane_path) {
         return false;
     }
 
-    if (! avionicsbay::init_wmm_interface(plane_path)) {
-        return false;
-    }
+    cifp_geometry = std::make_shared<CIFPGeometry>();
 
     avionicsbay::api_init();
 
@@ -130,4 +159,8 @@ void terminate(void) {
     }
     dfr.reset();    // This will join()
     LOG << logger_level_t::DEBUG << "DFR Terminated." << ENDL;
+    cifp_geometry.reset();  // This will join() the geometry thread
+    cifp.reset();   // This will join() the loader threads
+    LOG << logger_level_t::DEBUG << "CIFP Terminated." << ENDL;
+    avionicsbay::terminate_wmm_interface();
 }
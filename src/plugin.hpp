@@ -8,9 +8,12 @@
 #endif
 
 #include "xpdata.hpp"
+#include "cifp_geometry.hpp"
 #include "cifp_parser.hpp"
 #include "data_file_reader.hpp"
+#include "utilities/epoch_reclaimer.hpp"
 #include "utilities/logger.hpp"
+#include "utilities/mpsc_queue.hpp"
 
 #ifndef GIT_COMMIT_HASH
 #define GIT_COMMIT_HASH "Unknown"
@@ -21,10 +24,17 @@
 
 namespace avionicsbay {
 
+    // Notifications for the user plugin, drained by poll_events()
+    using EventQueue = MPSCQueue<xpdata_event_t, 256>;
+
     std::shared_ptr<Logger> get_logger() noexcept;
     std::shared_ptr<XPData> get_xpdata() noexcept;
     std::shared_ptr<DataFileReader> get_dfr() noexcept;
     std::shared_ptr<CIFPParser> get_cifp() noexcept;
+    std::shared_ptr<CIFPGeometry> get_cifp_geometry() noexcept;
+    std::shared_ptr<EpochReclaimer> get_reclaimer() noexcept;
+    std::shared_ptr<EventQueue> get_events() noexcept;
+    void push_event(const xpdata_event_t &event) noexcept;
     
     void set_acf_cur_pos(double lat, double lon) noexcept;
     std::pair<double, double> get_acf_cur_pos() noexcept;
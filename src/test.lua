@@ -6,51 +6,59 @@ local PATH_LIBRARY = "./build/libavionicsbay.so"
 local PATH_XPLANE  = "/usr/share/X-Plane 11/"
 local PATH_LOGFILE = "/usr/share/X-Plane 11/Aircraft/Downloaded/A321Neo-FXPL/"
 
-local AvionicsBay = {}
+local EVENT_DATA_READY  = 0     -- constants.hpp
+local EVENT_CIFP_LOADED = 1
+local EVENT_APT_DETAILS = 2
+local EVENT_NEAREST_APT = 3
 
-local function convert_cifp_array(rawdata, cifp_arr)
-    if rawdata then
-        return {
-            data = cifp_arr.data,
-            len  = cifp_arr.len
-        }
-    end
-    
-    local to_return = {}
-    for i=1,cifp_arr.len do
-        local new_dat =  {
-            proc_name   = ffi.string(cifp_arr.data[i-1].proc_name,  cifp_arr.data[i-1].proc_name_len),
-            trans_name  = ffi.string(cifp_arr.data[i-1].trans_name,  cifp_arr.data[i-1].trans_name_len),
-            legs = {}
-        }
-        
-        for j=1,cifp_arr.data[i-1].legs_len do
-            local l = cifp_arr.data[i-1].legs[j-1]
-            table.insert(new_dat.legs, {
-                leg_name = ffi.string(l.leg_name, l.leg_name_len),
-                turn_direction = l.turn_direction,
-                leg_type = l.leg_type,
-                radius = l.radius,
-                theta = l.theta,
-                rho = l.rho,
-                outb_mag = l.outb_mag,
-                rte_hold = l.rte_hold,
-                outb_mag_in_true = l.outb_mag_in_true,
-                rte_hold_in_time = l.rte_hold_in_time,
-                cstr_alt_type = l.cstr_alt_type,
-                cstr_altitude1 = l.cstr_altitude1,
-                cstr_altitude2 = l.cstr_altitude2,
-                cstr_speed_type = l.cstr_speed_type,
-                cstr_speed = l.cstr_speed,
-                center_fix = ffi.string(l.center_fix, l.center_fix_len)
-            })
+local APT_DETAILS_STATUS_FAILED = 4
+
+local NAV_ID_VOR           = 3
+local QUERY_NAVAID_BY_NAME = 0
+local QUERY_FIX_BY_NAME    = 3
+local QUERY_APT_BY_NAME    = 5
+
+local AvionicsBay = {}
+local views
+
+-- Events received so far, by type and by type:airport
+local events_seen = {}
+local events_buffer
+
+local function wait_event(type, apt_id)
+    local key = apt_id and (type .. ":" .. apt_id) or type
+    while events_seen[key] == nil do
+        local n = AvionicsBay.c.poll_events(events_buffer, 16)
+        for i=0,n-1 do
+            local e = ffi.new("xpdata_event_t", events_buffer[i])   -- The buffer is reused
+            local id = e.apt ~= nil and ffi.string(e.apt.id, e.apt.id_len) or ffi.string(e.apt_id)
+            events_seen[e.type] = e
+            events_seen[e.type .. ":" .. id] = e
         end
-        
-        table.insert(to_return, new_dat)
     end
-    return to_return
+    return events_seen[key]
 end
-    
+
+-- Average time of a call of f (us), after a warm-up call (that also lets the JIT compile it)
+local function time_us(label, reps, f)
+    f()
+    local start = os.clock()
+    for _=1,reps do
+        f()
+    end
+    print(label .. ": " .. string.format("%.1f", (os.clock() - start) * 1e6 / reps) .. " us")
+end
+
+-- Memory allocated by f (KB), with the GC stopped: what the collector will have to reclaim
+local function gc_pressure(label, f)
+    collectgarbage("collect")
+    collectgarbage("stop")
+    local before = collectgarbage("count")
+    f()
+    print(label .. ": " .. math.floor(collectgarbage("count") - before) .. " KB")
+    collectgarbage("restart")
+end
+
 local function expose_functions()
 
     AvionicsBay.is_initialized = function()
@@ -100,8 +108,10 @@ end
 
 local function load_avionicsbay()
     ffi.cdef(require("avionicsbay_lua_include"))
+    views = require("avionicsbay_lua_views")
     AvionicsBay.c = ffi.load(PATH_LIBRARY)
     
+    views.reset()
     if AvionicsBay.c.initialize(PATH_XPLANE, PATH_LOGFILE) then
         initialized = true
         print("Initialized")
@@ -118,13 +128,14 @@ local function load_avionicsbay()
     print("Test declination: ", AvionicsBay.c.get_declination(5, -30, 2020))
 
     print("WAIT")
-    while not AvionicsBay.c.xpdata_is_ready() do
-    end
+    events_buffer = ffi.new("xpdata_event_t[16]")
+    wait_event(EVENT_DATA_READY)
     print("READY")
 
     AvionicsBay.c.load_cifp("LIML")
     print("WAIT CIFP")
-    while not AvionicsBay.c.is_cifp_ready() do
+    if wait_event(EVENT_CIFP_LOADED, "LIML").value == APT_DETAILS_STATUS_FAILED then
+        print("CIFP NOT LOADED")
     end
     print("READY CIFP")
     a = AvionicsBay.c.get_cifp("LIML")
@@ -138,24 +149,29 @@ local function load_avionicsbay()
         print(i, ffi.string(x.proc_name), ffi.string(x.trans_name), x.legs_len)
     end
 
-    local x = convert_cifp_array(false, a.sids)
-    local x = convert_cifp_array(false, a.stars)
-    local x = convert_cifp_array(false, a.apprs)
+    -- Lazy views vs. copies of all the procedures and legs
+    gc_pressure("CIFP views, names of the approaches", function()
+        local cifp = views.cifp(a)
+        for _, appr in cifp.apprs:iter() do
+            local _ = appr.proc_name .. appr.trans_name .. appr.legs.len
+        end
+    end)
+    gc_pressure("CIFP copies", function()
+        local cifp = views.cifp(a)
+        local _ = {cifp.sids:to_table(), cifp.stars:to_table(), cifp.apprs:to_table()}
+    end)
 
     print("TRANS ALT: " .. a.sids.data[1].transition_altitude);
 
     print(AvionicsBay.test())
     
-    while AvionicsBay.c.get_nearest_apt() == nil do
-    end
-    
-    print(ffi.string(AvionicsBay.c.get_nearest_apt().id))
+    local nearest = wait_event(EVENT_NEAREST_APT).apt
+    print(nearest ~= nil and ffi.string(nearest.id, nearest.id_len) or "No nearest airport")
 
     print("Loading details...")
     AvionicsBay.c.request_apts_details("LIRF");
     
-    while not AvionicsBay.c.get_apts_by_name("LIRF").apts[0].is_loaded_details do
-    end
+    wait_event(EVENT_APT_DETAILS, "LIRF")
     print("Loaded...")
 
     local airport = AvionicsBay.c.get_apts_by_name("LIRF").apts[0];
@@ -190,6 +206,41 @@ local function load_avionicsbay()
     print("Nr AWY#2: " .. awy_2.len)
     print("Nr AWY#3: " .. awy_3.len)
 
+    -- 100 lookups: one FFI call each vs. a single query_batch()
+    local names = {"SRN", "ROMEO", "LIML", "MXP", "BOPUT", "LIRF", "OST", "CANEL", "LIMC", "XXXX"}
+    local query_types = {QUERY_NAVAID_BY_NAME, QUERY_FIX_BY_NAME, QUERY_APT_BY_NAME}
+    local queries = ffi.new("xpdata_query_t[100]")
+    local results = ffi.new("xpdata_query_result_t[100]")
+    for i=0,99 do
+        queries[i].type = query_types[i % 3 + 1]
+        queries[i].navaid_type = NAV_ID_VOR
+        queries[i].name = names[i % #names + 1]    -- Kept alive by names
+    end
+
+    time_us("100 single lookups", 100, function()
+        local found = 0
+        for i=0,99 do
+            local name = names[i % #names + 1]
+            local t = query_types[i % 3 + 1]
+            if t == QUERY_NAVAID_BY_NAME then
+                found = found + AvionicsBay.c.get_navaid_by_name(NAV_ID_VOR, name).len
+            elseif t == QUERY_FIX_BY_NAME then
+                found = found + AvionicsBay.c.get_fixes_by_name(name).len
+            else
+                found = found + AvionicsBay.c.get_apts_by_name(name).len
+            end
+        end
+        return found
+    end)
+    time_us("100 lookups in a query_batch()", 100, function()
+        AvionicsBay.c.query_batch(queries, 100, results)
+        local found = 0
+        for i=0,99 do
+            found = found + results[i].len
+        end
+        return found
+    end)
+
 
     AvionicsBay.c.terminate()
     
@@ -1,75 +1,97 @@
 #include "triangulator.hpp"
 
 #include "utilities/earcut.hpp"
+#include "plugin.hpp"
 
 #include <array>
-#include <iostream>
+
+#define TRIANGULATOR_CACHE_SIZE 4096    // Max nr. of node arrays cached
 
 namespace avionicsbay {
 
-const std::vector<xpdata_coords_t> empty_vector;
+void Triangulator::triangulate_indices(const xpdata_apt_node_array_t &array, std::vector<uint32_t> &indices) {
+    using Coord = double;
+    using Point = std::array<Coord, 2>;
+    std::vector<std::vector<Point>> full_dataset;
 
-const std::vector<xpdata_coords_t> & Triangulator::triangulate(const xpdata_apt_node_array_t* array) {
-    if (array == nullptr) {    // Uh?
-        return empty_vector;
-    }
-    
-    if (array->nodes_len == 0) {    // Uh?
-        return empty_vector;
+    for (const xpdata_apt_node_array_t *ring = &array; ring != nullptr; ring = ring->hole) {
+        std::vector<Point> polygon;
+        polygon.reserve(ring->nodes_len);
+        for (int i=0; i < ring->nodes_len; i++) {
+            polygon.push_back({ring->nodes[i].coords.lat, ring->nodes[i].coords.lon});
+        }
+        full_dataset.push_back(std::move(polygon));
     }
 
-    if (previous_data.count(array) > 0) {
-        return previous_data.at(array);
+    triangulate_rings(full_dataset, indices);
+}
+
+void Triangulator::triangulate_rings(const std::vector<std::vector<std::array<double, 2>>> &rings, std::vector<uint32_t> &indices) {
+    indices = mapbox::earcut<uint32_t>(rings);
+}
+
+std::shared_ptr<const std::vector<xpdata_coords_t>> Triangulator::triangulate(const xpdata_apt_node_array_t* array) {
+    if (array == nullptr || array->nodes_len == 0) {    // Uh?
+        return nullptr;
     }
-    
-    using Coord = double;
-    using N = uint_fast16_t;
-    using Point = std::array<Coord, 2>;
-    std::vector<std::vector<Point>> full_dataset;
 
-    std::vector<Point> real_polygon;
-    for (int i=0; i < array->nodes_len; i++) {
-        Point p = {array->nodes[i].coords.lat, array->nodes[i].coords.lon};
-        real_polygon.push_back(std::move(p));
+    {
+        std::lock_guard<std::mutex> lk(mx);
+        auto it = previous_data.find(array);
+        if (it != previous_data.end() && it->second.nodes == array->nodes && it->second.nodes_len == array->nodes_len) {
+            it->second.last_access = ++access_counter;
+            return it->second.vertices;
+        }
     }
-    
-    full_dataset.push_back(real_polygon);
-    
-    xpdata_apt_node_array_t *curr_hole = array->hole;
-    while (curr_hole != nullptr) {
-        std::vector<Point> hole_polygon;
-        for (int i=0; i < curr_hole->nodes_len; i++) {
-            hole_polygon.push_back({curr_hole->nodes[i].coords.lat, curr_hole->nodes[i].coords.lon});
+
+    // Not cached: triangulate outside the lock
+    std::vector<uint32_t> indices;
+    triangulate_indices(*array, indices);
+
+    std::vector<const xpdata_apt_node_t*> all_nodes;    // The nodes as numbered by the indices
+    for (const xpdata_apt_node_array_t *ring = array; ring != nullptr; ring = ring->hole) {
+        for (int i=0; i < ring->nodes_len; i++) {
+            all_nodes.push_back(&ring->nodes[i]);
         }
-        
-        full_dataset.push_back(std::move(hole_polygon));
-        
-        curr_hole = curr_hole->hole;
     }
 
-    std::vector<N> indices = mapbox::earcut<N>(full_dataset);
-    
+    auto vertices = std::make_shared<std::vector<xpdata_coords_t>>();
+    vertices->reserve(indices.size());
     for (auto i : indices) {
-        
-        if (i < array->nodes_len) {
-        
-            previous_data[array].push_back(array->nodes[i].coords);
-        
+        vertices->push_back(all_nodes[i]->coords);
+    }
+
+    std::lock_guard<std::mutex> lk(mx);
+    auto &cached = previous_data[array];
+    if (cached.vertices) {
+        // Stale, the user may still hold it: never released if it doesn't declare quiescent states
+        auto reclaimer = get_reclaimer();   // Null before initialize(): inactive
+        if (reclaimer && reclaimer->is_active()) {
+            reclaimer->retire(std::move(cached.vertices));
         } else {
-            i = i - array->nodes_len;
-            xpdata_apt_node_array_t *curr_hole = array->hole;
-            while (i >= curr_hole->nodes_len) {
-                i = i - curr_hole->nodes_len;
-                curr_hole = curr_hole->hole;
-            }
-            
-            previous_data[array].push_back(curr_hole->nodes[i].coords);
+            unreclaimed.push_back(std::move(cached.vertices));
         }
-    
-        
     }
+    cached = { std::move(vertices), array->nodes, array->nodes_len, ++access_counter };
+    evict_over_size();
+    return cached.vertices;
+}
 
-    return previous_data[array];
+void Triangulator::evict_over_size() noexcept {
+    auto reclaimer = get_reclaimer();
+    if (!reclaimer || !reclaimer->is_active()) {
+        return;     // The results must stay valid forever
+    }
+    while (previous_data.size() > TRIANGULATOR_CACHE_SIZE) {
+        auto lru_it = previous_data.begin();
+        for (auto it = previous_data.begin(); it != previous_data.end(); ++it) {
+            if (it->second.last_access < lru_it->second.last_access) {
+                lru_it = it;
+            }
+        }
+        reclaimer->retire(std::move(lru_it->second.vertices));
+        previous_data.erase(lru_it);
+    }
 }
 
 } // avionicsbay
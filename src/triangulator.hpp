@@ -1,8 +1,13 @@
 #ifndef TRIANGULATOR_H
 #define TRIANGULATOR_H
 
+#include "utilities/epoch_reclaimer.hpp"
 #include "data_types.hpp"
 
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -11,14 +16,34 @@ namespace avionicsbay {
 class Triangulator {
 
 public:
-    const std::vector<xpdata_coords_t> & triangulate(const xpdata_apt_node_array_t*);
+    // Indices (3 per triangle) over the nodes of the array followed by the nodes of its holes,
+    // in chain order. Stateless, it can be called from any thread.
+    static void triangulate_indices(const xpdata_apt_node_array_t &array, std::vector<uint32_t> &indices);
 
-private:
-    std::unordered_map<const xpdata_apt_node_array_t*, std::vector<xpdata_coords_t>> previous_data;
+    // Same, for rings already converted to planar coordinates: the outer one first, then the holes
+    static void triangulate_rings(const std::vector<std::vector<std::array<double, 2>>> &rings, std::vector<uint32_t> &indices);
+
+    // Three vertices per triangle. Thread-safe: the results are cached. Once the user plugin
+    // declares quiescent states, they are evicted over TRIANGULATOR_CACHE_SIZE arrays and
+    // released through the reclaimer; until then they are kept forever.
+    std::shared_ptr<const std::vector<xpdata_coords_t>> triangulate(const xpdata_apt_node_array_t*);
 
+private:
+    struct CachedTriangulation {
+        std::shared_ptr<const std::vector<xpdata_coords_t>> vertices;
+        const xpdata_apt_node_t *nodes;     // To detect an array reallocated at the same address
+        int nodes_len;
+        uint64_t last_access;
+    };
+
+    std::mutex mx;
+    std::unordered_map<const xpdata_apt_node_array_t*, CachedTriangulation> previous_data;
+    uint64_t access_counter = 0;
+    std::vector<std::shared_ptr<const std::vector<xpdata_coords_t>>> unreclaimed;  // Stale, without quiescent states
+
+    void evict_over_size() noexcept;    // mx must be held
 };
 
 
 } // avionicsbay
 #endif
-
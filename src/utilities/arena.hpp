@@ -0,0 +1,78 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace avionicsbay {
+
+// A simple chunked bump allocator. Objects allocated here are never destroyed singularly: the
+// whole memory is released when the arena is destroyed. Only trivially destructible types can
+// be stored in the arena.
+class Arena {
+public:
+    explicit Arena(size_t chunk_size = 16 * 1024) noexcept : chunk_size(chunk_size) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        size_t offset = (curr_used + align - 1) & ~(align - 1);
+        if (chunks.empty() || offset + size > curr_size) {
+            new_chunk(size + align);
+            offset = (curr_used + align - 1) & ~(align - 1);
+        }
+        curr_used = offset + size;
+        return chunks.back().get() + offset;
+    }
+
+    template<typename T>
+    T* allocate_array(size_t n) {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena objects are never destroyed");
+        if (n == 0) {
+            return nullptr;
+        }
+        return static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+    }
+
+    template<typename T>
+    T* copy_array(const T* src, size_t n) {
+        T* dst = allocate_array<T>(n);
+        if (n > 0) {
+            std::memcpy(dst, src, n * sizeof(T));
+        }
+        return dst;
+    }
+
+    // Returns a null-terminated copy of the string
+    const char* copy_string(const char* str, size_t len) {
+        char* dst = static_cast<char*>(allocate(len + 1, 1));
+        std::memcpy(dst, str, len);
+        dst[len] = '\0';
+        return dst;
+    }
+
+    size_t bytes_reserved() const noexcept { return reserved; }
+
+private:
+    size_t chunk_size;
+    std::vector<std::unique_ptr<char[]>> chunks;
+    size_t curr_size = 0;
+    size_t curr_used = 0;
+    size_t reserved  = 0;
+
+    void new_chunk(size_t min_size) {
+        curr_size = std::max(chunk_size, min_size);
+        chunks.emplace_back(new char[curr_size]);
+        curr_used = 0;
+        reserved += curr_size;
+    }
+};
+
+} // namespace avionicsbay
+
+#endif // ARENA_H
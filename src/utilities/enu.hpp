@@ -0,0 +1,52 @@
+#ifndef ENU_H
+#define ENU_H
+
+#include <cmath>
+
+namespace avionicsbay {
+
+// Local East-North-Up frame tangent to the WGS84 ellipsoid at an origin. Points are taken at
+// zero height and only the horizontal components are returned: at airport scale the planar
+// error is negligible.
+class EnuFrame {
+public:
+    EnuFrame(double lat0, double lon0) noexcept {
+        const double lat = lat0 * M_PI / 180.;
+        const double lon = lon0 * M_PI / 180.;
+        sin_lat = std::sin(lat);
+        cos_lat = std::cos(lat);
+        sin_lon = std::sin(lon);
+        cos_lon = std::cos(lon);
+        to_ecef(lat0, lon0, x0, y0, z0);
+    }
+
+    void to_enu(double lat, double lon, double &east, double &north) const noexcept {
+        double x, y, z;
+        to_ecef(lat, lon, x, y, z);
+        x -= x0;
+        y -= y0;
+        z -= z0;
+        east  = -sin_lon * x + cos_lon * y;
+        north = -sin_lat * cos_lon * x - sin_lat * sin_lon * y + cos_lat * z;
+    }
+
+private:
+    static constexpr double WGS84_A  = 6378137.0;
+    static constexpr double WGS84_E2 = 6.69437999014e-3;
+
+    double sin_lat, cos_lat, sin_lon, cos_lon;
+    double x0, y0, z0;
+
+    static void to_ecef(double lat_deg, double lon_deg, double &x, double &y, double &z) noexcept {
+        const double lat = lat_deg * M_PI / 180.;
+        const double lon = lon_deg * M_PI / 180.;
+        const double n = WGS84_A / std::sqrt(1. - WGS84_E2 * std::sin(lat) * std::sin(lat));
+        x = n * std::cos(lat) * std::cos(lon);
+        y = n * std::cos(lat) * std::sin(lon);
+        z = n * (1. - WGS84_E2) * std::sin(lat);
+    }
+};
+
+} // namespace avionicsbay
+
+#endif // ENU_H
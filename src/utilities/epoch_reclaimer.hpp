@@ -0,0 +1,62 @@
+#ifndef EPOCH_RECLAIMER_H
+#define EPOCH_RECLAIMER_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace avionicsbay {
+
+// Deferred reclamation of data that may still be referenced by raw pointers given to the user
+// plugin. The user plugin (the only reader outside the library) periodically declares a
+// quiescent state, i.e. a point where it does not hold pointers obtained before that call
+// (typically once per frame). An object retired during epoch E is released only when the
+// epoch has been advanced GRACE_EPOCHS times, so any pointer read before the retirement has
+// gone out of use. Library threads keep their own std::shared_ptr copies and are not affected.
+class EpochReclaimer {
+public:
+    static constexpr uint64_t GRACE_EPOCHS = 2;
+
+    void retire(std::shared_ptr<const void> obj) {
+        std::lock_guard<std::mutex> lk(mx);
+        retired.emplace_back(epoch, std::move(obj));
+    }
+
+    void quiescent_state() {
+        active.store(true, std::memory_order_relaxed);
+        std::deque<std::pair<uint64_t, std::shared_ptr<const void>>> to_release;
+        {
+            std::lock_guard<std::mutex> lk(mx);
+            epoch++;
+            while (!retired.empty() && retired.front().first + GRACE_EPOCHS <= epoch) {
+                to_release.push_back(std::move(retired.front()));
+                retired.pop_front();
+            }
+        }
+        // to_release is destroyed here, outside the lock
+    }
+
+    // True once the user plugin has declared a quiescent state: before that, anything retired is
+    // never released, and caches holding data for the user should not evict at all
+    bool is_active() const noexcept {
+        return active.load(std::memory_order_relaxed);
+    }
+
+    uint64_t get_epoch() const {
+        std::lock_guard<std::mutex> lk(mx);
+        return epoch;
+    }
+
+private:
+    mutable std::mutex mx;
+    uint64_t epoch = 0;
+    std::atomic<bool> active{false};
+    std::deque<std::pair<uint64_t, std::shared_ptr<const void>>> retired;
+};
+
+} // namespace avionicsbay
+
+#endif // EPOCH_RECLAIMER_H
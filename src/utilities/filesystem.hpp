@@ -1,6 +1,10 @@
+#include <dirent.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include <string>
+#include <vector>
+
 inline bool is_a_directory(const std::string& name) noexcept {
     struct stat info;
     if( stat( name.c_str(), &info ) != 0 ) {
@@ -22,3 +26,30 @@ inline bool is_a_file (const std::string& name) noexcept {
         return false;
     }
 }
+
+inline bool get_file_info(const std::string& name, long long &size, long long &mtime) noexcept {
+    struct stat info;
+    if( stat( name.c_str(), &info ) != 0 ) {
+        return false;
+    }
+    size  = info.st_size;
+    mtime = info.st_mtime;
+    return true;
+}
+
+// Names of the entries of a directory (without . and ..), empty if the directory is not accessible
+inline std::vector<std::string> list_directory(const std::string& name) {
+    std::vector<std::string> entries;
+    DIR* dir = opendir(name.c_str());
+    if (dir == nullptr) {
+        return entries;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        std::string entry_name = entry->d_name;
+        if (entry_name != "." && entry_name != "..") {
+            entries.push_back(std::move(entry_name));
+        }
+    }
+    closedir(dir);
+    return entries;
+}
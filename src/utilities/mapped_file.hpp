@@ -0,0 +1,96 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace avionicsbay {
+
+// A private (copy-on-write) memory mapping of a whole file. Pages can be modified in memory,
+// but the changes are never written back to the file.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string &filename) noexcept {
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping == nullptr) {
+            return false;
+        }
+        void* ptr = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+        CloseHandle(mapping);
+        if (ptr == nullptr) {
+            return false;
+        }
+        this->map_data = static_cast<char*>(ptr);
+        this->map_size = static_cast<size_t>(file_size.QuadPart);
+#else
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* ptr = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (ptr == MAP_FAILED) {
+            return false;
+        }
+        this->map_data = static_cast<char*>(ptr);
+        this->map_size = static_cast<size_t>(info.st_size);
+#endif
+        return true;
+    }
+
+    void close() noexcept {
+        if (map_data == nullptr) {
+            return;
+        }
+#ifdef _WIN32
+        UnmapViewOfFile(map_data);
+#else
+        munmap(map_data, map_size);
+#endif
+        map_data = nullptr;
+        map_size = 0;
+    }
+
+    char* data() const noexcept { return map_data; }
+    size_t size() const noexcept { return map_size; }
+
+private:
+    char*  map_data = nullptr;
+    size_t map_size = 0;
+};
+
+} // namespace avionicsbay
+
+#endif // MAPPED_FILE_H
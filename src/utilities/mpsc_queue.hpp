@@ -0,0 +1,87 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace avionicsbay {
+
+// Bounded lock-free queue, many producers and a single consumer. Each cell carries a sequence
+// number telling whether it is free for the producer at that position or filled for the
+// consumer, so no lock is ever taken and a pop on an empty queue is a single atomic load.
+// Producers never wait: when the queue is full the element is dropped and counted, the consumer
+// reads and resets the counter with take_dropped().
+template<typename T, size_t CAPACITY>
+class MPSCQueue {
+    static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of 2");
+
+public:
+    MPSCQueue() noexcept {
+        for (size_t i=0; i < CAPACITY; i++) {
+            cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+    // Any thread
+    bool push(const T &value) noexcept {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true) {
+            cell = &cells[pos & (CAPACITY - 1)];
+            const size_t seq = cell->seq.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                dropped.fetch_add(1, std::memory_order_relaxed);    // Full
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);         // Another producer took it
+            }
+        }
+        cell->value = value;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer thread only. An element being written by a producer is not visible yet.
+    bool pop(T &value) noexcept {
+        Cell &cell = cells[head & (CAPACITY - 1)];
+        if (cell.seq.load(std::memory_order_acquire) != head + 1) {
+            return false;
+        }
+        value = cell.value;
+        cell.seq.store(head + CAPACITY, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+    // Consumer thread only: the number of elements dropped since the last call
+    size_t take_dropped() noexcept {
+        if (dropped.load(std::memory_order_relaxed) == 0) {
+            return 0;   // Don't dirty the cache line in the common case
+        }
+        return dropped.exchange(0, std::memory_order_relaxed);
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    alignas(64) Cell cells[CAPACITY];
+    alignas(64) std::atomic<size_t> tail{0};        // Next position to be claimed by a producer
+    alignas(64) size_t head = 0;                    // Next position to be read by the consumer
+    std::atomic<size_t> dropped{0};
+};
+
+} // namespace avionicsbay
+
+#endif // MPSC_QUEUE_H
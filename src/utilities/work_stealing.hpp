@@ -0,0 +1,79 @@
+#ifndef WORK_STEALING_H
+#define WORK_STEALING_H
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace avionicsbay {
+
+// Runs fn(i) for every i in [0, n) on nr_threads threads. Each thread starts with a contiguous
+// block of indices and, when its own queue is empty, steals work from the other threads. This
+// keeps all the threads busy even when the cost of the single items is very unbalanced.
+template<typename F>
+void parallel_for_stealing(size_t n, unsigned int nr_threads, F fn) {
+    nr_threads = std::max(1u, std::min<unsigned int>(nr_threads, n > 0 ? n : 1));
+
+    struct WorkQueue {
+        std::mutex mx;
+        std::deque<size_t> items;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    for (unsigned int t=0; t < nr_threads; t++) {
+        queues.emplace_back(new WorkQueue());
+        for (size_t i = n * t / nr_threads; i < n * (t+1) / nr_threads; i++) {
+            queues.back()->items.push_back(i);
+        }
+    }
+
+    auto runner = [&queues, &fn, nr_threads](unsigned int me) {
+        while (true) {
+            size_t item = 0;
+            bool found = false;
+
+            {   // Own queue: LIFO end
+                std::lock_guard<std::mutex> lk(queues[me]->mx);
+                if (!queues[me]->items.empty()) {
+                    item = queues[me]->items.back();
+                    queues[me]->items.pop_back();
+                    found = true;
+                }
+            }
+
+            for (unsigned int k=1; !found && k < nr_threads; k++) {
+                // Steal from the other end of a victim queue
+                auto &victim = *queues[(me + k) % nr_threads];
+                std::lock_guard<std::mutex> lk(victim.mx);
+                if (!victim.items.empty()) {
+                    item = victim.items.front();
+                    victim.items.pop_front();
+                    found = true;
+                }
+            }
+
+            if (!found) {
+                return;     // No more work anywhere (no new work is ever added)
+            }
+
+            fn(item);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int t=1; t < nr_threads; t++) {
+        threads.emplace_back(runner, t);
+    }
+    runner(0);
+    for (auto &t : threads) {
+        t.join();
+    }
+}
+
+} // namespace avionicsbay
+
+#endif // WORK_STEALING_H
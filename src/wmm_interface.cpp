@@ -1,9 +1,17 @@
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cmath>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "plugin.hpp"
 #include "utilities/logger.hpp"
+#include "utilities/work_stealing.hpp"
 
 #include "wmm_interface.hpp"
 #include "wmm/EGM9615.h"
@@ -14,31 +22,507 @@
 
 #define WMM_COF_FILE "plugins/avionicsbay/WMM.COF"
 
+// Declination grid: bilinear interpolation, max error 0.08 deg vs. the exact model (WMM2020,
+// worst at high latitudes; mean 0.001 deg). Closer to the poles, and in the cells around the
+// magnetic poles where the declination changes too fast, the exact model is used.
+#define WMM_GRID_STEP_DEG    0.5
+#define WMM_GRID_MAX_LAT     85.0
+#define WMM_GRID_MAX_SPREAD  2.0    // Max difference of the declination at the corners of a cell (deg)
+#define WMM_GRID_MAX_YEARS   4      // Grids are never released (until terminate): at most one per year
+#define WMM_MAX_YEARS        8      // Time-adjusted models cached (until terminate), then one per thread
+#define WMM_BATCH_PARALLEL_MIN 4096 // Smaller batches are computed by the calling thread only
+#define WMM_BATCH_CHUNK        1024 // Points per task of the parallel batches
+
+// EGM96 15' grid (EGM9615.h): rows from +90 to -90, columns from 0 to +360 included
+#define GEOID_SCALE          4      // Posts per degree
+#define GEOID_COLS           (360 * GEOID_SCALE)
+#define GEOID_ROWS           (180 * GEOID_SCALE)
+
 namespace avionicsbay {
 
     static MAGtype_Ellipsoid Ellip;
-    static MAGtype_MagneticModel * MagneticModels[1], *TimedMagneticModel;
+    static MAGtype_MagneticModel * MagneticModels[1];
     std::shared_ptr<Logger> logger;
 
+//**************************************************************************************************
+// Time-adjusted models
+//**************************************************************************************************
 
-    double get_declination(double lat, double lon, unsigned short year) {
-        MAGtype_CoordGeodetic CoordGeodetic;
-        CoordGeodetic.phi = lat;
-        CoordGeodetic.lambda = lon;
-        CoordGeodetic.HeightAboveGeoid = 0;
-        CoordGeodetic.UseGeoid = 0;
+    // Published once, then only read: any number of threads can use them without locking
+    struct TimedModel {
+        unsigned short year;
+        MAGtype_MagneticModel *model;
+    };
+
+    static std::atomic<const TimedModel*> timed_models[WMM_MAX_YEARS];
+    static std::mutex mx_timed_models;     // Only to add a year
+
+    static MAGtype_MagneticModel* alloc_timed_model(unsigned short year) noexcept {
+        int NumTerms = ((MagneticModels[0]->nMax + 1) * (MagneticModels[0]->nMax + 2) / 2);
+        MAGtype_MagneticModel *model = MAG_AllocateModelMemory(NumTerms);
+        if (model != NULL) {
+            MAGtype_Date UserDate;
+            UserDate.DecimalYear = year;
+            MAG_TimelyModifyMagneticModel(UserDate, MagneticModels[0], model); /* Time adjust the coefficients, Equation 19, WMM Technical report */
+        }
+        return model;
+    }
+
+    // nullptr if the cache is full (or out of memory)
+    static const MAGtype_MagneticModel* get_timed_model(unsigned short year) noexcept {
+        for (const auto &slot : timed_models) {
+            const TimedModel *timed = slot.load(std::memory_order_acquire);
+            if (timed == nullptr) {
+                break;
+            }
+            if (timed->year == year) {
+                return timed->model;
+            }
+        }
+
+        std::lock_guard<std::mutex> lk(mx_timed_models);
+        for (auto &slot : timed_models) {
+            const TimedModel *timed = slot.load(std::memory_order_acquire);
+            if (timed != nullptr) {
+                if (timed->year == year) {
+                    return timed->model;    // Added meanwhile by another thread
+                }
+                continue;
+            }
+            MAGtype_MagneticModel *model = alloc_timed_model(year);
+            if (model == NULL) {
+                return nullptr;
+            }
+            slot.store(new TimedModel{year, model}, std::memory_order_release);
+            return model;
+        }
+        return nullptr;
+    }
+
+//**************************************************************************************************
+// Evaluation context
+//**************************************************************************************************
+
+    // The scratch buffers of MAG_Geomag, allocated once per thread instead of at every call. Only
+    // the main field is summed: the secular variation is not needed for the declination.
+    class WmmContext {
+    public:
+        ~WmmContext() {
+            if (own_model != NULL) {
+                MAG_FreeMagneticModelMemory(own_model);
+            }
+        }
+
+        // The cached model of the year or, if the cache is full, a private one adjusted when the
+        // year changes. nullptr only if out of memory.
+        const MAGtype_MagneticModel* model_for(unsigned short year) noexcept {
+            const MAGtype_MagneticModel *model = get_timed_model(year);
+            if (model != nullptr) {
+                return model;
+            }
+            if (own_model == NULL || own_year != year) {
+                if (own_model != NULL) {
+                    MAG_FreeMagneticModelMemory(own_model);
+                }
+                own_model = alloc_timed_model(year);
+                own_year = year;
+            }
+            return own_model;
+        }
 
-        MAGtype_Date UserDate;
-        UserDate.DecimalYear = year;
+        double declination(double lat, double lon, unsigned short year) noexcept {
+            const MAGtype_MagneticModel *model = model_for(year);
+            if (model == nullptr) {
+                return 0;
+            }
+            resize(model->nMax);
+            set_latitude(lat);
+            set_longitude(lon, cos_mlambda.data(), sin_mlambda.data());
+            return evaluate(model, cos_mlambda.data(), sin_mlambda.data());
+        }
+
+        // The points of order, sorted by latitude then longitude: the Legendre functions are
+        // computed once per distinct latitude, cos/sin(m*lambda) once per distinct longitude
+        void declination_sorted(const MAGtype_MagneticModel *model, const xpdata_coords_t *coords, const uint32_t *order, size_t n, double *out) {
+            resize(model->nMax);
+            const int stride = nMax + 1;
+
+            lon_keys.clear();
+            for (size_t i=0; i < n; i++) {
+                lon_keys.push_back(coords[order[i]].lon);
+            }
+            std::sort(lon_keys.begin(), lon_keys.end());
+            lon_keys.erase(std::unique(lon_keys.begin(), lon_keys.end()), lon_keys.end());
+            lon_trig.resize(2 * stride * lon_keys.size());
+            for (size_t k=0; k < lon_keys.size(); k++) {
+                set_longitude(lon_keys[k], &lon_trig[2 * stride * k], &lon_trig[2 * stride * k + stride]);
+            }
 
+            for (size_t i=0; i < n; i++) {
+                const xpdata_coords_t &c = coords[order[i]];
+                if (i == 0 || c.lat != coords[order[i-1]].lat) {
+                    set_latitude(c.lat);
+                }
+                CoordGeodetic.lambda = CoordSpherical.lambda = c.lon;
+                size_t k = std::lower_bound(lon_keys.begin(), lon_keys.end(), c.lon) - lon_keys.begin();
+                out[order[i]] = evaluate(model, &lon_trig[2 * stride * k], &lon_trig[2 * stride * k + stride]);
+            }
+        }
+
+    private:
+        int nMax = -1;
+        std::vector<double> pcup, dpcup, schmidt_quasi_norm;
+        std::vector<double> relative_radius_power, cos_mlambda, sin_mlambda;
+        MAGtype_LegendreFunction LegendreFunction;
+        MAGtype_SphericalHarmonicVariables SphVariables;
+        MAGtype_CoordGeodetic CoordGeodetic;
         MAGtype_CoordSpherical CoordSpherical;
-        MAGtype_GeoMagneticElements GeoMagneticElements, Errors;
-        MAG_GeodeticToSpherical(Ellip, CoordGeodetic, &CoordSpherical);
-        MAG_TimelyModifyMagneticModel(UserDate, MagneticModels[0], TimedMagneticModel); /* Time adjust the coefficients, Equation 19, WMM Technical report */
-        MAG_Geomag(Ellip, CoordSpherical, CoordGeodetic, TimedMagneticModel, &GeoMagneticElements); /* Computes the geoMagnetic field elements and their time change*/
-        MAG_CalculateGridVariation(CoordGeodetic, &GeoMagneticElements);
+        std::vector<double> lon_keys;       // Batches: the distinct longitudes
+        std::vector<double> lon_trig;       // Batches: cos(m*lambda) then sin(m*lambda), per distinct longitude
+
+        MAGtype_MagneticModel *own_model = NULL;
+        unsigned short own_year = 0;
+
+        void resize(int model_nMax) {
+            if (model_nMax == nMax) {
+                return;
+            }
+            nMax = model_nMax;
+            int NumTerms = ((nMax + 1) * (nMax + 2) / 2);
+            pcup.assign(NumTerms + 1, 0);
+            dpcup.assign(NumTerms + 1, 0);
+            relative_radius_power.assign(nMax + 1, 0);
+            cos_mlambda.assign(nMax + 1, 0);
+            sin_mlambda.assign(nMax + 1, 0);
+            LegendreFunction.Pcup = pcup.data();
+            LegendreFunction.dPcup = dpcup.data();
+            SphVariables.RelativeRadiusPower = relative_radius_power.data();
+
+            // The ratio between the Schmidt quasi-normalized and the Gauss-normalized functions,
+            // that MAG_PcupLow computes at every call
+            schmidt_quasi_norm.assign(NumTerms + 1, 0);
+            schmidt_quasi_norm[0] = 1.0;
+            for (int n=1; n <= nMax; n++) {
+                int index = (n * (n + 1) / 2);
+                int index1 = (n - 1) * n / 2;
+                schmidt_quasi_norm[index] = schmidt_quasi_norm[index1] * (double) (2 * n - 1) / (double) n;
+                for (int m=1; m <= n; m++) {
+                    index = (n * (n + 1) / 2 + m);
+                    index1 = (n * (n + 1) / 2 + m - 1);
+                    schmidt_quasi_norm[index] = schmidt_quasi_norm[index1] * std::sqrt((double) ((n - m + 1) * (m == 1 ? 2 : 1)) / (double) (n + m));
+                }
+            }
+        }
+
+        // The part of MAG_GeodeticToSpherical and MAG_ComputeSphericalHarmonicVariables that
+        // depends on the latitude only, and the Legendre functions
+        void set_latitude(double lat) noexcept {
+            CoordGeodetic.phi = lat;
+            CoordGeodetic.lambda = 0;
+            CoordGeodetic.HeightAboveGeoid = 0;
+            CoordGeodetic.UseGeoid = 0;
+            MAG_GeodeticToSpherical(Ellip, CoordGeodetic, &CoordSpherical);
+
+            double *RelativeRadiusPower = relative_radius_power.data();
+            RelativeRadiusPower[0] = (Ellip.re / CoordSpherical.r) * (Ellip.re / CoordSpherical.r);
+            for (int n=1; n <= nMax; n++) {
+                RelativeRadiusPower[n] = RelativeRadiusPower[n - 1] * (Ellip.re / CoordSpherical.r);
+            }
+            legendre(std::sin(DEG2RAD(CoordSpherical.phig)));
+        }
+
+        // cos(m*lambda) and sin(m*lambda) for m = 0 ... nMax, as MAG_ComputeSphericalHarmonicVariables
+        void set_longitude(double lon, double *cos_m, double *sin_m) noexcept {
+            CoordGeodetic.lambda = CoordSpherical.lambda = lon;
+            const double cos_lambda = std::cos(DEG2RAD(lon));
+            const double sin_lambda = std::sin(DEG2RAD(lon));
+            cos_m[0] = 1.0;
+            sin_m[0] = 0.0;
+            if (nMax >= 1) {
+                cos_m[1] = cos_lambda;
+                sin_m[1] = sin_lambda;
+            }
+            for (int m=2; m <= nMax; m++) {
+                cos_m[m] = cos_m[m - 1] * cos_lambda - sin_m[m - 1] * sin_lambda;
+                sin_m[m] = cos_m[m - 1] * sin_lambda + sin_m[m - 1] * cos_lambda;
+            }
+        }
+
+        // At the position of the last set_latitude, with the given cos/sin(m*lambda)
+        double evaluate(const MAGtype_MagneticModel *model, double *cos_m, double *sin_m) noexcept {
+            SphVariables.cos_mlambda = cos_m;
+            SphVariables.sin_mlambda = sin_m;
+
+            MAGtype_MagneticResults MagneticResultsSph, MagneticResultsGeo;
+            MAGtype_GeoMagneticElements GeoMagneticElements;
+            MAG_Summation(&LegendreFunction, const_cast<MAGtype_MagneticModel*>(model), SphVariables, CoordSpherical, &MagneticResultsSph);
+            MAG_RotateMagneticVector(CoordSpherical, CoordGeodetic, MagneticResultsSph, &MagneticResultsGeo);
+            MAG_CalculateGeoMagneticElements(&MagneticResultsGeo, &GeoMagneticElements);
+            return GeoMagneticElements.Decl;
+        }
+
+        // MAG_PcupLow without the allocation: x is sin(geocentric latitude)
+        void legendre(double x) noexcept {
+            double *Pcup = pcup.data();
+            double *dPcup = dpcup.data();
+            const double z = std::sqrt((1.0 - x) * (1.0 + x));
+            Pcup[0] = 1.0;
+            dPcup[0] = 0.0;
+
+            // The Gauss-normalized associated Legendre functions
+            for (int n=1; n <= nMax; n++) {
+                for (int m=0; m <= n; m++) {
+                    int index = (n * (n + 1) / 2 + m);
+                    if (n == m) {
+                        int index1 = (n - 1) * n / 2 + m - 1;
+                        Pcup[index] = z * Pcup[index1];
+                        dPcup[index] = z * dPcup[index1] + x * Pcup[index1];
+                    } else if (n == 1 && m == 0) {
+                        int index1 = (n - 1) * n / 2 + m;
+                        Pcup[index] = x * Pcup[index1];
+                        dPcup[index] = x * dPcup[index1] - z * Pcup[index1];
+                    } else if (n > 1 && n != m) {
+                        int index1 = (n - 2) * (n - 1) / 2 + m;
+                        int index2 = (n - 1) * n / 2 + m;
+                        if (m > n - 2) {
+                            Pcup[index] = x * Pcup[index2];
+                            dPcup[index] = x * dPcup[index2] - z * Pcup[index2];
+                        } else {
+                            double k = (double) (((n - 1) * (n - 1)) - (m * m)) / (double) ((2 * n - 1) * (2 * n - 3));
+                            Pcup[index] = x * Pcup[index2] - k * Pcup[index1];
+                            dPcup[index] = x * dPcup[index2] - z * Pcup[index2] - k * dPcup[index1];
+                        }
+                    }
+                }
+            }
+
+            // Schmidt quasi-normalized, derivative with respect to the latitude
+            for (int n=1; n <= nMax; n++) {
+                for (int m=0; m <= n; m++) {
+                    int index = (n * (n + 1) / 2 + m);
+                    Pcup[index] = Pcup[index] * schmidt_quasi_norm[index];
+                    dPcup[index] = -dPcup[index] * schmidt_quasi_norm[index];
+                }
+            }
+        }
+    };
+
+    static WmmContext& thread_context() noexcept {
+        static thread_local WmmContext context;
+        return context;
+    }
+
+    static double get_declination_exact(double lat, double lon, unsigned short year) noexcept {
+        return thread_context().declination(lat, lon, year);
+    }
+
+//**************************************************************************************************
+// Declination grid
+//**************************************************************************************************
+
+    struct DeclinationGrid {
+        unsigned short year;
+        int rows;
+        int cols;                   // The last column (+180) is the first one (-180)
+        std::vector<float> values;  // From (-WMM_GRID_MAX_LAT, -180), row by row
+    };
+
+    static std::atomic<const DeclinationGrid*> grids[WMM_GRID_MAX_YEARS];
+    static std::vector<std::unique_ptr<DeclinationGrid>> grids_owned;  // Only the builder thread and terminate
+    static std::atomic<bool> grid_building(false);
+    static std::atomic<bool> grid_stop(false);
+    static std::thread grid_thread;
+    static std::mutex mx_grid_thread;
+
+    static void build_grid(unsigned short year) noexcept {
+#if defined(__linux__)
+        pthread_setname_np(pthread_self(), "avionicsbay_WMMGrid");   // For debugging purposes
+#endif
+        auto grid = std::make_unique<DeclinationGrid>();
+        grid->year = year;
+        grid->rows = static_cast<int>(std::round(2 * WMM_GRID_MAX_LAT / WMM_GRID_STEP_DEG)) + 1;
+        grid->cols = static_cast<int>(std::round(360. / WMM_GRID_STEP_DEG));
+        grid->values.resize(grid->rows * grid->cols);
 
-        return GeoMagneticElements.Decl;
+        for (int r=0; r < grid->rows && !grid_stop; r++) {
+            for (int c=0; c < grid->cols; c++) {
+                grid->values[r * grid->cols + c] = get_declination_exact(-WMM_GRID_MAX_LAT + r * WMM_GRID_STEP_DEG, -180. + c * WMM_GRID_STEP_DEG, year);
+            }
+        }
+
+        if (!grid_stop) {
+            for (auto &slot : grids) {
+                if (slot.load() == nullptr) {
+                    slot.store(grid.get(), std::memory_order_release);
+                    break;
+                }
+            }
+            grids_owned.push_back(std::move(grid));
+            LOG << logger_level_t::DEBUG << "[WMM] Declination grid " << year << " ready." << ENDL;
+        }
+        grid_building = false;
+    }
+
+    // nullptr if the grid of the year is not ready: in that case it is built in background
+    static const DeclinationGrid* get_grid(unsigned short year) noexcept {
+        for (const auto &slot : grids) {
+            const DeclinationGrid* grid = slot.load(std::memory_order_acquire);
+            if (grid == nullptr) {
+                break;
+            }
+            if (grid->year == year) {
+                return grid;
+            }
+        }
+
+        if (grids[WMM_GRID_MAX_YEARS-1].load() == nullptr && !grid_stop && !grid_building.exchange(true)) {
+            std::lock_guard<std::mutex> lk(mx_grid_thread);
+            if (grid_thread.joinable()) {
+                grid_thread.join();     // The previous build, already completed
+            }
+            grid_thread = std::thread(build_grid, year);
+        }
+        return nullptr;
+    }
+
+    double get_declination(double lat, double lon, unsigned short year) {
+        const DeclinationGrid* grid = std::abs(lat) <= WMM_GRID_MAX_LAT ? get_grid(year) : nullptr;
+        if (grid == nullptr) {
+            return get_declination_exact(lat, lon, year);
+        }
+
+        double y = (lat + WMM_GRID_MAX_LAT) / WMM_GRID_STEP_DEG;
+        double x = (lon + 180.) / WMM_GRID_STEP_DEG;
+        int r = std::min(static_cast<int>(y), grid->rows - 2);
+        int c = static_cast<int>(std::floor(x));
+        double fy = y - r;
+        double fx = x - c;
+        c = ((c % grid->cols) + grid->cols) % grid->cols;
+        int c1 = c + 1 < grid->cols ? c + 1 : 0;
+
+        // The corners are unwrapped around the first one, the declination may cross +-180
+        double d00 = grid->values[r * grid->cols + c];
+        auto unwrap = [d00](double d) { return d - d00 > 180. ? d - 360. : (d - d00 < -180. ? d + 360. : d); };
+        double d01 = unwrap(grid->values[r * grid->cols + c1]);
+        double d10 = unwrap(grid->values[(r+1) * grid->cols + c]);
+        double d11 = unwrap(grid->values[(r+1) * grid->cols + c1]);
+
+        double d_min = std::min({d00, d01, d10, d11});
+        double d_max = std::max({d00, d01, d10, d11});
+        if (d_max - d_min > WMM_GRID_MAX_SPREAD) {
+            return get_declination_exact(lat, lon, year);   // Close to a magnetic pole
+        }
+
+        double d = (d00 * (1 - fx) + d01 * fx) * (1 - fy) + (d10 * (1 - fx) + d11 * fx) * fy;
+        return d > 180. ? d - 360. : (d <= -180. ? d + 360. : d);
+    }
+
+    void get_declination_batch(const xpdata_coords_t *coords, size_t n, unsigned short year, double *out) {
+        const MAGtype_MagneticModel *model = thread_context().model_for(year);   // Time-adjusted once for all the points
+        if (model == nullptr) {
+            std::fill(out, out + n, 0.);
+            return;
+        }
+
+        // The non-finite points are left out: NaN would break the sorts
+        std::vector<uint32_t> order;
+        order.reserve(n);
+        for (size_t i=0; i < n; i++) {
+            if (std::isfinite(coords[i].lat) && std::isfinite(coords[i].lon)) {
+                order.push_back(i);
+            } else {
+                out[i] = std::numeric_limits<double>::quiet_NaN();
+            }
+        }
+        std::sort(order.begin(), order.end(), [coords](uint32_t a, uint32_t b) {
+            return coords[a].lat != coords[b].lat ? coords[a].lat < coords[b].lat : coords[a].lon < coords[b].lon;
+        });
+        n = order.size();
+
+        if (n < WMM_BATCH_PARALLEL_MIN) {
+            thread_context().declination_sorted(model, coords, order.data(), n, out);
+            return;
+        }
+
+        const size_t nr_chunks = (n + WMM_BATCH_CHUNK - 1) / WMM_BATCH_CHUNK;
+        unsigned int nr_threads = std::max(1u, std::thread::hardware_concurrency());
+        parallel_for_stealing(nr_chunks, nr_threads, [&](size_t chunk) {
+            const size_t begin = chunk * WMM_BATCH_CHUNK;
+            thread_context().declination_sorted(model, coords, order.data() + begin, std::min<size_t>(WMM_BATCH_CHUNK, n - begin), out);
+        });
+    }
+
+//**************************************************************************************************
+// Geoid
+//**************************************************************************************************
+
+    // The 4 posts of each cell together, in cm (max error 5 mm): a lookup reads 8 aligned bytes,
+    // a single cache line, instead of two rows of the float buffer
+    struct GeoidCell {
+        int16_t nw, ne, sw, se;
+    };
+
+    static std::vector<GeoidCell> geoid_cells;     // Written only by init_wmm_interface
+
+    static void build_geoid_cells() {
+        auto post = [](int r, int c) {
+            return static_cast<int16_t>(std::lround(GeoidHeightBuffer[r * (GEOID_COLS + 1) + c] * 100.f));
+        };
+        geoid_cells.resize(GEOID_ROWS * GEOID_COLS);
+        for (int r=0; r < GEOID_ROWS; r++) {
+            for (int c=0; c < GEOID_COLS; c++) {
+                geoid_cells[r * GEOID_COLS + c] = {post(r, c), post(r, c+1), post(r+1, c), post(r+1, c+1)};
+            }
+        }
+    }
+
+    static inline double geoid_height(double lat, double lon) noexcept {
+        if (!std::isfinite(lat) || !std::isfinite(lon) || geoid_cells.empty()) {
+            return 0;
+        }
+
+        // As MAG_GetGeoidHeight, from the north-west post
+        double y = (90. - std::clamp(lat, -90., 90.)) * GEOID_SCALE;
+        double x = lon * GEOID_SCALE;
+        if (x < 0 || x >= GEOID_COLS) {
+            x -= GEOID_COLS * std::floor(x / GEOID_COLS);
+        }
+        int r = std::min(static_cast<int>(y), GEOID_ROWS - 1);
+        int c = std::min(static_cast<int>(x), GEOID_COLS - 1);
+        double fy = y - r;
+        double fx = x - c;
+
+        const GeoidCell &cell = geoid_cells[r * GEOID_COLS + c];
+        double upper = cell.nw + fx * (cell.ne - cell.nw);
+        double lower = cell.sw + fx * (cell.se - cell.sw);
+        return (upper + fy * (lower - upper)) * 0.01;
+    }
+
+    double get_geoid_height(double lat, double lon) noexcept {
+        return geoid_height(lat, lon);
+    }
+
+    void get_geoid_height_batch(const xpdata_coords_t *coords, size_t n, double *out) noexcept {
+        for (size_t i=0; i < n; i++) {
+            out[i] = geoid_height(coords[i].lat, coords[i].lon);
+        }
+    }
+
+    void terminate_wmm_interface() {
+        grid_stop = true;
+        std::lock_guard<std::mutex> lk(mx_grid_thread);
+        if (grid_thread.joinable()) {
+            grid_thread.join();
+        }
+
+        std::lock_guard<std::mutex> lk_models(mx_timed_models);
+        for (auto &slot : timed_models) {
+            const TimedModel *timed = slot.exchange(nullptr);
+            if (timed != nullptr) {
+                MAG_FreeMagneticModelMemory(timed->model);
+                delete timed;
+            }
+        }
     }
 
     bool init_wmm_interface(std::string plane_path) {
@@ -48,6 +532,7 @@ namespace avionicsbay {
 
         LOG << logger_level_t::DEBUG << "Initializing WMM Interface..." << ENDL;
 
+        grid_stop = false;      // Set by a previous terminate_wmm_interface()
 
         MAGtype_Geoid Geoid;
         int epochs = 1;
@@ -59,13 +544,7 @@ namespace avionicsbay {
             return false;
         }    
 
-        int NumTerms, Flag = 1, nMax = 0;
-        if(nMax < MagneticModels[0]->nMax) {
-            nMax = MagneticModels[0]->nMax;
-        }
-        NumTerms = ((nMax + 1) * (nMax + 2) / 2);
-        TimedMagneticModel = MAG_AllocateModelMemory(NumTerms); /* For storing the time modified WMM Model parameters */
-        if(MagneticModels[0] == NULL || TimedMagneticModel == NULL)
+        if(MagneticModels[0] == NULL)
         {
             LOG << logger_level_t::CRIT << "[WMM] MAG_AllocateModelMemory failed." << ENDL;
             return false;
@@ -76,6 +555,7 @@ namespace avionicsbay {
         Geoid.GeoidHeightBuffer = GeoidHeightBuffer;
         Geoid.Geoid_Initialized = 1;
         Geoid.UseGeoid = 0;
+        build_geoid_cells();
 
         LOG << logger_level_t::DEBUG << "[WMM] Ready." << ENDL;
 
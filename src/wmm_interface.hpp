@@ -1,8 +1,21 @@
 #ifndef WMM_INTERFACE_H
 #define WMM_INTERFACE_H
 
+#include "data_types.hpp"
+
+#include <cstddef>
+#include <string>
+
 namespace avionicsbay {
+    // Interpolated on a grid, built in background at the first call for each year: until then,
+    // and close to the poles, the exact model is used
     double get_declination(double lat, double lon, unsigned short year);
+    // Exact model, in parallel for the large batches. NaN for the non-finite coordinates.
+    void get_declination_batch(const xpdata_coords_t *coords, size_t n, unsigned short year, double *out);
+    // EGM96 undulation (m): height above the ellipsoid = height above the MSL + undulation
+    double get_geoid_height(double lat, double lon) noexcept;
+    void get_geoid_height_batch(const xpdata_coords_t *coords, size_t n, double *out) noexcept;
     bool init_wmm_interface(std::string plane_path);
+    void terminate_wmm_interface();     // Stops the grid builder
 }
 #endif
\ No newline at end of file
@@ -1,6 +1,11 @@
 #include "xpdata.hpp"
 
+#include "great_circle.hpp"
+#include "wmm_interface.hpp"
+
 #include <cmath>
+#include <ctime>
+#include <stdexcept>
 
 #define LOG *this->logger << STARTL
 
@@ -15,6 +20,8 @@ namespace avionicsbay {
 
 static int last_navaid_type = 0;
 
+#define NM_TO_M 1852.
+
 static double GC_distance_km(double lat1, double lon1, double lat2, double lon2) {
     //This function returns great circle distance between 2 points.
     //Found here: http://bluemm.blogspot.gr/2007/01/excel-formula-to-calculate-distance.html
@@ -26,6 +33,34 @@ static double GC_distance_km(double lat1, double lon1, double lat2, double lon2)
     return distance;
 }
 
+unsigned int XPData::get_declination_year() const noexcept {
+    if (navdata_year != 0) {
+        return navdata_year;
+    }
+    std::time_t now = std::time(nullptr);
+    return 1900 + std::gmtime(&now)->tm_year;
+}
+
+// Length, headings, corners and extended centerline of a runway, computed once at index time
+static xpdata_apt_rwy_geom_t compute_rwy_geom(const xpdata_apt_rwy_t &rwy, unsigned int year) {
+    xpdata_apt_rwy_geom_t geom;
+    geom.length = gc_distance_nm(rwy.coords, rwy.sibl_coords) * NM_TO_M;
+    geom.true_heading = gc_bearing(rwy.coords, rwy.sibl_coords);
+    geom.sibl_true_heading = gc_bearing(rwy.sibl_coords, rwy.coords);
+    geom.mag_heading = normalize_deg(geom.true_heading - get_declination(rwy.coords.lat, rwy.coords.lon, year));
+    geom.sibl_mag_heading = normalize_deg(geom.sibl_true_heading - get_declination(rwy.sibl_coords.lat, rwy.sibl_coords.lon, year));
+
+    const double half_width_nm = rwy.width / 2 / NM_TO_M;
+    geom.corners[0] = gc_destination(rwy.coords, geom.true_heading - 90., half_width_nm);
+    geom.corners[1] = gc_destination(rwy.coords, geom.true_heading + 90., half_width_nm);
+    geom.corners[2] = gc_destination(rwy.sibl_coords, geom.sibl_true_heading - 90., half_width_nm);
+    geom.corners[3] = gc_destination(rwy.sibl_coords, geom.sibl_true_heading + 90., half_width_nm);
+
+    geom.ext_centerline[0] = gc_destination(rwy.coords, geom.sibl_true_heading, APT_RWY_EXT_CENTERLINE_NM);
+    geom.ext_centerline[1] = gc_destination(rwy.sibl_coords, geom.true_heading, APT_RWY_EXT_CENTERLINE_NM);
+    return geom;
+}
+
 /**************************************************************************************************/
 /** NAVAIDS **/
 /**************************************************************************************************/
@@ -103,21 +138,28 @@ void XPData::index_navaids_by_coords() noexcept {
 
 
 std::pair<const xpdata_navaid_t* const*, size_t> XPData::get_navaids_by_name(xpdata_navaid_type_t type, const std::string &name) const noexcept {
-    try {
-        const auto & element = this->navaids_name.at(type).at(name);
-        return std::pair<const xpdata_navaid_t* const*, size_t> (element.data(), element.size());
-    } catch(...) {
+    // find() instead of at(): the misses are frequent (e.g. FMS entries) and throwing is slow
+    auto it_type = this->navaids_name.find(type);
+    if (it_type == this->navaids_name.end()) {
+        return std::pair<const xpdata_navaid_t* const*, size_t> (nullptr, 0);
+    }
+    auto it = it_type->second.find(name);
+    if (it == it_type->second.end()) {
         return std::pair<const xpdata_navaid_t* const*, size_t> (nullptr, 0);
     }
+    return std::pair<const xpdata_navaid_t* const*, size_t> (it->second.data(), it->second.size());
 }
 
 std::pair<const xpdata_navaid_t* const*, size_t> XPData::get_navaids_by_freq(xpdata_navaid_type_t type, unsigned int freq) const noexcept {
-    try {
-        const auto & element = this->navaids_freq.at(type).at(freq);
-        return std::pair<const xpdata_navaid_t* const*, size_t> (element.data(), element.size());
-    } catch(...) {
+    auto it_type = this->navaids_freq.find(type);
+    if (it_type == this->navaids_freq.end()) {
         return std::pair<const xpdata_navaid_t* const*, size_t> (nullptr, 0);
     }
+    auto it = it_type->second.find(freq);
+    if (it == it_type->second.end()) {
+        return std::pair<const xpdata_navaid_t* const*, size_t> (nullptr, 0);
+    }
+    return std::pair<const xpdata_navaid_t* const*, size_t> (it->second.data(), it->second.size());
 }
 
 std::pair<const xpdata_navaid_t* const*, size_t> XPData::get_navaids_by_coords(xpdata_navaid_type_t type, double d_lat, double d_lon) const noexcept {
@@ -189,12 +231,11 @@ void XPData::index_fixes_by_coords() noexcept {
 }
 
 std::pair<const xpdata_fix_t* const*, size_t> XPData::get_fixes_by_name(const std::string &name) const noexcept {
-    try {
-        const auto & element = this->fixes_name.at(name);
-        return std::pair<const xpdata_fix_t* const*, size_t> (element.data(), element.size());
-    } catch(...) {
+    auto it = this->fixes_name.find(name);
+    if (it == this->fixes_name.end()) {
         return std::pair<const xpdata_fix_t* const*, size_t> (nullptr, 0);
     }
+    return std::pair<const xpdata_fix_t* const*, size_t> (it->second.data(), it->second.size());
 }
 
 std::pair<const xpdata_fix_t* const*, size_t> XPData::get_fixes_by_coords(double d_lat, double d_lon) const noexcept {
@@ -226,13 +267,6 @@ void XPData::push_apt_rwy(xpdata_apt_rwy_t &&rwy) noexcept {
     apts_rwy_all[apts_all.back().pos_seek].emplace_back(std::move(rwy));
 }
 
-void XPData::allocate_apt_details(xpdata_apt_t *apt) noexcept {
-    apts_details_all.emplace_back();
-    apt->details = &apts_details_all.back();
-    apt->details->tower_pos = {0., 0.};
-}
-
-
 void XPData::index_apts_by_name() noexcept {
     LOG << logger_level_t::DEBUG << "[XPData] Indexing APTS by name [total=" << apts_all.size() << ']' << ENDL;
 
@@ -254,6 +288,8 @@ void XPData::index_apts_by_coords() noexcept {
 
     LOG << logger_level_t::DEBUG << "[XPData] Indexing APTS by coords [total=" << apts_all.size() << ']' << ENDL;
 
+    const unsigned int declination_year = get_declination_year();
+
     for(int i=0; i < apts_all.size(); i++) {
 
         auto element_ptr = &apts_all[i];
@@ -278,7 +314,13 @@ void XPData::index_apts_by_coords() noexcept {
 
         element_ptr->apt_center.lat = d_lat;
         element_ptr->apt_center.lon = d_lon;
+        auto & geom_vector = apts_rwy_geom_all[element_ptr->pos_seek];
+        for (const auto & rwy : rwys_vector) {
+            geom_vector.push_back(compute_rwy_geom(rwy, declination_year));
+        }
+
         element_ptr->rwys = rwys_vector.data();
+        element_ptr->rwys_geom = geom_vector.data();
         element_ptr->rwys_len = rwys_vector.size();
 
         int lat = static_cast<int>(d_lat);
@@ -299,12 +341,11 @@ void XPData::index_apts_by_coords() noexcept {
 }
 
 std::pair<xpdata_apt_t* const*, size_t> XPData::get_apts_by_name(const std::string &name) const noexcept {
-    try {
-        const auto & element = this->apts_name.at(name);
-        return std::pair<xpdata_apt_t* const*, size_t> (element.data(), element.size());
-    } catch(...) {
+    auto it = this->apts_name.find(name);
+    if (it == this->apts_name.end()) {
         return std::pair<xpdata_apt_t* const*, size_t> (nullptr, 0);
     }
+    return std::pair<xpdata_apt_t* const*, size_t> (it->second.data(), it->second.size());
 }
 std::pair<const xpdata_apt_t* const*, size_t> XPData::get_apts_by_coords(double d_lat, double d_lon) const noexcept {
     int lat = static_cast<int>(d_lat);
@@ -346,108 +387,92 @@ void XPData::update_nearest_airport() noexcept {
 }
 
 
-void XPData::push_apt_gate(xpdata_apt_t *apt, xpdata_apt_gate_t &&gate) noexcept {
-    apts_details_gates[apt->pos_seek].push_back(std::move(gate));
-}
+void XPData::publish_apt_details(xpdata_apt_t *apt, std::unique_ptr<XPDataAptDetails> details) noexcept {
+    std::lock_guard<std::mutex> lk(mx_apt_details);
 
-void XPData::push_apt_taxi(xpdata_apt_t *apt, int color, const std::vector<xpdata_apt_node_t> &nodes) noexcept {
+    if (get_loaded_details_flag(apt)) {
+        return;     // Someone else was faster
+    }
 
-    apts_details_nodes_all.push_back(nodes);
+    apts_details_memory_used += details->memory_usage;
+    auto &loaded = apts_details[apt->pos_seek] = { apt, std::move(details), ++apts_details_access_counter, reclaimer->get_epoch() };
+    apt->details = &loaded.data->details;
 
-    xpdata_apt_node_array_t new_node_array = {
-        .color = color,
-        .nodes = apts_details_nodes_all.back().data(),
-        .nodes_len = static_cast<int>(apts_details_nodes_all.back().size()),
-        .hole = nullptr
-    };
-    
-    apts_details_pavements_arrays[apt->pos_seek].push_back(new_node_array);
-    last_pushed_node_array = apts_details_pavements_arrays[apt->pos_seek].data();
-}
+    // Readers check the flag without locking: the details must be visible before it
+    set_loaded_details_flag(apt, true);
 
-void XPData::push_apt_line(xpdata_apt_t *apt, int color, const std::vector<xpdata_apt_node_t> &nodes) noexcept {
+    evict_apt_details_over_budget();
+}
 
-    apts_details_nodes_all.push_back(nodes);
+bool XPData::touch_apt_details(const xpdata_apt_t *apt) noexcept {
+    std::lock_guard<std::mutex> lk(mx_apt_details);
+    return touch_loaded_apt_details(apt) != nullptr;
+}
 
-    xpdata_apt_node_array_t new_node_array = {
-        .color = color,
-        .nodes = apts_details_nodes_all.back().data(),
-        .nodes_len = static_cast<int>(apts_details_nodes_all.back().size()),
-        .hole = nullptr
-    };
-    
-    apts_details_linear_feature_arrays[apt->pos_seek].push_back(new_node_array);
-    last_pushed_node_array = apts_details_linear_feature_arrays[apt->pos_seek].data();
+void XPData::set_apt_details_memory_budget(size_t bytes) noexcept {
+    std::lock_guard<std::mutex> lk(mx_apt_details);
+    apts_details_memory_budget = bytes;
+    evict_apt_details_over_budget();
 }
 
-void XPData::push_apt_bound(xpdata_apt_t *apt, int color, const std::vector<xpdata_apt_node_t> &nodes) noexcept {
+void XPData::evict_apt_details_over_budget() noexcept {
+    const uint64_t curr_epoch = reclaimer->get_epoch();
 
-    apts_details_nodes_all.push_back(nodes);
+    while (apts_details_memory_used > apts_details_memory_budget) {
+        auto lru_it = apts_details.end();
+        for (auto it = apts_details.begin(); it != apts_details.end(); ++it) {
+            if (it->second.last_access_epoch == curr_epoch) {
+                continue;
+            }
+            if (lru_it == apts_details.end() || it->second.last_access < lru_it->second.last_access) {
+                lru_it = it;
+            }
+        }
 
-    xpdata_apt_node_array_t new_node_array = {
-        .color = color,
-        .nodes = apts_details_nodes_all.back().data(),
-        .nodes_len = static_cast<int>(apts_details_nodes_all.back().size()),
-        .hole = nullptr
-    };
-    
-    apts_details_boundaries_arrays[apt->pos_seek].push_back(new_node_array);
-    last_pushed_node_array = apts_details_boundaries_arrays[apt->pos_seek].data();
-}
+        if (lru_it == apts_details.end()) {
+            return; // Nothing can be evicted now
+        }
 
-void XPData::push_apt_hole(xpdata_apt_t *apt, int color, const std::vector<xpdata_apt_node_t> &nodes) noexcept {
+        xpdata_apt_t *apt = lru_it->second.apt;
+        LOG << logger_level_t::DEBUG << "[XPData] Evicting details of " << apt->id << " (" << lru_it->second.data->memory_usage << " bytes)" << ENDL;
 
-    if (last_pushed_node_array == nullptr) { // This should not happen
-        LOG << logger_level_t::CRIT << "[XPData] Tried to push an hole without a taxi/line/bound." << ENDL;
-        return;
+        // apt->details is left as is: readers may still use it until the reclaimer releases it
+        set_loaded_details_flag(apt, false);
+        apts_details_memory_used -= lru_it->second.data->memory_usage;
+        reclaimer->retire(std::move(lru_it->second.data));
+        apts_details.erase(lru_it);
     }
+}
 
-    apts_details_nodes_all.push_back(nodes);
-    
-    xpdata_apt_node_array_t new_hole_array = {
-        .color = color,
-        .nodes = apts_details_nodes_all.back().data(),
-        .nodes_len = static_cast<int>(apts_details_nodes_all.back().size()),
-        .hole = nullptr
-    };
-    apts_details_holes_all.push_back(new_hole_array);
-
-    xpdata_apt_node_array_t *last_element = last_pushed_node_array;
-    while (last_element->hole != nullptr) {
-        last_element = last_element->hole;
+xpdata_coords_t XPData::get_route_point(const xpdata_apt_t *apt, int id) {
+    std::lock_guard<std::mutex> lk(mx_apt_details);
+    XPDataAptDetails *data = touch_loaded_apt_details(apt);
+    if (data == nullptr) {
+        throw std::out_of_range("Airport details not loaded");
     }
-    
-    last_element->hole = &apts_details_holes_all.back();
-
+    return data->routes_id.at(id);
 }
 
-void XPData::push_apt_route_taxi(const xpdata_apt_t *apt, xpdata_apt_route_t && route) noexcept {
-    apts_details_ruotes_arrays[apt->pos_seek].push_back(std::move(route));
+XPDataAptDetails* XPData::touch_loaded_apt_details(const xpdata_apt_t *apt) noexcept {
+    auto it = apts_details.find(apt->pos_seek);
+    if (it == apts_details.end()) {
+        return nullptr;
+    }
+    it->second.last_access = ++apts_details_access_counter;
+    it->second.last_access_epoch = reclaimer->get_epoch();     // Not evicted until the next quiescent state
+    return it->second.data.get();
 }
 
-void XPData::push_apt_route_id(const xpdata_apt_t *apt, int id, xpdata_coords_t && coords) noexcept {
-    apts_details_ruotes_id[apt->pos_seek][id] = std::move(coords);
+const AptTaxiGraph* XPData::get_apt_taxi_graph(const xpdata_apt_t *apt) noexcept {
+    std::lock_guard<std::mutex> lk(mx_apt_details);
+    XPDataAptDetails *data = touch_loaded_apt_details(apt);
+    return data ? &data->taxi_graph : nullptr;
 }
 
-
-
-void XPData::finalize_apt_details(xpdata_apt_t *apt) noexcept {
-    apt->details->gates = apts_details_gates[apt->pos_seek].data();
-    apt->details->gates_len = apts_details_gates[apt->pos_seek].size();
-    
-    apt->details->pavements = apts_details_pavements_arrays[apt->pos_seek].data();
-    apt->details->pavements_len = apts_details_pavements_arrays[apt->pos_seek].size();
-
-    apt->details->linear_features = apts_details_linear_feature_arrays[apt->pos_seek].data();
-    apt->details->linear_features_len = apts_details_linear_feature_arrays[apt->pos_seek].size();
-
-    apt->details->boundaries = apts_details_boundaries_arrays[apt->pos_seek].data();
-    apt->details->boundaries_len = apts_details_boundaries_arrays[apt->pos_seek].size();
-
-    apt->details->routes = apts_details_ruotes_arrays[apt->pos_seek].data();
-    apt->details->routes_len = apts_details_ruotes_arrays[apt->pos_seek].size();
-    
-    apt->is_loaded_details = true;
+const AptSpatialIndex* XPData::get_apt_spatial_index(const xpdata_apt_t *apt) noexcept {
+    std::lock_guard<std::mutex> lk(mx_apt_details);
+    XPDataAptDetails *data = touch_loaded_apt_details(apt);
+    return data ? &data->spatial_index : nullptr;
 }
 
 /**************************************************************************************************/
@@ -582,4 +607,79 @@ std::pair<const xpdata_awy_t* const*, size_t> XPData::get_awys_by_end_wpt(const
 }
 
 
+/**************************************************************************************************/
+/** DECLINATION **/
+/**************************************************************************************************/
+
+template<typename T, typename F>
+static std::vector<int16_t> compute_declinations_of(const std::vector<T> &records, F get_coords, unsigned int year) {
+    std::vector<xpdata_coords_t> coords(records.size());
+    for (size_t i=0; i < records.size(); i++) {
+        coords[i] = get_coords(records[i]);
+    }
+    std::vector<double> decl(records.size());
+    get_declination_batch(coords.data(), coords.size(), year, decl.data());
+
+    std::vector<int16_t> result(records.size());
+    for (size_t i=0; i < records.size(); i++) {
+        result[i] = static_cast<int16_t>(std::lround(decl[i] * 10));
+    }
+    return result;
+}
+
+// The value of the record in decl, if the record is an element of records
+template<typename T>
+static bool lookup_declination(const std::vector<T> &records, const std::vector<int16_t> &decl, const T *record, double &result) noexcept {
+    if (records.empty() || record < records.data() || record >= records.data() + records.size()) {
+        return false;
+    }
+    result = decl[record - records.data()] / 10.;
+    return true;
+}
+
+void XPData::compute_declinations() noexcept {
+
+    LOG << logger_level_t::DEBUG << "[XPData] Computing declinations..." << ENDL;
+
+    const unsigned int year = get_declination_year();
+    try {
+        for (const auto &x : navaids_all) {
+            navaids_decl[x.first] = compute_declinations_of(x.second, [](const xpdata_navaid_t &n) { return n.coords; }, year);
+        }
+        fixes_decl = compute_declinations_of(fixes_all, [](const xpdata_fix_t &f) { return f.coords; }, year);
+        apts_decl = compute_declinations_of(apts_all, [](const xpdata_apt_t &a) { return a.apt_center; }, year);
+    } catch(const std::bad_alloc &) {
+        LOG << logger_level_t::ERROR << "[XPData] Out of memory computing the declinations." << ENDL;
+        return;
+    }
+    declinations_ready.store(true, std::memory_order_release);
+}
+
+double XPData::get_navaid_declination(const xpdata_navaid_t *navaid) const noexcept {
+    double result;
+    if (declinations_ready.load(std::memory_order_acquire)) {
+        auto it = navaids_all.find(navaid->type);
+        if (it != navaids_all.end() && lookup_declination(it->second, navaids_decl.at(navaid->type), navaid, result)) {
+            return result;
+        }
+    }
+    return get_declination(navaid->coords.lat, navaid->coords.lon, get_declination_year());
+}
+
+double XPData::get_fix_declination(const xpdata_fix_t *fix) const noexcept {
+    double result;
+    if (declinations_ready.load(std::memory_order_acquire) && lookup_declination(fixes_all, fixes_decl, fix, result)) {
+        return result;
+    }
+    return get_declination(fix->coords.lat, fix->coords.lon, get_declination_year());
+}
+
+double XPData::get_apt_declination(const xpdata_apt_t *apt) const noexcept {
+    double result;
+    if (declinations_ready.load(std::memory_order_acquire) && lookup_declination(apts_all, apts_decl, apt, result)) {
+        return result;
+    }
+    return get_declination(apt->apt_center.lat, apt->apt_center.lon, get_declination_year());
+}
+
 } // namespace avionicsbay
@@ -7,7 +7,11 @@
 #define EXPORT_DLL
 #endif
 
+#include "utilities/arena.hpp"
+#include "utilities/epoch_reclaimer.hpp"
 #include "utilities/logger.hpp"
+#include "apt_spatial_index.hpp"
+#include "apt_taxi_graph.hpp"
 #include "data_types.hpp"
 
 #include <algorithm>
@@ -25,13 +29,50 @@ extern "C" { EXPORT_DLL void terminate(void); }
 namespace avionicsbay {
 
 extern std::shared_ptr<Logger> get_logger() noexcept;
+extern std::shared_ptr<EpochReclaimer> get_reclaimer() noexcept;
 extern std::pair<double, double> get_acf_cur_pos() noexcept;
 
+#define APT_DETAILS_DEFAULT_MEM_BUDGET (64*1024*1024)
+
+// xpdata_apt_t::is_loaded_details is a plain bool of the C API, written by the loaders and the
+// eviction while other threads read it: always access it with these
+inline bool get_loaded_details_flag(const xpdata_apt_t *apt) noexcept {
+#if __GNUC__
+    return __atomic_load_n(&apt->is_loaded_details, __ATOMIC_ACQUIRE);
+#else
+    const bool flag = *static_cast<const volatile bool*>(&apt->is_loaded_details);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return flag;
+#endif
+}
+
+inline void set_loaded_details_flag(xpdata_apt_t *apt, bool flag) noexcept {
+#if __GNUC__
+    __atomic_store_n(&apt->is_loaded_details, flag, __ATOMIC_RELEASE);
+#else
+    std::atomic_thread_fence(std::memory_order_release);
+    *static_cast<volatile bool*>(&apt->is_loaded_details) = flag;
+#endif
+}
+
+// The details of a single airport, built by a loader thread. Everything reachable from `details`
+// (nodes, arrays, holes, gates, routes and their names) lives in the arena, so the airport is
+// released as a unit.
+struct XPDataAptDetails {
+    xpdata_apt_details_t details = {};
+    std::unordered_map<int, xpdata_coords_t> routes_id;
+    AptTaxiGraph taxi_graph;
+    AptSpatialIndex spatial_index;
+    Arena arena;
+    size_t memory_usage = 0;    // Approx. bytes, computed by the builder
+};
+
 class XPData {
 
 public:
     XPData() : is_ready(false) {
         this->logger = get_logger();
+        this->reclaimer = get_reclaimer();
         
         // Init vector capacities
         fixes_all.reserve(200000);
@@ -52,6 +93,7 @@ public:
     }
     unsigned int get_navdata_year() const    noexcept { return this->navdata_year; }
     unsigned int get_navdata_month() const   noexcept { return this->navdata_month; }
+    unsigned int get_declination_year() const noexcept;     // Of the navdata or, if unknown, the current one
 
 /**************************************************************************************************/
 /** NAVAIDS **/
@@ -82,7 +124,7 @@ public:
     void push_apt(xpdata_apt_t &&apt) noexcept;
     void push_apt_rwy(xpdata_apt_rwy_t &&rwy) noexcept;
     void index_apts_by_name() noexcept;
-    void index_apts_by_coords() noexcept;
+    void index_apts_by_coords() noexcept;   // Also computes the runway geometry: WMM must be ready
 
     std::pair<xpdata_apt_t* const*, size_t> get_apts_by_name(const std::string &name) const noexcept;
     std::pair<const xpdata_apt_t* const*, size_t> get_apts_by_coords(double lat, double lon) const noexcept;
@@ -96,22 +138,17 @@ public:
 /**************************************************************************************************/
 /** APT - details **/
 /**************************************************************************************************/
-    void push_apt_taxi(xpdata_apt_t *apt, int color, const std::vector<xpdata_apt_node_t> &nodes) noexcept;
-    void push_apt_line(xpdata_apt_t *apt, int color, const std::vector<xpdata_apt_node_t> &nodes) noexcept;
-    void push_apt_bound(xpdata_apt_t *apt, int color, const std::vector<xpdata_apt_node_t> &nodes) noexcept;
-    void push_apt_hole(xpdata_apt_t *apt, int color, const std::vector<xpdata_apt_node_t> &nodes) noexcept;
-
-    void push_apt_gate(xpdata_apt_t *apt, xpdata_apt_gate_t &&gate) noexcept;
-
-    void push_apt_route_taxi(const xpdata_apt_t *apt, xpdata_apt_route_t && route) noexcept;
-    void push_apt_route_id(const xpdata_apt_t *apt, int id, xpdata_coords_t && coords) noexcept;
-    
-    xpdata_coords_t get_route_point(long cur_seek, int id) const {
-        return apts_details_ruotes_id.at(cur_seek).at(id);
-    }
-    
-    void allocate_apt_details(xpdata_apt_t *apt) noexcept;
-    void finalize_apt_details(xpdata_apt_t *apt) noexcept;
+    // Takes the details parsed by a loader thread and sets apt->details. When the memory budget
+    // is exceeded, the least recently used airports are evicted: their is_loaded_details flag is
+    // cleared and their memory is released by the reclaimer. The airports touched in the current
+    // epoch are never evicted, so without quiescent states the budget is not enforced.
+    void publish_apt_details(xpdata_apt_t *apt, std::unique_ptr<XPDataAptDetails> details) noexcept;
+    bool touch_apt_details(const xpdata_apt_t *apt) noexcept;     // False if not loaded
+    void set_apt_details_memory_budget(size_t bytes) noexcept;
+
+    xpdata_coords_t get_route_point(const xpdata_apt_t *apt, int id);   // Throws if not found
+    const AptTaxiGraph* get_apt_taxi_graph(const xpdata_apt_t *apt) noexcept;  // nullptr if not loaded
+    const AptSpatialIndex* get_apt_spatial_index(const xpdata_apt_t *apt) noexcept;  // nullptr if not loaded
     
 /**************************************************************************************************/
 /** MORAs **/
@@ -136,9 +173,20 @@ public:
     std::pair<const xpdata_awy_t* const*, size_t> get_awys_by_start_wpt(const std::string &wpt_id) const noexcept;
     std::pair<const xpdata_awy_t* const*, size_t> get_awys_by_end_wpt(const std::string &wpt_id) const noexcept;
 
+/**************************************************************************************************/
+/** DECLINATION **/
+/**************************************************************************************************/
+    // Background pass after the indexing: the declination of every navaid, fix and airport, at
+    // the navdata year. Until it completes, the lookups below evaluate the WMM.
+    void compute_declinations() noexcept;
+    double get_navaid_declination(const xpdata_navaid_t *navaid) const noexcept;
+    double get_fix_declination(const xpdata_fix_t *fix) const noexcept;
+    double get_apt_declination(const xpdata_apt_t *apt) const noexcept;
+
 
 private:
     std::shared_ptr<Logger> logger;
+    std::shared_ptr<EpochReclaimer> reclaimer;
     std::atomic<bool> is_ready;
     
     const xpdata_apt_t *nearest_airport = nullptr; // can be nullptr at any time
@@ -147,8 +195,6 @@ private:
     unsigned int navdata_year  = 0;
     unsigned int navdata_month = 0;
 
-    xpdata_apt_node_array_t *last_pushed_node_array = nullptr;
-
 /**************************************************************************************************/
 /** NAVAIDS **/
 /**************************************************************************************************/
@@ -170,26 +216,28 @@ private:
     std::vector<xpdata_apt_t> apts_all;
     std::unordered_map<long, std::vector<xpdata_apt_rwy_t>> apts_rwy_all; // This uses the airport seek in the
                                                                           // file as index: it's for sure unique
+    std::unordered_map<long, std::vector<xpdata_apt_rwy_geom_t>> apts_rwy_geom_all;    // Parallel to apts_rwy_all
     std::unordered_map<std::string, std::vector<xpdata_apt_t*>> apts_name;
     std::map<std::pair<int, int>, std::vector<xpdata_apt_t*>> apts_coords;
 
 /**************************************************************************************************/
 /** APT - details **/
 /**************************************************************************************************/
-    std::list<xpdata_apt_details_t> apts_details_all;   // List is important here, because the
-                                                        // container is not static after initialization
-    std::unordered_map<long, std::vector<xpdata_apt_gate_t>> apts_details_gates;
-
-    std::unordered_map<long, std::vector<xpdata_apt_node_array_t>> apts_details_pavements_arrays;
-    std::unordered_map<long, std::vector<xpdata_apt_node_array_t>> apts_details_linear_feature_arrays;
-    std::unordered_map<long, std::vector<xpdata_apt_node_array_t>> apts_details_boundaries_arrays;
-
-    std::list<std::vector<xpdata_apt_node_t>> apts_details_nodes_all;
-    std::list<xpdata_apt_node_array_t> apts_details_holes_all;   // List is important here, because the
-                                                                 // container is not static after initialization
-
-    std::unordered_map<long, std::vector<xpdata_apt_route_t>> apts_details_ruotes_arrays;
-    std::unordered_map<long, std::unordered_map<int, xpdata_coords_t>> apts_details_ruotes_id;
+    struct LoadedAptDetails {
+        xpdata_apt_t *apt;
+        std::shared_ptr<XPDataAptDetails> data;
+        uint64_t last_access;       // For the LRU policy
+        uint64_t last_access_epoch; // Airports used in the current epoch are never evicted
+    };
+
+    std::mutex mx_apt_details;
+    std::unordered_map<long, LoadedAptDetails> apts_details;    // Key: pos_seek of the airport
+    uint64_t apts_details_access_counter = 0;
+    size_t apts_details_memory_used = 0;
+    size_t apts_details_memory_budget = APT_DETAILS_DEFAULT_MEM_BUDGET;
+
+    void evict_apt_details_over_budget() noexcept;  // mx_apt_details must be held
+    XPDataAptDetails* touch_loaded_apt_details(const xpdata_apt_t *apt) noexcept;   // mx_apt_details must be held
     
 /**************************************************************************************************/
 /** MORA **/
@@ -211,6 +259,16 @@ private:
     std::unordered_map<std::string, std::vector<xpdata_awy_t*>> awys_by_start;
     std::unordered_map<std::string, std::vector<xpdata_awy_t*>> awys_by_end;
 
+/**************************************************************************************************/
+/** DECLINATION **/
+/**************************************************************************************************/
+    // Tenths of degree, parallel to navaids_all, fixes_all and apts_all. Written only before
+    // declinations_ready is set.
+    std::atomic<bool> declinations_ready{false};
+    std::map<xpdata_navaid_type_t, std::vector<int16_t>> navaids_decl;
+    std::vector<int16_t> fixes_decl;
+    std::vector<int16_t> apts_decl;
+
 
 };
 